@@ -0,0 +1,365 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              bank.cpp
+	DESCRIPTION:       The library's interface, which keeps a database open and works on it
+	COMPILER:          Built on g++ with c++11
+
+	Until something needs the whole database, accounts are only fetched from the storage engine
+	one at a time as they are asked for, and kept in the table in account number order.
+	Anything closed stays in the table, so a later lookup doesn't fetch the old copy back
+	from storage before the close has been saved.
+
+	Other processes are kept out with flock() on a lock file next to the database, rather than
+	on the database itself, since some storage engines replace their files with new ones.
+	The lock is held from open until the bank goes away, after every change has been saved.
+	Working optimistically, each change is saved as soon as it is made, so that it can be
+	made over again from fresh copies of its accounts if another process got to them first.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include "bank.h"
+#include "server.h"
+#include "shard.h"
+#include "settle.h"
+#include "schedule.h"
+
+using namespace std;
+
+struct Bank::State {
+	vector<Account> people;
+	unique_ptr<Storage> storage;
+	//Whether every account has been read in, rather than just the ones asked for
+	bool loaded;
+	//The lock file, and what the database was locked for
+	int lock;
+	int access;
+	string fileName;
+};
+
+Bank::Bank() : state(new State) {
+	state->loaded = false;
+	state->lock = -1;
+	state->access = BANK_WRITE;
+}
+
+//Waits for the lock file to be locked the given way
+static bool lockFile(int fd, int how) {
+	while(flock(fd, how) == -1) {
+		if(errno != EINTR) return false;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          ~Bank()
+DESCRIPTION:       Saves every change and closes the database
+----------------------------------------------------------------------------- */
+Bank::~Bank() {
+	if(state->storage != nullptr) WriteOnShutdown::saveDatabase(&state->people, state->storage.get());
+	//The database is closed before letting go of the lock, so nobody sees it half written
+	state->storage.reset();
+	if(state->lock != -1) ::close(state->lock);
+	delete state;
+}
+
+int Bank::open(const char* fileName, const char* engine) {
+	return open(fileName, engine, BANK_WRITE);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          open()
+DESCRIPTION:       Locks the database for a kind of access, then opens it
+RETURNS:           0, or an exit code if the database couldn't be locked or opened
+NOTES:             A database which doesn't exist yet is always created under an exclusive lock.
+                   Changing accounts one at a time with an engine which can't lock them
+                   falls back to locking the whole database
+----------------------------------------------------------------------------- */
+int Bank::open(const char* fileName, const char* engine, int access) {
+	if(state->storage != nullptr || fileName == nullptr) return ERR_DB_NOT_FOUND;
+	if(access < BANK_READ || access > BANK_WRITE_OPTIMISTIC) return ERR_NO_INFO;
+	if(engine != nullptr && unique_ptr<Storage>(makeStorage(engine)) == nullptr) return ERR_NO_ENGINE;
+
+	state->lock = ::open((string(fileName) + LOCK_SUFFIX).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(state->lock == -1) return ERR_DB_NOT_FOUND;
+	bool exclusive = access == BANK_WRITE || ::access(fileName, F_OK) != 0;
+	if(!lockFile(state->lock, exclusive ? LOCK_EX : LOCK_SH)) return ERR_DB_NOT_FOUND;
+
+	state->storage.reset(openStorage(fileName, engine));
+	if(state->storage == nullptr) return ERR_DB_NOT_FOUND;
+	//Engines which can't lock accounts get by on the shared lock, since every writer they could meet has an exclusive one
+	if(access == BANK_READ) state->storage->lockRecords(false);
+	bool shared = true;
+	if(access == BANK_WRITE_RECORDS) shared = state->storage->lockRecords(true);
+	if(access == BANK_WRITE_OPTIMISTIC) shared = state->storage->versionRecords();
+	if(!shared) {
+		//Whatever was read under the shared lock could be out of date by the time the exclusive one is had
+		state->storage.reset();
+		access = BANK_WRITE;
+		if(!lockFile(state->lock, LOCK_EX)) return ERR_DB_NOT_FOUND;
+		state->storage.reset(openStorage(fileName, engine));
+		if(state->storage == nullptr) return ERR_DB_NOT_FOUND;
+	}
+	state->access = access;
+	state->fileName = fileName;
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          load()
+DESCRIPTION:       Reads in every account and sorts them by account number
+RETURNS:           0, or an exit code if the database couldn't be read
+NOTES:             Anything already fetched and changed is saved first, so the fresh copy has the changes
+----------------------------------------------------------------------------- */
+int Bank::load() {
+	if(state->storage == nullptr) return ERR_DB_NOT_FOUND;
+	if(state->loaded) return 0;
+	//Other processes can be changing accounts all through the database, so there is no whole copy of it to read
+	if(state->access == BANK_WRITE_RECORDS || state->access == BANK_WRITE_OPTIMISTIC) return ERR_NOT_LOCKED;
+	if(!state->people.empty() && !WriteOnShutdown::saveDatabase(&state->people, state->storage.get())) return ERR_STORAGE_ERR;
+
+	state->people.clear();
+	if(!state->storage->scan([&](Account* acc) {
+		state->people.push_back(*acc);
+		return true;
+	})) return ERR_DB_NOT_FOUND;
+	radixSort(&state->people);
+	addHighestNumber(&state->people, state->storage.get());
+	state->loaded = true;
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          fetch()
+DESCRIPTION:       Finds an open account, getting it from the storage engine if it hasn't been read in yet
+RETURNS:           A pointer into the table, or nullptr if there is no such open account
+NOTES:             Fetching can move the table around, so only the latest pointer is safe to use
+----------------------------------------------------------------------------- */
+Account* Bank::fetch(const char* number, const char* password) {
+	if(state->storage == nullptr || number == nullptr || password == nullptr) return nullptr;
+	vector<Account>& people = state->people;
+	unsigned long long key = accountKey(number);
+	vector<Account>::iterator it = lower_bound(people.begin(), people.end(), key, [](const Account& acc, unsigned long long key) {
+		return accountKey(acc.number) < key;
+	});
+
+	bool closed = false;
+	for(vector<Account>::iterator same = it; same != people.end() && accountKey(same->number) == key; same++) {
+		if(strcmp(same->password, password)) continue;
+		if(!same->closed) return &*same;
+		closed = true;
+	}
+	if(state->loaded || closed) return nullptr;
+
+	Account acc;
+	if(!state->storage->get(number, password, &acc)) return nullptr;
+	return &*people.insert(it, acc);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          apply()
+DESCRIPTION:       Makes a change to the accounts it fetches. Working optimistically, the change is made to fresh
+                   copies of them and saved straight away, and made over again if another process saved any of them first
+RETURNS:           0, or the change's exit code
+NOTES:             Somebody else has always saved a change whenever this one has to be made again,
+                   so every process gets through eventually
+----------------------------------------------------------------------------- */
+int Bank::apply(function<int()> change) {
+	if(state->access != BANK_WRITE_OPTIMISTIC) return change();
+	vector<Account>& people = state->people;
+	while(true) {
+		//Nothing is kept between changes, so every account is fetched again at the version it is at now
+		people.clear();
+		int err = change();
+		vector<Account*> changed;
+		for(Account& acc : people) {
+			if(acc.dirty) changed.push_back(&acc);
+		}
+		if(err != 0 || changed.empty()) {
+			people.clear();
+			return err;
+		}
+
+		int result = state->storage->putIfUnchanged(&changed);
+		if(result == PUT_CONFLICT) continue;
+		for(Account* acc : changed) acc->dirty = false;
+		return result == PUT_DONE ? 0 : ERR_STORAGE_ERR;
+	}
+}
+
+int Bank::lookup(const char* number, const char* password, Account* out) {
+	Account* acc = fetch(number, password);
+	if(acc == nullptr) return ERR_NO_ACCOUNT;
+	*out = *acc;
+	return 0;
+}
+
+int Bank::query(function<bool(const Account&)> visit) {
+	int err = load();
+	if(err != 0) return err;
+	for(Account& acc : state->people) {
+		if(!acc.closed && !visit(acc)) break;
+	}
+	return 0;
+}
+
+int Bank::update(const char* number, const char* password, char change, const char* value) {
+	//Only the field changes go through here, not transfers or closing
+	string copy(value == nullptr ? "" : value);
+	BatchOp op = {nullptr, nullptr, change, &copy[0], nullptr, nullptr, nullptr, nullptr};
+	if(value == nullptr || change == O_TRANS || change == O_CLOSE || !validBatchOp(&op)) return ERR_NO_INFO;
+	if(state->access == BANK_READ) return ERR_NOT_LOCKED;
+	return apply([&]() {
+		Account* acc = fetch(number, password);
+		if(acc == nullptr) return ERR_NO_ACCOUNT;
+		changeAccount(acc, change, &copy[0]);
+		return 0;
+	});
+}
+
+int Bank::transfer(const char* number, const char* password, const char* toNumber, const char* toPassword, const char* amount) {
+	string copy(amount == nullptr ? "" : amount);
+	if(amount == nullptr || !validValue(O_TRANS, &copy[0])) return ERR_NO_INFO;
+	if(state->access == BANK_READ) return ERR_NOT_LOCKED;
+	return apply([&]() {
+		//Fetched in account number order, so two processes locking accounts one at a time
+		//can't each end up holding the account the other is waiting for
+		if(number != nullptr && toNumber != nullptr && accountKey(toNumber) < accountKey(number)) fetch(toNumber, toPassword);
+		if(fetch(number, password) == nullptr) return ERR_NO_ACCOUNT;
+		Account* to = fetch(toNumber, toPassword);
+		if(to == nullptr) return ERR_NO_TRANSFER_ACCOUNT;
+		//Fetching the second account could have moved the first
+		Account* from = fetch(number, password);
+		to = fetch(toNumber, toPassword);
+		return ::transfer(from, to, &copy[0]);
+	});
+}
+
+int Bank::close(const char* number, const char* password) {
+	//Closing changes where accounts are kept, which only a lock on the whole database allows
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	Account* acc = fetch(number, password);
+	if(acc == nullptr) return ERR_NO_ACCOUNT;
+	acc->closed = true;
+	acc->dirty = true;
+	return 0;
+}
+
+int Bank::create(const char* value, Account* out) {
+	string copy(value == nullptr ? "" : value);
+	if(value == nullptr || !validValue(O_CREATE, &copy[0])) return ERR_NO_INFO;
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	int err = load();
+	if(err != 0) return err;
+	Account* acc;
+	err = createAccount(&state->people, &copy[0], &acc);
+	if(err != 0) return err;
+	if(out != nullptr) *out = *acc;
+	return 0;
+}
+
+int Bank::batch(vector<BatchOp>* ops) {
+	for(BatchOp& op : *ops) {
+		if(!validBatchOp(&op)) return ERR_NO_INFO;
+	}
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	int err = load();
+	if(err != 0) return err;
+	return runScheduledBatch(&state->people, ops, 0);
+}
+
+int Bank::batch(vector<BatchOp>* ops, unsigned int cores) {
+	return batch(ops, cores, nullptr);
+}
+
+int Bank::batch(vector<BatchOp>* ops, unsigned int cores, vector<const char*>* hot) {
+	for(BatchOp& op : *ops) {
+		if(!validBatchOp(&op)) return ERR_NO_INFO;
+	}
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	int err = load();
+	if(err != 0) return err;
+	return runShardedBatch(&state->people, ops, cores, hot);
+}
+
+int Bank::settle(vector<BatchOp>* ops, unsigned int threads) {
+	//Only transfers can be netted
+	for(BatchOp& op : *ops) {
+		if(op.change != O_TRANS || !validBatchOp(&op)) return ERR_NO_INFO;
+	}
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	int err = load();
+	if(err != 0) return err;
+	return settleBatch(&state->people, ops, threads);
+}
+
+int Bank::report(const char* fileName) {
+	int err = load();
+	if(err != 0) return err;
+	return createReport(&state->people, fileName) ? 0 : ERR_REPORT_FILE_ERR;
+}
+
+int Bank::exportTo(const char* engine, const char* fileName) {
+	if(unique_ptr<Storage>(makeStorage(engine)) == nullptr) return ERR_NO_ENGINE;
+	int err = load();
+	if(err != 0) return err;
+	return copyDatabase(&state->people, engine, fileName) ? 0 : ERR_STORAGE_ERR;
+}
+
+int Bank::commit() {
+	if(state->storage == nullptr) return ERR_DB_NOT_FOUND;
+	return WriteOnShutdown::saveDatabase(&state->people, state->storage.get()) ? 0 : ERR_STORAGE_ERR;
+}
+
+int Bank::checkpoint() {
+	if(state->access == BANK_READ) return ERR_NOT_LOCKED;
+	int err = commit();
+	if(err != 0) return err;
+	return state->storage->checkpoint() ? 0 : ERR_STORAGE_ERR;
+}
+
+int Bank::compact() {
+	//Compaction moves accounts around, and every one of them needs its slot updated
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	int err = load();
+	if(err == 0) err = commit();
+	if(err != 0) return err;
+	return state->storage->compact(&state->people) ? 0 : ERR_STORAGE_ERR;
+}
+
+void Bank::stats(ostream& out) {
+	if(state->storage != nullptr) state->storage->stats(out);
+}
+
+int Bank::serve(const char* path) {
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	int err = load();
+	if(err == 0) err = commit();
+	if(err != 0) return err;
+	return ::serve(&state->people, state->storage.get(), path, nullptr) ? 0 : ERR_SERVER_ERR;
+}
+
+//The group's journal, snapshot and term are kept in files named after the database
+int Bank::serve(const char* path, unsigned int me, vector<const char*>* peers) {
+	return serve(path, me, peers, nullptr, nullptr);
+}
+
+//The feed has to outlast the Replica, whose thread is what sends to it
+int Bank::serve(const char* path, unsigned int me, vector<const char*>* peers, const char* feedPath, const char* feedFile) {
+	if(state->access != BANK_WRITE) return ERR_NOT_LOCKED;
+	if(peers == nullptr || me >= peers->size()) return ERR_NO_INFO;
+	int err = load();
+	if(err == 0) err = commit();
+	if(err != 0) return err;
+	ChangeFeed feed;
+	if(feedPath != nullptr && !feed.listen(feedPath)) return ERR_SERVER_ERR;
+	if(feedFile != nullptr && !feed.openFile(feedFile)) return ERR_SERVER_ERR;
+	Replica replica(state->fileName.c_str(), me, peers);
+	if(feedPath != nullptr || feedFile != nullptr) replica.feedTo(&feed);
+	return ::serve(&state->people, state->storage.get(), path, &replica) ? 0 : ERR_SERVER_ERR;
+}
@@ -0,0 +1,94 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              bank.h
+
+DESCRIPTION:       The library's interface. A Bank is one open database, which only reads as much
+                   of the database as it has to and saves every change when it is destroyed.
+                   Everything returns 0 or one of the program's exit codes
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __BANK_H__
+#define __BANK_H__
+
+#include <vector>
+#include <functional>
+#include <ostream>
+#include "bankacct.h"
+
+//How a Bank is going to use its database, which decides how it is locked against other processes.
+//Reading lets other readers in at the same time, and changing the whole database locks everybody else out.
+//Changing accounts one at a time shares the database with other processes doing the same, locking just
+//the accounts it touches, if the storage engine can do that. Changing accounts optimistically doesn't even
+//keep them locked, and makes each change over again if another process changed the same accounts first.
+//If the storage engine can't do either of those, the whole database gets locked
+#define BANK_READ 0
+#define BANK_WRITE 1
+#define BANK_WRITE_RECORDS 2
+#define BANK_WRITE_OPTIMISTIC 3
+
+//Added to the database's file name for the file the whole database is locked with
+#define LOCK_SUFFIX ".lock"
+
+class Bank {
+	private:
+		//Kept out of the header so the class never changes size as the library changes
+		struct State;
+		State* state;
+
+		Account* fetch(const char*, const char*);
+		int apply(function<int()>);
+	public:
+		Bank();
+		~Bank();
+		Bank(const Bank&) = delete;
+		Bank& operator=(const Bank&) = delete;
+
+		//Opens a database, working out the storage engine from the file if none is given, to change the whole of it
+		int open(const char*, const char*);
+		//Opens a database for one of the kinds of access, waiting for other processes to let go of it
+		int open(const char*, const char*, int);
+		//Reads in every account, which anything working on the whole database does by itself
+		int load();
+
+		//Copies out an open account by its number and password
+		int lookup(const char*, const char*, Account*);
+		//Goes through every open account in account number order, until the function returns false
+		int query(function<bool(const Account&)>);
+
+		//Changes one field, using the action option letters and values
+		int update(const char*, const char*, char, const char*);
+		//Moves an amount from the first account to the second
+		int transfer(const char*, const char*, const char*, const char*, const char*);
+		int close(const char*, const char*);
+		//Opens a new account from first,last,middle,social,area,phone,password, copying it out with its new number
+		int create(const char*, Account*);
+		//Makes every change in a batch, looking all of the accounts up at once. Changes to different
+		//accounts run on every core, with the same result as making them one after another
+		int batch(vector<BatchOp>*);
+		//Makes every change in a batch thread-per-core, on this many cores (0 for all of them)
+		int batch(vector<BatchOp>*, unsigned int);
+		//The same, with the balances of the hot accounts with these numbers split between the cores
+		int batch(vector<BatchOp>*, unsigned int, vector<const char*>*);
+		//Nets a batch of transfers into one change to each account, adding them up on this many threads (0 for every core)
+		int settle(vector<BatchOp>*, unsigned int);
+
+		int report(const char*);
+		//Writes a copy of the database with another storage engine
+		int exportTo(const char*, const char*);
+		int commit();
+		int checkpoint();
+		int compact();
+		void stats(ostream&);
+		//Serves the database on a Unix socket until a client shuts the server down
+		int serve(const char*);
+		//The same, as this server of a group which replicates every change, given the Unix socket each server uses for the group.
+		//Every server in the group has to start out with the same database
+		int serve(const char*, unsigned int, vector<const char*>*);
+		//The same, also sending every change made to subscribers on a Unix socket and into a rotated file, either of which can be null
+		int serve(const char*, unsigned int, vector<const char*>*, const char*, const char*);
+};
+
+#endif
@@ -12,6 +12,14 @@
 		- 5: The report file could not be written
 		- 6: An account to transfer to was needed, but not supplied
 		- 7: The ammount of money to transfer was too much such that it would bring someone's balance negative
+		- 8: There are no account numbers left to give to a new account
+		- 9: A binary copy of the database could not be written
+		- 10: An LSM copy of the database could not be written
+		- 11: The database could not be checkpointed or compacted
+		- 12: The storage engine asked for doesn't exist
+		- 13: The server couldn't listen on its socket or save a change
+		- 14: The database wasn't locked for that kind of change
+		- 15: A replicated server was asked for a change, but it isn't the leader of its group
 	
 	MODIFICATION HISTORY:
 	Author                  Date               Version
@@ -21,41 +29,38 @@
 ----------------------------------------------------------------------------- */
 
 #include <cstring>
-#include <fstream>
-#include <cmath>
+#include <cstdlib>
 #include <vector>
-#include <algorithm> //For std::sort
-#include <regex>
-#include <iomanip>
 #include <iostream>
 #include <map>
+#include <string>
+#include <memory>
 #include "bankacct.h"
+#include "bank.h"
 
 using namespace std;
 
 void sortArgs(map<char, vector<char*>>*, int, char*[]);
-int parseArgs(map<char, vector<char*>>*, vector<Account>*);
+int parseArgs(map<char, vector<char*>>*);
 char* yankArg(map<char, vector<char*>>*, char);
+bool validArgs(map<char, vector<char*>>*);
+bool parseBatch(map<char, vector<char*>>*, vector<BatchOp>*);
+int loadNeeded(map<char, vector<char*>>*);
+int accessNeeded(map<char, vector<char*>>*);
 
 void helpMenu();
 void displayInfo(Account*);
 
-Account* findAccount(vector<Account>*, char*, char*);
-
-bool createReport(vector<Account>*, char*);
-bool loadDatabase(vector<Account>*, char*);
-
 /* -----------------------------------------------------------------------------
 FUNCTION:          main()
 DESCRIPTION:       Sorts the arguments, then runs them
 RETURNS:           See Exit Codes
 ----------------------------------------------------------------------------- */
 int main(int argc, char* argv[]) {
-	vector<Account> people;
 	map<char, vector<char*>> args;
 
 	sortArgs(&args, argc, argv);
-	return parseArgs(&args, &people);	
+	return parseArgs(&args);	
 }
 
 /* -----------------------------------------------------------------------------
@@ -73,7 +78,8 @@ NOTES:             The map's keys are the switches,
 ----------------------------------------------------------------------------- */
 void sortArgs(map<char, vector<char*>>* args, int argc, char* argv[]) {
 	char* arg;
-	for(int i = 0; i < argc; i++) {
+	//Skip the program name, which would look like an option if it was run with a full path
+	for(int i = 1; i < argc; i++) {
 		arg = argv[i];
 		//Check for a valid argument
 		if(arg[0] != SLASH || arg[1] == '\0') continue;
@@ -96,7 +102,7 @@ FUNCTION:          parseArgs()
 DESCRIPTION:       Goes through the list of arguments and actually performs the functions
 RETURNS:           See Exit Codes
 ----------------------------------------------------------------------------- */
-int parseArgs(map<char, vector<char*>>* args, vector<Account>* people) {	
+int parseArgs(map<char, vector<char*>>* args) {	
 	//Conditions for help menu
 	if(args->empty() || args->find(O_HELP) != args->end()) {
 		helpMenu();
@@ -107,128 +113,173 @@ int parseArgs(map<char, vector<char*>>* args, vector<Account>* people) {
 		return ERR_NO_DB;
 	}
 
-	//Load the database file
+	//Check every value before touching the database, so a bad one costs nothing
+	vector<BatchOp> batch;
+	if(!validArgs(args) || !parseBatch(args, &batch)) return ERR_NO_INFO;
+
+	//Open the database file
 	//If two databases are specified, default to the last one
 	//If we weren't succesful, return
-	if(!loadDatabase(people, args->at(O_DATA).back())) {
+	//The storage engine can be picked with an option, otherwise it is worked out from the file
+	//Only as much of the database as the options need gets read, which might be nothing at all
+	//The bank saves every change whenever it goes away, for any reason
+	//Other processes can use the database at the same time, as far as the options allow
+	char* engine = yankArg(args, O_ENGINE);
+	if(engine != nullptr && unique_ptr<Storage>(makeStorage(engine)) == nullptr) return ERR_NO_ENGINE;
+	int needed = loadNeeded(args);
+	if(needed == LOAD_NOTHING) return 0;
+	Bank bank;
+	int err = bank.open(args->at(O_DATA).back(), engine, accessNeeded(args));
+	if(err == 0 && needed == LOAD_ALL) err = bank.load();
+	if(err != 0) {
 		cout << "ERR! Could not load \"" << args->at(O_DATA).back() << "\"";
 		return ERR_DB_NOT_FOUND;
 	}
 
-	//WriteOnShutdown is a class which writes my database file whenever I exit, for any reason
-	WriteOnShutdown write(args->at(O_DATA).back(), people);
-
-	//Sort by Account number
-	sort(people->begin(), people->end(), [](Account& a, Account& b) {
-		return strcmp(a.number, b.number) < 0;
-	});
-
-	Account* acc;
-	Account* acc2;
+	//The account the last option acted on, which the next one falls back to if it doesn't name one
+	Account last;
+	bool haveLast = false;
+	char* number;
+	char* password;
 	char* buf;
+	Account created;
 
 	for(pair<char, vector<char*>> arg : *args) {
 		//Ordered by priority
 		switch(arg.first) {
 			case O_CHANGE_AREA:
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) {
-					if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-					else acc = acc2;
-				}
-				buf = yankArg(args, O_CHANGE_AREA);
-				if(buf == nullptr || !regex_match(buf, regex(R_AREA))) return ERR_NO_INFO;
-				acc->area = atoi(buf);
-				break;
 			case O_CHANGE_F:
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) {
-					if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-					else acc = acc2;
-				}
-				buf = yankArg(args, O_CHANGE_F);
-				if(buf == nullptr || !regex_match(buf, regex(R_NAME))) return ERR_NO_INFO;
-				strcpy(acc->first, buf);
-				break;
 			case O_CHANGE_PHONE:
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) {
-					if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-					else acc = acc2;
-				}
-				buf = yankArg(args, O_CHANGE_PHONE);
-				if(buf == nullptr || !regex_match(buf, regex(R_PHONE))) return ERR_NO_INFO;
-				acc->phone = atoi(buf);
-				break;	
 			case O_CHANGE_L:
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) {
-					if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-					else acc = acc2;
+			case O_CHANGE_M:
+			case O_CHANGE_SSN:
+			case O_NEWPASS:
+				number = yankArg(args, O_NUM);
+				password = yankArg(args, O_PASS);
+				buf = yankArg(args, arg.first);
+				if(buf == nullptr) return ERR_NO_INFO;
+				if(bank.lookup(number, password, &last) != 0) {
+					if(!haveLast) return ERR_NO_ACCOUNT;
+					number = last.number;
+					password = last.password;
 				}
-				buf = yankArg(args, O_CHANGE_L);
-				if(buf == nullptr || !regex_match(buf, regex(R_NAME))) return ERR_NO_INFO;
-				strcpy(acc->last, buf);
+				err = bank.update(number, password, arg.first, buf);
+				if(err != 0) return err;
+				bank.lookup(number, arg.first == O_NEWPASS ? buf : password, &last);
+				haveLast = true;
 				break;
-			case O_CHANGE_M:
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) {
-					if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-					else acc = acc2;
+			case O_TRANS:
+				number = yankArg(args, O_NUM);
+				password = yankArg(args, O_PASS);
+				{
+					char* toNumber = yankArg(args, O_NUM);
+					char* toPassword = yankArg(args, O_PASS);
+					buf = yankArg(args, O_TRANS);
+					if(buf == nullptr) return bank.lookup(number, password, &last) != 0 ? ERR_NO_ACCOUNT : ERR_NO_INFO;
+					//The bank gets both accounts itself, in the order which keeps it from deadlocking with other processes
+					err = bank.transfer(number, password, toNumber, toPassword, buf);
+					if(err != 0) return err;
 				}
-				buf = yankArg(args, O_CHANGE_M);
-				if(buf == nullptr || !isalpha(*buf)) return ERR_NO_INFO;
-				acc->middle = *buf;
+				bank.lookup(number, password, &last);
+				haveLast = true;
 				break;
-			case O_CHANGE_SSN:
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) {
-					if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-					else acc = acc2;
+			case O_BATCH:
+				haveLast = false;
+				buf = yankArg(args, O_SETTLE);
+				if(buf != nullptr) {
+					err = bank.settle(&batch, atoi(buf));
+					if(err != 0) return err;
+					break;
 				}
-				buf = yankArg(args, O_CHANGE_SSN);
-				if(buf == nullptr || !regex_match(buf, regex(R_SSN))) return ERR_NO_INFO;
-				acc->social = atoi(buf);
+				buf = yankArg(args, O_CORES);
+				if(buf == nullptr) {
+					err = bank.batch(&batch);
+				} else {
+					//Hot accounts only matter when the batch is split between cores
+					vector<const char*> hot;
+					for(char* hotNumber = yankArg(args, O_HOT); hotNumber != nullptr; hotNumber = yankArg(args, O_HOT)) hot.push_back(hotNumber);
+					err = bank.batch(&batch, atoi(buf), &hot);
+				}
+				if(err != 0) return err;
 				break;
-			case O_TRANS: {
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) return ERR_NO_ACCOUNT;
-				acc2 = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc2 == nullptr) return ERR_NO_TRANSFER_ACCOUNT;
-				buf = yankArg(args, O_TRANS);
-				if(buf == nullptr || !regex_match(buf, regex(R_NAME))) return ERR_NO_INFO;
-				if(acc->balance < atoi(buf)) return ERR_TOO_MUCH_TRANSFER;
-				acc->balance -= atoi(buf);
-				acc2->balance += atoi(buf);
+			case O_CREATE:
+				buf = yankArg(args, O_CREATE);
+				if(buf == nullptr) return ERR_NO_INFO;
+				err = bank.create(buf, &created);
+				if(err != 0) return err;
+				cout << created.number << endl;
+				last = created;
+				haveLast = true;
 				break;
-			}
-			case O_NEWPASS:
-				acc = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc == nullptr) {
-					if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-					else acc = acc2;
+			case O_CLOSE:
+				yankArg(args, O_CLOSE);
+				number = yankArg(args, O_NUM);
+				password = yankArg(args, O_PASS);
+				if(bank.lookup(number, password, &last) != 0) {
+					if(!haveLast) return ERR_NO_ACCOUNT;
+					number = last.number;
+					password = last.password;
 				}
-				buf = yankArg(args, O_NEWPASS);
-				if(buf == nullptr || !regex_match(buf, regex(R_PASS))) return ERR_NO_INFO;
-				strcpy(acc->password, buf);
+				err = bank.close(number, password);
+				if(err != 0) return err;
+				//Nothing else can act on an account once it's closed
+				haveLast = false;
 				break;
 		}
-		acc2 = acc;
-		buf = nullptr;
 	}
 
 	for(pair<char, vector<char*>> arg : *args) {
 		switch(arg.first) {
 			case O_INFO:
 				yankArg(args,O_INFO);
-				acc2 = findAccount(people, yankArg(args, O_NUM), yankArg(args, O_PASS));
-				if(acc2 == nullptr) acc2 = acc;
-				if(acc2 == nullptr) return ERR_NO_ACCOUNT;
-				displayInfo(acc2);
+				number = yankArg(args, O_NUM);
+				password = yankArg(args, O_PASS);
+				if(bank.lookup(number, password, &last) != 0) {
+					if(!haveLast || bank.lookup(last.number, last.password, &last) != 0) return ERR_NO_ACCOUNT;
+				}
+				displayInfo(&last);
 				break;
 			case O_REPORT:
-				if(!createReport(people, yankArg(args, O_REPORT))) return ERR_REPORT_FILE_ERR;
+				err = bank.report(yankArg(args, O_REPORT));
+				if(err != 0) return err;
 				break;	
+			case O_EXPORT_BIN:
+				if(bank.exportTo(ENGINE_BINARY, yankArg(args, O_EXPORT_BIN)) != 0) return ERR_BINARY_FILE_ERR;
+				break;
+			case O_EXPORT_LSM:
+				if(bank.exportTo(ENGINE_LSM, yankArg(args, O_EXPORT_LSM)) != 0) return ERR_LSM_FILE_ERR;
+				break;
+			case O_STATS:
+				yankArg(args, O_STATS);
+				bank.stats(cout);
+				break;
+			case O_CHECKPOINT:
+				yankArg(args, O_CHECKPOINT);
+				if(bank.checkpoint() != 0) return ERR_STORAGE_ERR;
+				break;
+			case O_COMPACT:
+				yankArg(args, O_COMPACT);
+				if(bank.compact() != 0) return ERR_STORAGE_ERR;
+				break;
+			case O_SERVE: {
+				//Either just the socket, or socket,n,peer,peer,... to serve as the nth of a replicated group
+				char* value = yankArg(args, O_SERVE);
+				char* path = value == nullptr ? nullptr : strtok(value, BATCH_SEPARATOR);
+				char* me = path == nullptr ? nullptr : strtok(nullptr, BATCH_SEPARATOR);
+				if(me == nullptr) {
+					if(args->find(O_FEED) != args->end() || args->find(O_FEED_FILE) != args->end()) return ERR_NO_INFO;
+					if(bank.serve(path) != 0) return ERR_SERVER_ERR;
+					break;
+				}
+				if(strspn(me, "0123456789") != strlen(me)) return ERR_NO_INFO;
+				vector<const char*> peers;
+				for(char* peer = strtok(nullptr, BATCH_SEPARATOR); peer != nullptr; peer = strtok(nullptr, BATCH_SEPARATOR)) peers.push_back(peer);
+				//The change feed comes out of the group's journal, so there's only one for a replicated server
+				char* feed = yankArg(args, O_FEED);
+				char* feedFile = yankArg(args, O_FEED_FILE);
+				if(bank.serve(path, strtoul(me, nullptr, 10), &peers, feed, feedFile) != 0) return ERR_SERVER_ERR;
+				break;
+			}
 		}
 	}
 
@@ -259,16 +310,46 @@ char* yankArg(map<char, vector<char*>>* args, char arg) {
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION:          findAccount()
-DESCRIPTION:       Finds an account based on the account number and password
-RETURNS:           A pointer to the found account
+FUNCTION:          validArgs()
+DESCRIPTION:       Checks the value of every option which changes an account
+RETURNS:           Whether every value is valid
+NOTES:             This runs before the database is loaded, so nothing after it has to check the values again
 ----------------------------------------------------------------------------- */
-Account* findAccount(vector<Account>* people, char* number, char* password) {
-	if(number == nullptr || password == nullptr) return nullptr;
-	for(Account& acc : *people) {
-		if(!strcmp(acc.number, number) && !strcmp(acc.password, password)) return &acc;
+bool validArgs(map<char, vector<char*>>* args) {
+	for(pair<const char, vector<char*>>& arg : *args) {
+		for(char* value : arg.second) {
+			if(!validValue(arg.first, value)) return false;
+		}
 	}
-	return nullptr;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          parseBatch()
+DESCRIPTION:       Splits every batch option into its changes, checking each one
+RETURNS:           Whether every change was valid
+NOTES:             A change is number,password,change where the change is an option letter and its value,
+                   like A123B,PASS12,H5551234. A transfer also names the account to send to,
+                   like A123B,PASS12,T10.50,C456D,PASS34, and closing an account is just X.
+----------------------------------------------------------------------------- */
+bool parseBatch(map<char, vector<char*>>* args, vector<BatchOp>* batch) {
+	if(args->find(O_BATCH) == args->end()) return true;
+	for(char* value : args->at(O_BATCH)) {
+		BatchOp op;
+		op.number = strtok(value, BATCH_SEPARATOR);
+		op.password = strtok(nullptr, BATCH_SEPARATOR);
+		char* change = strtok(nullptr, BATCH_SEPARATOR);
+		if(op.number == nullptr || op.password == nullptr || change == nullptr) return false;
+		op.change = *change;
+		op.value = change + 1;
+		op.toNumber = strtok(nullptr, BATCH_SEPARATOR);
+		op.toPassword = strtok(nullptr, BATCH_SEPARATOR);
+		op.acc = nullptr;
+		op.to = nullptr;
+		if(strtok(nullptr, BATCH_SEPARATOR) != nullptr || !validBatchOp(&op)) return false;
+		batch->push_back(op);
+	}
+	return true;
 }
 
 /* -----------------------------------------------------------------------------
@@ -290,7 +371,23 @@ void helpMenu() {
 		 << "\t\t/" << O_REPORT << " - Print a report to a specified report file" << endl
 		 << "\t\t/" << O_CHANGE_SSN << " - Change the social security number for a specified account" << endl
 		 << "\t\t/" << O_TRANS << " - Transfer money for one specified account to another" << endl 
-		 << "\t\t/" << O_NEWPASS << " - Change the password for a specified account" << endl << endl
+		 << "\t\t/" << O_NEWPASS << " - Change the password for a specified account" << endl
+		 << "\t\t/" << O_CREATE << " - Open a new account from first,last,middle,social,area,phone,password and print its number" << endl
+		 << "\t\t/" << O_CLOSE << " - Close a specified account" << endl
+		 << "\t\t/" << O_BATCH << " - Make a change to an account given as number,password,change, where the change is an action option and its value (like "
+		 << O_CHANGE_PHONE << "5551234, " << O_CLOSE << ", or " << O_TRANS << "10.50,number,password to transfer). Can be given many times" << endl
+		 << "\t\t/" << O_CORES << " - Run the batch changes thread-per-core on a specified number of cores (0 for all of them), where a change that fails doesn't stop the rest" << endl
+		 << "\t\t/" << O_SETTLE << " - Settle batch transfers by netting them, adding them up on a specified number of threads (0 for every core). Only the final balances have to stay above 0, and the last transfers out of an account which wouldn't are turned down" << endl
+		 << "\t\t/" << O_HOT << " - Split a specified account's balance between the cores running the batch, for accounts most of the transfers go to. Can be given many times" << endl
+		 << "\t\t/" << O_EXPORT_BIN << " - Save a copy of the database to a specified file in the binary format" << endl
+		 << "\t\t/" << O_EXPORT_LSM << " - Save a copy of the database to a specified file in the LSM format" << endl
+		 << "\t\t/" << O_STATS << " - Show how the storage engine is keeping the database" << endl
+		 << "\t\t/" << O_CHECKPOINT << " - Save every change and fold it into the main database files" << endl
+		 << "\t\t/" << O_COMPACT << " - Give back the space used by closed accounts" << endl
+		 << "\t\t/" << O_SERVE << " - Serve the database on a specified Unix socket until a client shuts the server down. Given as socket,n,peer,peer,... the server is the nth (from 0) of a group replicated with Raft, where each peer is a server's own Unix socket for the group, and only the leader takes changes" << endl
+		 << "\t\t/" << O_FEED << " - Send every change a replicated server makes, in order, to subscribers on a specified Unix socket. A subscriber sends the index of the last change it has (8 bytes), and is sent everything after it" << endl
+		 << "\t\t/" << O_FEED_FILE << " - Write every change a replicated server makes into a specified file, rotated to file.1, file.2, ... as it grows, and carried on from where it left off" << endl
+		 << "\t\t/" << O_ENGINE << " - Pick the storage engine (" << ENGINE_TEXT << ", " << ENGINE_BINARY << ", " << ENGINE_LSM << ", " << ENGINE_MEMORY << " or " << ENGINE_MEMORY_FORK << "), creating the database if it doesn't exist" << endl << endl
 		 << "\tInfo options:" << endl
 		 << "\t\t/" << O_NUM << " - specifies the account number for an action option" << endl
 		 << "\t\t/" << O_PASS << " - specifies the password for an action option" << endl;
@@ -314,54 +411,84 @@ void displayInfo(Account* acc) {
 }
 
 /* -----------------------------------------------------------------------------
-FUNCTION:          createReport()
-DESCRIPTION:       Creates a human-readable text file at a given file name
-RETURNS:           Whether the report file was actually able to be created
+FUNCTION:          loadNeeded()
+DESCRIPTION:       Works out how much of the database the options need
+RETURNS:           LOAD_ALL if an option works on every account (like a report or a new account number),
+                   LOAD_ACCOUNTS if the options only work on the accounts they name,
+                   or LOAD_NOTHING if the options don't touch the database at all
 ----------------------------------------------------------------------------- */
-bool createReport(vector<Account>* people, char* fileName) {
-	ofstream file(fileName);
-	if(!file.is_open()) {
-		return false;
-	}
-	file << "-------  ----            -----           --  ---------  ------------  -------" << endl
-	     << "Account  Last            First           MI  SS         Phone         Account" << endl
-		 << "Number   Name            Name                Number     Number        Balance" << endl
-		 << "-------  ----            -----           --  ---------  ------------  -------" << endl;
-	
-	for(Account& person : *people) {
-		file <<  " " << person.number << "   "
-		     << left << setw(14) << person.last << "  "
-			 << setw(14) << person.first << "  "
-			 << person.middle << ".  "
-			 << person.social << "  "
-		     << "(" << person.area << ")" << person.phone << "  "
-			 << fixed << setprecision(2) << person.balance << endl;
+int loadNeeded(map<char, vector<char*>>* args) {
+	int needed = LOAD_NOTHING;
+	for(pair<const char, vector<char*>>& arg : *args) {
+		switch(arg.first) {
+			case O_HELP:
+			case O_DATA:
+			case O_NUM:
+			case O_PASS:
+			case O_CORES:
+			case O_HOT:
+			case O_SETTLE:
+			case O_FEED:
+			case O_FEED_FILE:
+				break;
+			case O_REPORT:
+			case O_CREATE:
+			case O_BATCH:
+			case O_SERVE:
+			case O_EXPORT_BIN:
+			case O_EXPORT_LSM:
+			case O_COMPACT:
+				return LOAD_ALL;
+			default:
+				needed = LOAD_ACCOUNTS;
+				break;
+		}
 	}
-	return true;
+	return needed;
 }
-/*----------------------------------------------------------------------------
-FUNCTION:          loadDatabase()
-DESCRIPTION:       Loads the database from a file
-RETURNS:           Whether the database was able to be loaded
------------------------------------------------------------------------------ */
-bool loadDatabase(vector<Account>* people, char* fileName) {
-	ifstream input(fileName);
-	if(!input.is_open()) return false;
 
-	for(unsigned int i = 0; !input.eof(); i++) {
-		Account person;
-		input >> person.last
-		      >> person.first
-			  >> person.middle
-			  >> person.social
-			  >> person.area
-			  >> person.phone
-			  >> person.balance
-			  >> person.number
-			  >> person.password;
-		person.nameLength = strlen(person.first) + strlen(person.last) + 4;
-		if(input.eof()) break;
-		people->push_back(person);
+/* -----------------------------------------------------------------------------
+FUNCTION:          accessNeeded()
+DESCRIPTION:       Works out how the options need the database locked against other processes
+RETURNS:           BANK_READ if the options only look at the database,
+                   BANK_WRITE_OPTIMISTIC if they only change fields of or move money between the accounts they name,
+                   or BANK_WRITE if anything else changes it
+----------------------------------------------------------------------------- */
+int accessNeeded(map<char, vector<char*>>* args) {
+	int access = BANK_READ;
+	for(pair<const char, vector<char*>>& arg : *args) {
+		switch(arg.first) {
+			case O_HELP:
+			case O_DATA:
+			case O_NUM:
+			case O_PASS:
+			case O_CORES:
+			case O_HOT:
+			case O_SETTLE:
+			case O_FEED:
+			case O_FEED_FILE:
+			case O_ENGINE:
+			case O_INFO:
+			case O_REPORT:
+			case O_STATS:
+			case O_EXPORT_BIN:
+			case O_EXPORT_LSM:
+				break;
+			case O_CHANGE_AREA:
+			case O_CHANGE_F:
+			case O_CHANGE_PHONE:
+			case O_CHANGE_L:
+			case O_CHANGE_M:
+			case O_CHANGE_SSN:
+			case O_NEWPASS:
+			case O_TRANS:
+				access = BANK_WRITE_OPTIMISTIC;
+				break;
+			default:
+				return BANK_WRITE;
+		}
 	}
-	return true;
+	//Changing accounts one at a time leaves no whole copy of the database to read
+	if(access == BANK_WRITE_OPTIMISTIC && loadNeeded(args) == LOAD_ALL) return BANK_WRITE;
+	return access;
 }
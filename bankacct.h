@@ -17,6 +17,10 @@ Alexander Novotny         2016-10-18         1.0.0
 #ifndef __BANKACCT_H__
 #define __BANKACCT_H__
 
+#include <vector>
+#include <functional>
+#include <ostream>
+
 //Semvers
 #define VERSION "1.0.0" 
 
@@ -25,6 +29,9 @@ Alexander Novotny         2016-10-18         1.0.0
 #define ACC_NUM_LENGTH 5
 #define PASS_LENGTH 6
 
+//Number of records at which radix sorting is split up across threads
+#define RADIX_PARALLEL_MIN 65536
+
 //Valid command line operator
 #define SLASH '/'
 
@@ -41,6 +48,22 @@ Alexander Novotny         2016-10-18         1.0.0
 #define O_CHANGE_SSN   'S'
 #define O_TRANS        'T'
 #define O_NEWPASS      'W'
+#define O_CREATE       'O'
+#define O_CLOSE        'X'
+#define O_BATCH        'U'
+
+#define O_ENGINE       'E'
+#define O_EXPORT_BIN   'B'
+#define O_CHECKPOINT   'C'
+#define O_STATS        'G'
+#define O_COMPACT      'K'
+#define O_EXPORT_LSM   'Y'
+#define O_SERVE        'V'
+#define O_CORES        'Q'
+#define O_HOT          'J'
+#define O_SETTLE       'Z'
+#define O_FEED         '@'
+#define O_FEED_FILE    '%'
 
 #define O_INFO         'I'
 #define O_REPORT       'R'
@@ -50,11 +73,13 @@ Alexander Novotny         2016-10-18         1.0.0
 
 //Field regex
 #define R_AREA "^\\d{3}$"
-#define R_NAME "^[:alpha:]*$"
-#define R_MIDDLE "^[:alpha:]$"
+#define R_NAME "^[[:alpha:]]*$"
+#define R_MIDDLE "^[[:alpha:]]$"
 #define R_PHONE "^\\d{7}$"
 #define R_SSN "^\\d{9}$"
 #define R_PASS "^[A-Z0-9]{6}$"
+#define R_AMOUNT "^\\d+(\\.\\d{1,2})?$"
+#define R_CORES "^\\d{1,3}$"
 
 
 //Error codes
@@ -65,6 +90,41 @@ Alexander Novotny         2016-10-18         1.0.0
 #define ERR_REPORT_FILE_ERR 5
 #define ERR_NO_TRANSFER_ACCOUNT 6
 #define ERR_TOO_MUCH_TRANSFER 7
+#define ERR_NO_ACCOUNT_NUMBERS 8
+#define ERR_BINARY_FILE_ERR 9
+#define ERR_LSM_FILE_ERR 10
+#define ERR_STORAGE_ERR 11
+#define ERR_NO_ENGINE 12
+#define ERR_SERVER_ERR 13
+#define ERR_NOT_LOCKED 14
+#define ERR_NOT_LEADER 15
+
+//Names of the storage engines which can be picked with the engine option
+#define ENGINE_TEXT "text"
+#define ENGINE_BINARY "binary"
+#define ENGINE_LSM "lsm"
+#define ENGINE_MEMORY "memory"
+#define ENGINE_MEMORY_FORK "memory-fork"
+
+//Slot number of an account which the storage engine hasn't stored yet
+#define NO_SLOT 0
+
+//How much of the database a command line needs loaded
+#define LOAD_NOTHING 0
+#define LOAD_ACCOUNTS 1
+#define LOAD_ALL 2
+
+//Number of fields in the value of a create option, and what separates them
+#define CREATE_FIELDS 7
+#define CREATE_SEPARATOR ","
+
+//What separates the fields of a batch change: number,password,change[,number,password]
+#define BATCH_SEPARATOR ","
+
+//First account number handed out to an empty database
+#define FIRST_ACC_NUM "A000A"
+//What kind of character belongs at each place of an account number ('A' for letters, '9' for digits)
+#define ACC_NUM_PATTERN "A999A"
 
 using namespace std;
 
@@ -80,34 +140,125 @@ struct Account {
 	char password[PASS_LENGTH + 1];
 	//Length of full name (including two spaces and a .)
 	unsigned int nameLength;
+	//Closed accounts are left in place as tombstones until they can be reused or dropped
+	bool closed;
+	//Where the storage engine keeps the account, and whether it has changed since it was loaded
+	unsigned int slot;
+	bool dirty;
+	//How many times the storage engine had written the account when it was loaded, if it keeps count
+	unsigned int version;
+};
+
+//One change from a batch option, which is an option letter and its value (like A775) for one account
+struct BatchOp {
+	char* number;
+	char* password;
+	char change;
+	char* value;
+	//The account money goes to, which only a transfer has
+	char* toNumber;
+	char* toPassword;
+	//Filled in once the whole batch has been looked up
+	Account* acc;
+	Account* to;
+};
+
+unsigned long long accountKey(const char*);
+long long toCents(double);
+
+//Things done to the table of accounts, which the library, the server and the command line share
+bool validValue(char, char*);
+bool validBatchOp(BatchOp*);
+bool createFields(char*, char**);
+
+Account* findAccount(vector<Account>*, char*, char*);
+void findBatchAccounts(vector<Account>*, vector<BatchOp>*);
+void changeAccount(Account*, char, char*);
+int transfer(Account*, Account*, char*);
+int runBatch(vector<Account>*, vector<BatchOp>*);
+int runBatchOp(BatchOp*);
+int createAccount(vector<Account>*, char*, Account**);
+Account* insertAccount(vector<Account>*, Account*);
+bool nextAccountNumber(vector<Account>*, char*);
+
+void radixSort(vector<Account>*);
+bool createReport(vector<Account>*, const char*);
+
+//What Storage::putIfUnchanged() can return
+#define PUT_DONE 0
+#define PUT_CONFLICT 1
+#define PUT_FAILED 2
+
+/* -----------------------------------------------------------------------------
+CLASS:             Storage
+DESCRIPTION:       What every storage engine has to be able to do, so the rest of the program
+                   doesn't need to know how the database is kept
+NOTES:             Every engine hands out its own slot numbers, which say which stored account an Account
+                   came from. put() with a slot replaces that stored account, put() without one (NO_SLOT)
+                   adds a new one, and put() with a closed account removes it.
+                   Nothing is safe until commit(), and nothing is folded into the main files until checkpoint().
+----------------------------------------------------------------------------- */
+class Storage {
+	public:
+		virtual ~Storage() {}
+
+		//Opens an existing database, returning false if the file isn't in this engine's format
+		virtual bool open(const char*) = 0;
+		//Creates an empty database, replacing whatever was there
+		virtual bool create(const char*) = 0;
+
+		//Finds a single open account by its number and password
+		virtual bool get(const char*, const char*, Account*) = 0;
+		virtual bool put(Account*) = 0;
+		//Goes through every open account, stopping early if the function returns false
+		virtual bool scan(function<bool(Account*)>) = 0;
+
+		virtual bool commit() = 0;
+		virtual bool checkpoint() = 0;
+
+		//The highest account number the database has ever had, which is kept after that account is closed
+		//and dropped, so the number is never handed out again. Copies in "" if the database hasn't kept one
+		virtual void highestNumber(char*) = 0;
+		//Raises the highest account number to the one given, if it's higher, to be saved with the next commit()
+		virtual void keepNumber(const char*) = 0;
+
+		//Gives back space used by closed accounts, updating the slots of any accounts which were moved
+		virtual bool compact(vector<Account>*) { return checkpoint(); }
+		virtual void stats(ostream&) {}
+
+		//Locks each account against other processes as it is read, for reading or for changing,
+		//instead of relying on the whole database being locked. Returns false if the engine can't
+		virtual bool lockRecords(bool) { return false; }
+		//Reads accounts without keeping them locked, so that changes are saved with putIfUnchanged()
+		//instead of put(). Returns false if the engine doesn't keep a version for each account
+		virtual bool versionRecords() { return false; }
+		//Saves changed accounts all at once, only if nobody else saved any of them since they were read
+		virtual int putIfUnchanged(vector<Account*>*) { return PUT_FAILED; }
 };
 
 class WriteOnShutdown {
 	private:
-		const char* filename;
 		vector<Account>* database;
+		Storage* storage;
 	public:
-		WriteOnShutdown(char* a, vector<Account>* b) : filename(a), database(b) {}
+		WriteOnShutdown(vector<Account>* a, Storage* b) : database(a), storage(b) {}
 		
 		/* -----------------------------------------------------------------------------
 		FUNCTION:          ~WriteOnShutdown()
 		DESCRIPTION:       Destructor for WriteOnShutdown. When WriteOnShutdown gets deleted, 
                                    it writes the database to the specified output file
 		RETURNS:           Void function
+		NOTES:             Only the accounts which changed are handed back to the storage engine
 		----------------------------------------------------------------------------- */
 		~WriteOnShutdown() {
-			ofstream out(filename);
-			for(Account& acc : *database) {
-				out << acc.last<< endl
-				    << acc.first << endl
-					<< acc.middle << endl
-					<< acc.social << endl
-					<< acc.area << endl
-					<< acc.phone << endl
-					<< acc.balance << endl
-					<< acc.number << endl
-					<< acc.password << endl << endl;
-			}
+			saveDatabase(database, storage);
 		}
+
+		static bool saveDatabase(vector<Account>*, Storage*);
 };
+
+Storage* makeStorage(const char*);
+Storage* openStorage(const char*, const char*);
+bool copyDatabase(vector<Account>*, const char*, const char*);
+void addHighestNumber(vector<Account>*, Storage*);
 #endif
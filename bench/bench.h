@@ -0,0 +1,78 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              bench.h
+
+DESCRIPTION:       What the benchmarks share: made up accounts, a scratch directory, and a stopwatch
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <dirent.h>
+#include <unistd.h>
+#include "bankacct.h"
+
+using namespace std;
+
+#define BENCH_PASS "PASS01"
+#define BENCH_BALANCE 1000
+
+//The nth account number, counting A000A, A000B, ... A000Z, A001A, ... so every number is different
+static inline void benchNumber(char* number, unsigned int n) {
+	snprintf(number, ACC_NUM_LENGTH + 1, "%c%03u%c", 'A' + n / 26000 % 26, n / 26 % 1000, 'A' + n % 26);
+}
+
+//The nth made up account, which can be looked up with BENCH_PASS
+static inline void benchAccount(Account* acc, unsigned int n) {
+	memset(acc, 0, sizeof(Account));
+	strcpy(acc->first, "Bench");
+	strcpy(acc->last, "Account");
+	acc->middle = 'B';
+	acc->social = 100000000 + n;
+	acc->area = 775;
+	acc->phone = 5550000 + n % 10000;
+	acc->balance = BENCH_BALANCE;
+	benchNumber(acc->number, n);
+	strcpy(acc->password, BENCH_PASS);
+	acc->nameLength = strlen(acc->first) + strlen(acc->last) + 4;
+	acc->slot = NO_SLOT;
+	acc->dirty = true;
+}
+
+//A new empty directory under /tmp for the benchmark's files
+static inline string benchDir() {
+	char path[] = "/tmp/bankbenchXXXXXX";
+	if(mkdtemp(path) == nullptr) return "";
+	return path;
+}
+
+//Deletes the directory and every file in it
+static inline void removeDir(const string& path) {
+	DIR* dir = opendir(path.c_str());
+	if(dir == nullptr) return;
+	while(dirent* entry = readdir(dir)) {
+		if(strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) unlink((path + "/" + entry->d_name).c_str());
+	}
+	closedir(dir);
+	rmdir(path.c_str());
+}
+
+class Stopwatch {
+	private:
+		chrono::steady_clock::time_point start;
+	public:
+		Stopwatch() : start(chrono::steady_clock::now()) {}
+		double seconds() {
+			return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		}
+};
+
+#endif
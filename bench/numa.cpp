@@ -0,0 +1,90 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              numa.cpp
+
+DESCRIPTION:       Times random reads of an account table from a thread pinned to the first NUMA node,
+                   with the table on that node, on the last node, and interleaved across every node
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#include <iostream>
+#include <iomanip>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "bench.h"
+#include "numa.h"
+
+using namespace std;
+
+#define TABLE_ACCOUNTS (1 << 20)
+#define READS 10000000
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          interleavedAlloc()
+DESCRIPTION:       Maps memory whose pages are spread over every node in turn
+RETURNS:           The memory, or nullptr if there wasn't any
+NOTES:             Nodes in the mask which aren't there are left out by the kernel. Freed with munmap()
+----------------------------------------------------------------------------- */
+static void* interleavedAlloc(size_t size) {
+	void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED) return nullptr;
+	unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+	memset(mask, 0xFF, sizeof(mask));
+	if(syscall(SYS_mbind, mem, size, MPOL_INTERLEAVE, mask, NUMA_MAX_NODES, 0) != 0) {
+		munmap(mem, size);
+		return nullptr;
+	}
+	return mem;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          nanosPerRead()
+DESCRIPTION:       Fills the table and then reads balances out of it in a random order
+RETURNS:           Nanoseconds a read
+NOTES:             Each read's index depends on the last balance, so they can't overlap
+----------------------------------------------------------------------------- */
+static double nanosPerRead(Account* table) {
+	for(unsigned int i = 0; i < TABLE_ACCOUNTS; i++) benchAccount(&table[i], i);
+	unsigned long long at = 92;
+	double total = 0;
+	Stopwatch took;
+	for(unsigned int i = 0; i < READS; i++) {
+		double balance = table[at % TABLE_ACCOUNTS].balance;
+		total += balance;
+		at = at * 6364136223846793005ULL + 1442695040888963407ULL + (unsigned long long) balance;
+	}
+	double nanos = took.seconds() * 1e9 / READS;
+	//Keeps the reads from being optimized out
+	if(total == 0) cout << "";
+	return nanos;
+}
+
+int main() {
+	size_t size = TABLE_ACCOUNTS * sizeof(Account);
+	unsigned int nodes = numaNodes();
+	if(nodes > 1 && !pinToNode(0)) return 1;
+	cout << TABLE_ACCOUNTS << " accounts, " << READS << " random reads from node 0, in nanoseconds a read" << endl;
+
+	Account* local = (Account*) nodeAlloc(size, nodes > 1 ? 0 : NO_NODE);
+	if(local == nullptr) return 1;
+	cout << fixed << setprecision(1) << "Local: " << nanosPerRead(local) << endl;
+	nodeFree(local, size, nodes > 1 ? 0 : NO_NODE);
+	if(nodes == 1) {
+		cout << "Only one NUMA node, so there's no remote or interleaved memory to compare with" << endl;
+		return 0;
+	}
+
+	Account* remote = (Account*) nodeAlloc(size, nodes - 1);
+	if(remote == nullptr) return 1;
+	cout << "Remote (node " << nodes - 1 << "): " << nanosPerRead(remote) << endl;
+	nodeFree(remote, size, nodes - 1);
+
+	Account* interleaved = (Account*) interleavedAlloc(size);
+	if(interleaved == nullptr) return 1;
+	cout << "Interleaved over " << nodes << " nodes: " << nanosPerRead(interleaved) << endl;
+	munmap(interleaved, size);
+	return 0;
+}
@@ -0,0 +1,274 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              server.cpp
+
+DESCRIPTION:       Serves a made up database in this process and measures it from the client side:
+                   how many lookups a second get through with lots of them in each frame and several
+                   frames sent before reading any answers, against one lookup at a time, and how long
+                   one lookup takes to come back over the socket against over shared memory. Then
+                   several clients look accounts up at once while another one makes changes, first opening
+                   and closing accounts, then changing the names and balances of the accounts being read,
+                   checking every account read was all from before or all from after each change
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include "bench.h"
+#include "bank.h"
+#include "client.h"
+
+using namespace std;
+
+#define BENCH_ACCOUNTS 20000
+#define BENCH_SEED 87
+
+//Sending a frame and waiting for the answer, compared with keeping several full frames on the way
+#define BATCH_GETS 500
+#define BATCH_IN_FLIGHT 4
+#define BATCH_FRAMES 400
+#define SINGLE_GETS 20000
+//Round trips timed on each transport
+#define LATENCY_GETS 20000
+//How long readers run for while another client makes changes, and how many lookups are in each of their frames
+#define LOAD_SECONDS 1
+#define LOAD_GETS 100
+#define NEW_ACCOUNT "Temp,Account,T,123456789,775,5551234,PASS02"
+//Accounts whose names and balances are changed while they're read
+#define HOT_ACCOUNTS 16
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          makeDatabase()
+DESCRIPTION:       Writes a database of made up accounts for the server to serve
+RETURNS:           Whether it was written
+----------------------------------------------------------------------------- */
+static bool makeDatabase(const string& fileName) {
+	unique_ptr<Storage> storage(makeStorage(ENGINE_BINARY));
+	if(!storage->create(fileName.c_str())) return false;
+	Account acc;
+	for(unsigned int i = 0; i < BENCH_ACCOUNTS; i++) {
+		benchAccount(&acc, i);
+		if(!storage->put(&acc)) return false;
+	}
+	return storage->commit();
+}
+
+//Connects once the server is listening
+static bool connectTo(BankClient* client, const string& path) {
+	for(int tries = 0; tries < 500; tries++) {
+		if(client->connect(path.c_str())) return true;
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	return false;
+}
+
+//Queues lookups of random accounts out of the first so many, all of which are there
+static void addGets(BankClient* client, minstd_rand* random, unsigned int count, unsigned int accounts = BENCH_ACCOUNTS) {
+	char number[ACC_NUM_LENGTH + 1];
+	for(unsigned int i = 0; i < count; i++) {
+		benchNumber(number, (*random)() % accounts);
+		client->get(number, BENCH_PASS);
+	}
+}
+
+//Reads the answer to a frame of lookups, checking every account was found
+static bool receiveGets(BankClient* client, unsigned int count) {
+	unsigned int id;
+	vector<WireResult> results;
+	if(!client->receive(&id, &results) || results.size() != count) return false;
+	for(WireResult& result : results) {
+		if(result.status != 0 || !result.found) return false;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          getsPerSecond()
+DESCRIPTION:       Sends frames of lookups, keeping so many of them unanswered at once
+RETURNS:           Lookups a second, or 0 if any of them didn't work
+----------------------------------------------------------------------------- */
+static double getsPerSecond(BankClient* client, unsigned int perFrame, unsigned int inFlight, unsigned int frames) {
+	minstd_rand random(BENCH_SEED);
+	Stopwatch took;
+	unsigned int sent = 0;
+	for(unsigned int received = 0; received < frames; received++) {
+		while(sent < frames && sent - received < inFlight) {
+			addGets(client, &random, perFrame);
+			if(client->send() == 0) return 0;
+			sent++;
+		}
+		if(!receiveGets(client, perFrame)) return 0;
+	}
+	return perFrame * frames / took.seconds();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          roundTrips()
+DESCRIPTION:       Times lookups one at a time, each one sent once the last one has come back
+RETURNS:           Whether they all worked, with the median and 99th percentile in microseconds
+----------------------------------------------------------------------------- */
+static bool roundTrips(BankClient* client, double* median, double* slowest) {
+	minstd_rand random(BENCH_SEED);
+	vector<double> took(LATENCY_GETS);
+	for(double& micros : took) {
+		Stopwatch trip;
+		addGets(client, &random, 1);
+		if(client->send() == 0 || !receiveGets(client, 1)) return false;
+		micros = trip.seconds() * 1e6;
+	}
+	sort(took.begin(), took.end());
+	*median = took[took.size() / 2];
+	*slowest = took[took.size() * 99 / 100];
+	return true;
+}
+
+struct LoadCounts {
+	atomic<unsigned long long> lookups;
+	atomic<unsigned long long> failed;
+	atomic<unsigned long long> changes;
+	atomic<unsigned long long> torn;
+};
+
+//A first name which is still the one it was made with, or one letter over and over like changeHot() gives them
+static bool wholeName(const Account& acc) {
+	size_t length = strnlen(acc.first, FIRST_NAME_LENGTH + 1);
+	if(length > FIRST_NAME_LENGTH) return false;
+	if(strcmp(acc.first, "Bench") == 0) return true;
+	return length > 0 && strspn(acc.first, string(1, acc.first[0]).c_str()) == length;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          readAccounts()
+DESCRIPTION:       Looks up accounts which are always there, out of the first so many, on a connection of its own, until told to stop
+RETURNS:           Nothing, counting every lookup, every one which didn't find its account, and every account
+                   which was read partway through a change
+----------------------------------------------------------------------------- */
+static void readAccounts(const string& path, unsigned int seed, unsigned int accounts, atomic<bool>* stop, LoadCounts* counts) {
+	BankClient client;
+	if(!connectTo(&client, path)) {
+		counts->failed++;
+		return;
+	}
+	minstd_rand random(seed);
+	while(!*stop) {
+		addGets(&client, &random, LOAD_GETS, accounts);
+		unsigned int id;
+		vector<WireResult> results;
+		if(client.send() == 0 || !client.receive(&id, &results)) {
+			counts->failed++;
+			return;
+		}
+		for(WireResult& result : results) {
+			if(result.status != 0 || !result.found) counts->failed++;
+			else if(!wholeName(result.acc)) counts->torn++;
+		}
+		counts->lookups += results.size();
+	}
+}
+
+//Opens an account and closes it again, as one change
+static bool createAndClose(BankClient* client) {
+	unsigned int id;
+	vector<WireResult> results;
+	client->create(NEW_ACCOUNT);
+	if(client->send() == 0 || !client->receive(&id, &results) || results[0].status != 0) return false;
+	client->close(results[0].acc.number, results[0].acc.password);
+	return client->send() != 0 && client->receive(&id, &results) && results[0].status == 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          changeHot()
+DESCRIPTION:       Makes the nth of the changes to the hot accounts, every other one a new first name
+                   of a different length and the rest a transfer to the next hot account
+RETURNS:           Whether it worked
+----------------------------------------------------------------------------- */
+static bool changeHot(BankClient* client, unsigned int n) {
+	char number[ACC_NUM_LENGTH + 1], toNumber[ACC_NUM_LENGTH + 1];
+	benchNumber(number, n / 2 % HOT_ACCOUNTS);
+	benchNumber(toNumber, (n / 2 + 1) % HOT_ACCOUNTS);
+	if(n % 2 == 0) client->change(number, BENCH_PASS, O_CHANGE_F, string(1 + n % FIRST_NAME_LENGTH, 'A' + n % 26).c_str());
+	else client->transfer(number, BENCH_PASS, "0.01", toNumber, BENCH_PASS);
+	unsigned int id;
+	vector<WireResult> results;
+	return client->send() != 0 && client->receive(&id, &results) && results[0].status == 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          underLoad()
+DESCRIPTION:       Runs so many readers of the first so many accounts for LOAD_SECONDS while the client
+                   makes one change after another
+RETURNS:           Whether every change worked, with what got done in counts
+----------------------------------------------------------------------------- */
+static bool underLoad(const string& path, unsigned int readers, unsigned int accounts, BankClient* client, function<bool(BankClient*)> change, LoadCounts* counts) {
+	counts->lookups = counts->failed = counts->changes = counts->torn = 0;
+	atomic<bool> stop(false);
+	vector<thread> threads;
+	for(unsigned int i = 0; i < readers; i++) threads.push_back(thread(readAccounts, path, BENCH_SEED + i, accounts, &stop, counts));
+	bool ok = true;
+	Stopwatch took;
+	while(ok && took.seconds() < LOAD_SECONDS) {
+		ok = change(client);
+		if(ok) counts->changes++;
+	}
+	stop = true;
+	for(thread& reader : threads) reader.join();
+	return ok;
+}
+
+int main() {
+	string dir = benchDir();
+	if(dir.empty() || !makeDatabase(dir + "/db")) return 1;
+	Bank bank;
+	if(bank.open((dir + "/db").c_str(), ENGINE_BINARY, BANK_WRITE) != 0) return 1;
+	string path = dir + "/sock";
+	thread server([&]() { bank.serve(path.c_str()); });
+
+	BankClient client;
+	int failed = 1;
+	if(connectTo(&client, path)) {
+		double batched = getsPerSecond(&client, BATCH_GETS, BATCH_IN_FLIGHT, BATCH_FRAMES);
+		double single = getsPerSecond(&client, 1, 1, SINGLE_GETS);
+		cout << fixed << setprecision(0) << BENCH_ACCOUNTS << " accounts over a Unix socket" << endl
+		     << BATCH_GETS << " lookups a frame, " << BATCH_IN_FLIGHT << " frames in flight: " << batched << " lookups/s" << endl
+		     << "1 lookup a frame, waiting for each answer: " << single << " lookups/s" << endl;
+		if(batched > 0 && single > 0) failed = 0;
+
+		//The same connection is timed on the socket and then moved onto shared memory and timed again
+		double socketMedian, socketSlowest, sharedMedian, sharedSlowest;
+		if(!roundTrips(&client, &socketMedian, &socketSlowest) || !client.attachShared()
+		   || !roundTrips(&client, &sharedMedian, &sharedSlowest)) failed = 1;
+		else cout << setprecision(1) << "One lookup's round trip, median and 99th percentile in microseconds" << endl
+		          << "Unix socket: " << socketMedian << ", " << socketSlowest << endl
+		          << "Shared memory: " << sharedMedian << ", " << sharedSlowest << endl;
+
+		LoadCounts counts;
+		cout << setprecision(0) << "Readers while another client opens and closes accounts" << endl;
+		for(unsigned int readers : {4, 8}) {
+			if(!underLoad(path, readers, BENCH_ACCOUNTS, &client, createAndClose, &counts)) failed = 1;
+			cout << readers << " readers: " << counts.lookups / LOAD_SECONDS << " lookups/s, " << counts.failed << " failed, "
+			     << counts.changes / LOAD_SECONDS << " accounts opened and closed/s" << endl;
+			if(counts.failed > 0) failed = 1;
+		}
+		cout << "Readers of " << HOT_ACCOUNTS << " accounts while another client changes their names and moves money between them" << endl;
+		for(unsigned int readers : {4, 8}) {
+			unsigned int n = 0;
+			if(!underLoad(path, readers, HOT_ACCOUNTS, &client, [&](BankClient* writer) { return changeHot(writer, n++); }, &counts)) failed = 1;
+			cout << readers << " readers: " << counts.lookups / LOAD_SECONDS << " lookups/s, " << counts.failed << " failed, "
+			     << counts.torn << " torn, " << counts.changes / LOAD_SECONDS << " changes/s" << endl;
+			if(counts.failed > 0 || counts.torn > 0) failed = 1;
+		}
+		client.shutdown();
+		client.send();
+	}
+	server.join();
+	removeDir(dir);
+	return failed;
+}
@@ -0,0 +1,82 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              sort.cpp
+
+DESCRIPTION:       Times the radix sort on account numbers against the std::sort it replaced,
+                   on databases of 10 thousand up to 100 million random account numbers.
+                   Sizes there isn't enough free memory for are skipped
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <unistd.h>
+#include "bankacct.h"
+
+using namespace std;
+
+//Same seed every run, so every run sorts the same accounts
+#define BENCH_SEED 76
+#define BENCH_RUNS 5
+//Databases bigger than this take long enough to sort that they only get two runs
+#define BENCH_BIG 1000000
+#define BENCH_BIG_RUNS 2
+
+//Account numbers look like A123B
+static void makeAccounts(vector<Account>* people, size_t count) {
+	minstd_rand random(BENCH_SEED);
+	people->assign(count, Account());
+	for(Account& acc : *people) {
+		memset(&acc, 0, sizeof(Account));
+		acc.number[0] = 'A' + random() % 26;
+		for(int i = 1; i < 4; i++) acc.number[i] = '0' + random() % 10;
+		acc.number[4] = 'A' + random() % 26;
+	}
+}
+
+//Best of a few runs, in milliseconds, since the first run also pays for faulting the memory in
+static double best(size_t count, function<void(vector<Account>*)> sortWith) {
+	double fastest = 0;
+	vector<Account> people;
+	int runs = count > BENCH_BIG ? BENCH_BIG_RUNS : BENCH_RUNS;
+	for(int run = 0; run < runs; run++) {
+		makeAccounts(&people, count);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		sortWith(&people);
+		double took = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		if(run == 0 || took < fastest) fastest = took;
+	}
+	return fastest;
+}
+
+//Bytes a sort of this many accounts needs at most, which is the radix sort's keys, order and scratch
+//space plus the sorted copy it builds, on top of the accounts themselves
+static size_t needed(size_t count) {
+	return count * (2 * sizeof(Account) + sizeof(unsigned long long) + 2 * sizeof(size_t));
+}
+
+int main() {
+	size_t available = (size_t) sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+	cout << "Accounts    std::sort (ms)  radix sort (ms)" << endl;
+	for(size_t count : {10000, 100000, 1000000, 10000000, 100000000}) {
+		if(needed(count) > available) {
+			cout << left << setw(12) << count << "skipped, needs " << needed(count) / (1 << 20) << " MB and only "
+			     << available / (1 << 20) << " MB is free" << endl;
+			continue;
+		}
+		double comparison = best(count, [](vector<Account>* people) {
+			sort(people->begin(), people->end(), [](const Account& a, const Account& b) {
+				return strcmp(a.number, b.number) < 0;
+			});
+		});
+		double radix = best(count, radixSort);
+		cout << left << setw(12) << count << setw(16) << fixed << setprecision(2) << comparison << radix << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              storage.cpp
+
+DESCRIPTION:       Runs the same workload against every storage engine, side by side: filling a new
+                   database, reading it all back, looking accounts up, changing them with a commit
+                   every so often, and a checkpoint at the end
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <vector>
+#include "bench.h"
+
+using namespace std;
+
+#define BENCH_ACCOUNTS 20000
+#define BENCH_LOOKUPS 2000
+#define BENCH_CHANGES 2000
+#define BENCH_COMMIT_EVERY 100
+#define BENCH_SEED 81
+
+struct Timings {
+	double fill;
+	double scan;
+	double lookups;
+	double changes;
+	double checkpoint;
+};
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runEngine()
+DESCRIPTION:       Runs the workload on one engine, in a file of its own
+RETURNS:           Whether every step worked
+NOTES:             The database is opened again after it's filled, so the rest reads what was written
+----------------------------------------------------------------------------- */
+static bool runEngine(const char* engine, const string& fileName, Timings* took) {
+	unique_ptr<Storage> storage(makeStorage(engine));
+	if(storage == nullptr || !storage->create(fileName.c_str())) return false;
+	Stopwatch fill;
+	Account acc;
+	for(unsigned int i = 0; i < BENCH_ACCOUNTS; i++) {
+		benchAccount(&acc, i);
+		if(!storage->put(&acc)) return false;
+	}
+	if(!storage->commit()) return false;
+	took->fill = fill.seconds();
+	storage.reset(makeStorage(engine));
+	if(!storage->open(fileName.c_str())) return false;
+
+	vector<Account> people;
+	Stopwatch scan;
+	if(!storage->scan([&](Account* person) {
+		people.push_back(*person);
+		return true;
+	}) || people.size() != BENCH_ACCOUNTS) return false;
+	took->scan = scan.seconds();
+
+	minstd_rand random(BENCH_SEED);
+	Stopwatch lookups;
+	for(unsigned int i = 0; i < BENCH_LOOKUPS; i++) {
+		if(!storage->get(people[random() % people.size()].number, BENCH_PASS, &acc)) return false;
+	}
+	took->lookups = lookups.seconds();
+
+	Stopwatch changes;
+	for(unsigned int i = 0; i < BENCH_CHANGES; i++) {
+		Account& person = people[random() % people.size()];
+		person.balance += 1;
+		person.dirty = true;
+		if(!storage->put(&person)) return false;
+		if(i % BENCH_COMMIT_EVERY == BENCH_COMMIT_EVERY - 1 && !storage->commit()) return false;
+	}
+	if(!storage->commit()) return false;
+	took->changes = changes.seconds();
+
+	Stopwatch checkpoint;
+	if(!storage->checkpoint()) return false;
+	took->checkpoint = checkpoint.seconds();
+	return true;
+}
+
+int main() {
+	string dir = benchDir();
+	if(dir.empty()) return 1;
+	cout << BENCH_ACCOUNTS << " accounts, " << BENCH_LOOKUPS << " lookups, " << BENCH_CHANGES
+	     << " changes committed every " << BENCH_COMMIT_EVERY << ", in seconds" << endl
+	     << "Engine       Fill      Scan      Lookups   Changes   Checkpoint" << endl;
+	int failed = 0;
+	for(const char* engine : {ENGINE_TEXT, ENGINE_BINARY, ENGINE_LSM, ENGINE_MEMORY, ENGINE_MEMORY_FORK}) {
+		Timings took;
+		cout << left << setw(13) << engine;
+		if(!runEngine(engine, dir + "/" + engine, &took)) {
+			cout << "failed" << endl;
+			failed = 1;
+			continue;
+		}
+		cout << fixed << setprecision(4) << setw(10) << took.fill << setw(10) << took.scan << setw(10) << took.lookups
+		     << setw(10) << took.changes << took.checkpoint << endl;
+	}
+	removeDir(dir);
+	return failed;
+}
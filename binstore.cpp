@@ -0,0 +1,578 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              binstore.cpp
+	DESCRIPTION:       Keeps a binary database of fixed size account records in pages,
+	                   along with a free list of pages which still have room
+	COMPILER:          Built on g++ with c++11
+
+	Every slot is numbered page * SLOTS_PER_PAGE + index, so slot numbers below
+	SLOTS_PER_PAGE (which would be in the header page) are never used, and NO_SLOT is 0.
+	Record pages are only ever read and written through the buffer pool,
+	while the file header is kept in memory and written straight to page 0.
+
+	When records are locked one at a time, other processes can be changing other records in the
+	same pages, so records are read and written straight to the file under an fcntl() lock on just
+	their own bytes, instead of going through the buffer pool a page at a time. Nothing which changes
+	the pages' layout (opening, closing or compacting) can be done like that.
+
+	Every write stamps the record with the next version. A writer working optimistically only locks a
+	record while reading it, and saves its changes by locking every record it changed, checking that
+	none of their versions moved since it read them, and writing them all before letting go.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <iomanip>
+#include <unordered_map>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include "binstore.h"
+
+using namespace std;
+
+static_assert(SLOTS_PER_PAGE <= 64, "A page can only keep track of 64 slots");
+static_assert(sizeof(FileHeader) <= PAGE_SIZE, "The file header has to fit in a page");
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          toRecord()
+DESCRIPTION:       Copies the fields of an account which get saved into a record
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void toRecord(Account* acc, Record* rec) {
+	memset(rec, 0, sizeof(Record));
+	strcpy(rec->first, acc->first);
+	strcpy(rec->last, acc->last);
+	rec->middle = acc->middle;
+	strcpy(rec->number, acc->number);
+	strcpy(rec->password, acc->password);
+	rec->social = acc->social;
+	rec->area = acc->area;
+	rec->phone = acc->phone;
+	rec->balance = acc->balance;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          fromRecord()
+DESCRIPTION:       Fills in an account from a record
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void fromRecord(Record* rec, Account* acc, unsigned int slot) {
+	strcpy(acc->first, rec->first);
+	strcpy(acc->last, rec->last);
+	acc->middle = rec->middle;
+	strcpy(acc->number, rec->number);
+	strcpy(acc->password, rec->password);
+	acc->social = rec->social;
+	acc->area = rec->area;
+	acc->phone = rec->phone;
+	acc->balance = rec->balance;
+	acc->nameLength = strlen(acc->first) + strlen(acc->last) + 4;
+	acc->closed = false;
+	acc->slot = slot;
+	acc->dirty = false;
+	acc->version = 0;
+}
+
+//Fills in an account from a record, along with the version it was read at
+static void fromStamped(StampedRecord* stamped, Account* acc, unsigned int slot) {
+	fromRecord(&stamped->rec, acc, slot);
+	acc->version = stamped->version;
+}
+
+//Stamps an account's record with the account's next version
+static void toStamped(Account* acc, StampedRecord* stamped) {
+	memset(stamped, 0, sizeof(StampedRecord));
+	toRecord(acc, &stamped->rec);
+	stamped->version = ++acc->version;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          pageRecord()
+DESCRIPTION:       Finds a slot's record in the memory of its page
+RETURNS:           A pointer to the record
+----------------------------------------------------------------------------- */
+static StampedRecord* pageRecord(char* page, unsigned int slot) {
+	return (StampedRecord*) (page + sizeof(PageHeader)) + slot % SLOTS_PER_PAGE;
+}
+
+//Where a slot's record is in the file
+static off_t recordOffset(unsigned int slot) {
+	return (off_t) (slot / SLOTS_PER_PAGE) * PAGE_SIZE + sizeof(PageHeader) + (slot % SLOTS_PER_PAGE) * sizeof(StampedRecord);
+}
+
+BinaryStore::~BinaryStore() {
+	if(fd == -1) return;
+	pool.flush();
+	close(fd);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          open()
+DESCRIPTION:       Opens an existing binary database
+RETURNS:           Whether the file exists and is a binary database
+----------------------------------------------------------------------------- */
+bool BinaryStore::open(const char* fileName) {
+	fd = ::open(fileName, O_RDWR);
+	if(fd == -1) return false;
+	if(pread(fd, &header, sizeof(FileHeader), 0) != sizeof(FileHeader) || memcmp(header.magic, BIN_MAGIC, BIN_MAGIC_LENGTH)) {
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	pool.attach(fd);
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          create()
+DESCRIPTION:       Creates an empty binary database, replacing whatever file was there
+RETURNS:           Whether the file could be created
+----------------------------------------------------------------------------- */
+bool BinaryStore::create(const char* fileName) {
+	fd = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1) return false;
+	pool.attach(fd);
+	memset(&header, 0, sizeof(FileHeader));
+	memcpy(header.magic, BIN_MAGIC, BIN_MAGIC_LENGTH);
+	header.pageCount = 1;
+	indexed = true;
+	return ftruncate(fd, PAGE_SIZE) == 0 && pwrite(fd, &header, sizeof(FileHeader), 0) == sizeof(FileHeader);
+}
+
+bool BinaryStore::readRecord(unsigned int slot, StampedRecord* rec) {
+	char* page = pool.pin(slot / SLOTS_PER_PAGE, PIN_READ);
+	if(page == nullptr) return false;
+	*rec = *pageRecord(page, slot);
+	pool.unpin(slot / SLOTS_PER_PAGE, false);
+	return true;
+}
+
+bool BinaryStore::writeRecord(unsigned int slot, Account* acc) {
+	char* page = pool.pin(slot / SLOTS_PER_PAGE, PIN_READ);
+	if(page == nullptr) return false;
+	toStamped(acc, pageRecord(page, slot));
+	pool.unpin(slot / SLOTS_PER_PAGE, true);
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          allocate()
+DESCRIPTION:       Finds a free slot, taking it from the first page on the free list,
+                   or adding a new page to the end of the file if the free list is empty
+RETURNS:           The slot, or NO_SLOT if there was no room in the buffer pool
+----------------------------------------------------------------------------- */
+unsigned int BinaryStore::allocate() {
+	if(header.freeHead == 0) {
+		unsigned int added = header.pageCount;
+		if(pool.pin(added, PIN_FRESH) == nullptr) return NO_SLOT;
+		pool.unpin(added, true);
+		header.pageCount++;
+		header.freeHead = added;
+	}
+
+	unsigned int pageNum = header.freeHead;
+	PageHeader* page = (PageHeader*) pool.pin(pageNum, PIN_READ);
+	if(page == nullptr) return NO_SLOT;
+	unsigned int index = 0;
+	while(page->bitmap & (1ULL << index)) index++;
+	page->bitmap |= 1ULL << index;
+	page->used++;
+
+	//Full pages come off the free list
+	if(page->used == SLOTS_PER_PAGE) {
+		header.freeHead = page->nextFree;
+		page->nextFree = 0;
+	}
+	pool.unpin(pageNum, true);
+	header.recordCount++;
+	return pageNum * SLOTS_PER_PAGE + index;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          release()
+DESCRIPTION:       Gives a slot back, putting its page back on the free list if it had been full
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void BinaryStore::release(unsigned int slot) {
+	unsigned int pageNum = slot / SLOTS_PER_PAGE;
+	PageHeader* page = (PageHeader*) pool.pin(pageNum, PIN_READ);
+	if(page == nullptr) return;
+	if(page->used == SLOTS_PER_PAGE) {
+		page->nextFree = header.freeHead;
+		header.freeHead = pageNum;
+	}
+	page->bitmap &= ~(1ULL << (slot % SLOTS_PER_PAGE));
+	page->used--;
+	header.recordCount--;
+	pool.unpin(pageNum, true);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          scanPages()
+DESCRIPTION:       Goes through every record in the file in order, without letting the scan push hot pages out of the pool
+RETURNS:           Whether the whole file could be read
+----------------------------------------------------------------------------- */
+bool BinaryStore::scanPages(function<void(unsigned int, StampedRecord*)> visit) {
+	for(unsigned int pageNum = 1; pageNum < header.pageCount; pageNum++) {
+		char* data = pool.pin(pageNum, PIN_SCAN);
+		if(data == nullptr) return false;
+		PageHeader* page = (PageHeader*) data;
+		for(unsigned int i = 0; i < SLOTS_PER_PAGE; i++) {
+			if(!(page->bitmap & (1ULL << i))) continue;
+			unsigned int slot = pageNum * SLOTS_PER_PAGE + i;
+			visit(slot, pageRecord(data, slot));
+		}
+		pool.unpin(pageNum, false);
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          scan()
+DESCRIPTION:       Reads every record in the database, building the index along the way
+RETURNS:           Whether the whole file could be read
+----------------------------------------------------------------------------- */
+bool BinaryStore::scan(function<bool(Account*)> visit) {
+	//Locking the whole file for reading would give up the locks on any records being changed
+	if(recordLock == F_WRLCK) return false;
+	if(recordLock == F_RDLCK) {
+		if(!lockRange(F_RDLCK, 0, 0)) return false;
+		//Pages read before the lock was taken could be out of date
+		pool.discard(1);
+	}
+	bool more = true;
+	index.clear();
+	indexed = scanPages([&](unsigned int slot, StampedRecord* rec) {
+		index.insert(make_pair(accountKey(rec->rec.number), slot));
+		if(!more) return;
+		Account person;
+		fromStamped(rec, &person, slot);
+		more = visit(&person);
+	});
+	return indexed;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          get()
+DESCRIPTION:       Looks up a single account by its number and password, only reading the page it is on
+RETURNS:           Whether the account was found
+----------------------------------------------------------------------------- */
+bool BinaryStore::get(const char* number, const char* password, Account* acc) {
+	if(!indexed) {
+		index.clear();
+		indexed = scanPages([&](unsigned int slot, StampedRecord* rec) {
+			index.insert(make_pair(accountKey(rec->rec.number), slot));
+		});
+		if(!indexed) return false;
+	}
+
+	StampedRecord rec;
+	pair<multimap<unsigned long long, unsigned int>::iterator, multimap<unsigned long long, unsigned int>::iterator> range = index.equal_range(accountKey(number));
+	for(multimap<unsigned long long, unsigned int>::iterator it = range.first; it != range.second; it++) {
+		if(recordLock != F_UNLCK) {
+			if(getLocked(it->second, password, acc)) return true;
+			continue;
+		}
+		if(!readRecord(it->second, &rec)) return false;
+		if(strcmp(rec.rec.password, password)) continue;
+		fromStamped(&rec, acc, it->second);
+		return true;
+	}
+	return false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          unindex()
+DESCRIPTION:       Takes a single slot out of the index
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void BinaryStore::unindex(unsigned long long key, unsigned int slot) {
+	pair<multimap<unsigned long long, unsigned int>::iterator, multimap<unsigned long long, unsigned int>::iterator> range = index.equal_range(key);
+	for(multimap<unsigned long long, unsigned int>::iterator it = range.first; it != range.second; it++) {
+		if(it->second != slot) continue;
+		index.erase(it);
+		return;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          put()
+DESCRIPTION:       Writes an account into its slot in the buffer pool, giving it a slot first if it is new,
+                   or gives its slot back if it was closed
+RETURNS:           Whether there was room in the buffer pool
+----------------------------------------------------------------------------- */
+bool BinaryStore::put(Account* acc) {
+	if(recordLock != F_UNLCK) {
+		if(recordLock != F_WRLCK || optimistic || acc->closed || acc->slot == NO_SLOT) return false;
+		StampedRecord rec;
+		toStamped(acc, &rec);
+		return pwrite(fd, &rec, sizeof(StampedRecord), recordOffset(acc->slot)) == sizeof(StampedRecord);
+	}
+	unsigned long long key = accountKey(acc->number);
+	if(acc->closed) {
+		if(acc->slot == NO_SLOT) return true;
+		StampedRecord rec;
+		if(!readRecord(acc->slot, &rec)) return false;
+		release(acc->slot);
+		if(indexed) unindex(accountKey(rec.rec.number), acc->slot);
+		acc->slot = NO_SLOT;
+		return true;
+	}
+
+	if(acc->slot == NO_SLOT) {
+		acc->slot = allocate();
+		if(acc->slot == NO_SLOT) return false;
+		if(indexed) index.insert(make_pair(key, acc->slot));
+	} else if(indexed) {
+		//The account might have taken over the slot of a closed account with a different number
+		StampedRecord rec;
+		if(!readRecord(acc->slot, &rec)) return false;
+		if(accountKey(rec.rec.number) != key) {
+			unindex(accountKey(rec.rec.number), acc->slot);
+			index.insert(make_pair(key, acc->slot));
+		}
+	}
+	return writeRecord(acc->slot, acc);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          commit()
+DESCRIPTION:       Writes every dirty page and the file header
+RETURNS:           Whether everything could be written
+NOTES:             Records locked one at a time have already been written, and the header can't have changed
+----------------------------------------------------------------------------- */
+bool BinaryStore::commit() {
+	if(recordLock != F_UNLCK) return true;
+	return pool.flush() && pwrite(fd, &header, sizeof(FileHeader), 0) == sizeof(FileHeader);
+}
+
+void BinaryStore::highestNumber(char* number) {
+	strcpy(number, header.highest);
+}
+
+//Only goes into the header, which is written with the next commit
+void BinaryStore::keepNumber(const char* number) {
+	if(accountKey(number) > accountKey(header.highest)) strcpy(header.highest, number);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          checkpoint()
+DESCRIPTION:       Commits, and then makes sure the file is on disk
+RETURNS:           Whether everything could be written
+----------------------------------------------------------------------------- */
+bool BinaryStore::checkpoint() {
+	return commit() && fdatasync(fd) == 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          pageStats()
+DESCRIPTION:       Goes through every page header to see how fragmented the database is
+RETURNS:           Whether every page header could be read
+----------------------------------------------------------------------------- */
+bool BinaryStore::pageStats(StoreStats* out) {
+	memset(out, 0, sizeof(StoreStats));
+	out->pages = header.pageCount - 1;
+	out->records = header.recordCount;
+	for(unsigned int pageNum = 1; pageNum < header.pageCount; pageNum++) {
+		PageHeader* page = (PageHeader*) pool.pin(pageNum, PIN_SCAN);
+		if(page == nullptr) return false;
+		out->freeSlots += SLOTS_PER_PAGE - page->used;
+		out->trailingEmptyPages = page->used == 0 ? out->trailingEmptyPages + 1 : 0;
+		pool.unpin(pageNum, false);
+	}
+	for(unsigned int pageNum = header.freeHead; pageNum != 0;) {
+		PageHeader* page = (PageHeader*) pool.pin(pageNum, PIN_SCAN);
+		if(page == nullptr) return false;
+		out->freeListPages++;
+		unsigned int next = page->nextFree;
+		pool.unpin(pageNum, false);
+		pageNum = next;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          stats()
+DESCRIPTION:       Displays how full the pages are, and how the buffer pool has done so far
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void BinaryStore::stats(ostream& out) {
+	StoreStats pages;
+	PoolStats cache = pool.stats();
+	if(!pageStats(&pages)) return;
+	unsigned int slots = pages.pages * SLOTS_PER_PAGE;
+	out << "Pages: " << pages.pages << endl
+	    << "Records: " << pages.records << " of " << slots << " slots";
+	if(slots != 0) out << " (" << fixed << setprecision(1) << 100.0 * pages.records / slots << "% full)";
+	out << endl
+	    << "Free slots: " << pages.freeSlots << " on " << pages.freeListPages << " free list pages" << endl
+	    << "Empty pages at the end: " << pages.trailingEmptyPages << endl
+	    << "Buffer pool: " << cache.hits << " hits, " << cache.misses << " misses, "
+	    << cache.evictions << " evictions, " << cache.writeBacks << " write backs" << endl;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          compact()
+DESCRIPTION:       Moves records from the end of the file into free slots nearer the start,
+                   then cuts off the pages which are left empty
+RETURNS:           Whether every record could be moved
+NOTES:             Any account which was moved gets its new slot.
+----------------------------------------------------------------------------- */
+bool BinaryStore::compact(vector<Account>* people) {
+	if(recordLock != F_UNLCK) return false;
+	if(!commit()) return false;
+	unsigned int keep = (header.recordCount + SLOTS_PER_PAGE - 1) / SLOTS_PER_PAGE;
+	unordered_map<unsigned int, unsigned int> moved;
+	unsigned int target = 1;
+	PageHeader* targetPage = nullptr;
+
+	for(unsigned int pageNum = keep + 1; pageNum < header.pageCount; pageNum++) {
+		char* data = pool.pin(pageNum, PIN_SCAN);
+		if(data == nullptr) return false;
+		PageHeader* page = (PageHeader*) data;
+		for(unsigned int i = 0; i < SLOTS_PER_PAGE; i++) {
+			if(!(page->bitmap & (1ULL << i))) continue;
+
+			//Everything fits in the pages being kept, so there is always a free slot left in one of them
+			while(targetPage == nullptr || targetPage->used == SLOTS_PER_PAGE) {
+				if(targetPage != nullptr) pool.unpin(target++, true);
+				targetPage = (PageHeader*) pool.pin(target, PIN_READ);
+				if(targetPage == nullptr) return false;
+			}
+			unsigned int free = 0;
+			while(targetPage->bitmap & (1ULL << free)) free++;
+
+			unsigned int from = pageNum * SLOTS_PER_PAGE + i;
+			unsigned int to = target * SLOTS_PER_PAGE + free;
+			*pageRecord((char*) targetPage, to) = *pageRecord(data, from);
+			targetPage->bitmap |= 1ULL << free;
+			targetPage->used++;
+			moved[from] = to;
+		}
+		pool.unpin(pageNum, false);
+	}
+	if(targetPage != nullptr) pool.unpin(target, true);
+
+	//Rebuild the free list out of the pages being kept, lowest page first
+	header.freeHead = 0;
+	for(unsigned int pageNum = keep; pageNum >= 1; pageNum--) {
+		PageHeader* page = (PageHeader*) pool.pin(pageNum, PIN_READ);
+		if(page == nullptr) return false;
+		page->nextFree = 0;
+		if(page->used < SLOTS_PER_PAGE) {
+			page->nextFree = header.freeHead;
+			header.freeHead = pageNum;
+		}
+		pool.unpin(pageNum, true);
+	}
+
+	pool.discard(keep + 1);
+	header.pageCount = keep + 1;
+	//Everything being kept has to be written before the tail is cut off, or records would be lost
+	if(!pool.flush() || pwrite(fd, &header, sizeof(FileHeader), 0) != sizeof(FileHeader)) return false;
+	if(ftruncate(fd, (off_t) header.pageCount * PAGE_SIZE) != 0) return false;
+
+	for(Account& acc : *people) {
+		unordered_map<unsigned int, unsigned int>::iterator it = moved.find(acc.slot);
+		if(it != moved.end()) acc.slot = it->second;
+	}
+	//The index still has the slots the moved records came from, so it's rebuilt from scratch next time
+	index.clear();
+	indexed = false;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          lockRecords()
+DESCRIPTION:       Switches to locking each record as it is read, instead of the whole database being locked
+RETURNS:           True, since every binary database can be locked a record at a time
+----------------------------------------------------------------------------- */
+bool BinaryStore::lockRecords(bool write) {
+	recordLock = write ? F_WRLCK : F_RDLCK;
+	return true;
+}
+
+//Waits for a lock on part of the file, which is kept until the file is closed. A length of 0 means to the end
+bool BinaryStore::lockRange(short type, off_t start, off_t length) {
+	struct flock range;
+	memset(&range, 0, sizeof(range));
+	range.l_type = type;
+	range.l_whence = SEEK_SET;
+	range.l_start = start;
+	range.l_len = length;
+	while(fcntl(fd, F_SETLKW, &range) == -1) {
+		//Two processes waiting on each other's records get EDEADLK, and the account can't be had
+		if(errno != EINTR) return false;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          getLocked()
+DESCRIPTION:       Locks a slot's record, then reads it straight from the file
+RETURNS:           Whether the record could be read and has the password
+NOTES:             The lock is kept even if the password is wrong, since this process might
+                   already have had it for another reason.
+                   Working optimistically, the lock is only held while the record is read,
+                   so nobody is caught halfway through writing it
+----------------------------------------------------------------------------- */
+bool BinaryStore::getLocked(unsigned int slot, const char* password, Account* acc) {
+	StampedRecord rec;
+	if(!lockRange(recordLock, recordOffset(slot), sizeof(StampedRecord))) return false;
+	bool read = pread(fd, &rec, sizeof(StampedRecord), recordOffset(slot)) == sizeof(StampedRecord);
+	if(optimistic) lockRange(F_UNLCK, recordOffset(slot), sizeof(StampedRecord));
+	if(!read || strcmp(rec.rec.password, password)) return false;
+	fromStamped(&rec, acc, slot);
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          versionRecords()
+DESCRIPTION:       Switches to reading each record without keeping it locked, and saving changes with putIfUnchanged()
+RETURNS:           True, since every binary record has a version
+----------------------------------------------------------------------------- */
+bool BinaryStore::versionRecords() {
+	recordLock = F_RDLCK;
+	optimistic = true;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          putIfUnchanged()
+DESCRIPTION:       Writes changed accounts only if none of their records have been written since they were read
+RETURNS:           PUT_DONE if every account was written, PUT_CONFLICT if nothing was because one had changed,
+                   or PUT_FAILED if the records couldn't be locked, read or written
+NOTES:             The records are locked in account number order, the same as anything locking them one at a time,
+                   so two writers can't each be holding a record the other is waiting for.
+                   Every lock is let go of before returning
+----------------------------------------------------------------------------- */
+int BinaryStore::putIfUnchanged(vector<Account*>* changed) {
+	if(!optimistic) return PUT_FAILED;
+	vector<Account*> order(*changed);
+	sort(order.begin(), order.end(), [](Account* a, Account* b) {
+		return accountKey(a->number) < accountKey(b->number);
+	});
+
+	int result = PUT_DONE;
+	for(Account* acc : order) {
+		StampedRecord rec;
+		if(acc->closed || acc->slot == NO_SLOT || !lockRange(F_WRLCK, recordOffset(acc->slot), sizeof(StampedRecord)) ||
+		   pread(fd, &rec, sizeof(StampedRecord), recordOffset(acc->slot)) != sizeof(StampedRecord)) {
+			result = PUT_FAILED;
+			break;
+		}
+		if(rec.version != acc->version || strcmp(rec.rec.number, acc->number)) {
+			result = PUT_CONFLICT;
+			break;
+		}
+	}
+	for(Account* acc : order) {
+		if(result != PUT_DONE) break;
+		StampedRecord rec;
+		toStamped(acc, &rec);
+		if(pwrite(fd, &rec, sizeof(StampedRecord), recordOffset(acc->slot)) != sizeof(StampedRecord)) result = PUT_FAILED;
+	}
+	lockRange(F_UNLCK, 0, 0);
+	return result;
+}
@@ -0,0 +1,127 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              binstore.h
+
+DESCRIPTION:       Binary database format. Accounts are kept as fixed size records in pages,
+                   so single accounts can be written in place without rewriting the whole file
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __BINSTORE_H__
+#define __BINSTORE_H__
+
+#include <vector>
+#include <map>
+#include <fcntl.h>
+#include "bankacct.h"
+#include "bufpool.h"
+
+//Every binary database starts with this
+#define BIN_MAGIC "BANKBIN2"
+#define BIN_MAGIC_LENGTH 8
+
+//Size of a page in the binary database. Page 0 holds the file header, the rest hold records
+#define PAGE_SIZE 4096
+
+//An account as it is laid out in a binary database
+struct Record {
+	char first[FIRST_NAME_LENGTH + 1];
+	char last[LAST_NAME_LENGTH + 1];
+	char middle;
+	char number[ACC_NUM_LENGTH + 1];
+	char password[PASS_LENGTH + 1];
+	unsigned int social;
+	unsigned int area;
+	unsigned int phone;
+	double balance;
+};
+
+//A record as it sits in a page, with a version which goes up every time the record is written,
+//so a writer which read it without keeping it locked can tell whether anybody has changed it since
+struct StampedRecord {
+	Record rec;
+	unsigned int version;
+};
+
+//Start of every record page
+struct PageHeader {
+	//Next page on the free list, or 0 if this is the last one
+	unsigned int nextFree;
+	//How many slots are in use
+	unsigned int used;
+	//Which slots are in use, one bit per slot
+	unsigned long long bitmap;
+};
+
+//Page 0 of a binary database
+struct FileHeader {
+	char magic[BIN_MAGIC_LENGTH];
+	//Number of pages, including this one
+	unsigned int pageCount;
+	//First page with a free slot, or 0 if every page is full
+	unsigned int freeHead;
+	unsigned int recordCount;
+	//The highest account number the database has had, zeroed in files from before it was kept
+	char highest[ACC_NUM_LENGTH + 1];
+};
+
+#define SLOTS_PER_PAGE ((PAGE_SIZE - sizeof(PageHeader)) / sizeof(StampedRecord))
+
+//How full the record pages of a binary database are
+struct StoreStats {
+	unsigned int pages;
+	unsigned int records;
+	unsigned int freeSlots;
+	unsigned int freeListPages;
+	//Empty pages at the end of the file, which compaction gives back
+	unsigned int trailingEmptyPages;
+};
+
+void toRecord(Account*, Record*);
+void fromRecord(Record*, Account*, unsigned int);
+
+class BinaryStore : public Storage {
+	private:
+		int fd;
+		FileHeader header;
+		BufferPool pool;
+		//Account number keys to slots, built by the first scan through the file
+		multimap<unsigned long long, unsigned int> index;
+		bool indexed;
+		//F_RDLCK or F_WRLCK if records are being locked one at a time, otherwise F_UNLCK
+		short recordLock;
+		//Whether records are only locked while they are read, and changed with putIfUnchanged()
+		bool optimistic;
+
+		bool readRecord(unsigned int, StampedRecord*);
+		bool writeRecord(unsigned int, Account*);
+		unsigned int allocate();
+		void release(unsigned int);
+		bool scanPages(function<void(unsigned int, StampedRecord*)>);
+		void unindex(unsigned long long, unsigned int);
+		bool pageStats(StoreStats*);
+		bool lockRange(short, off_t, off_t);
+		bool getLocked(unsigned int, const char*, Account*);
+	public:
+		BinaryStore() : fd(-1), pool(POOL_PAGES, PAGE_SIZE), indexed(false), recordLock(F_UNLCK), optimistic(false) {}
+		~BinaryStore();
+
+		bool open(const char*);
+		bool create(const char*);
+		bool get(const char*, const char*, Account*);
+		bool put(Account*);
+		bool scan(function<bool(Account*)>);
+		bool commit();
+		bool checkpoint();
+		void highestNumber(char*);
+		void keepNumber(const char*);
+		bool compact(vector<Account>*);
+		void stats(ostream&);
+		bool lockRecords(bool);
+		bool versionRecords();
+		int putIfUnchanged(vector<Account*>*);
+};
+
+#endif
@@ -0,0 +1,143 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              bufpool.cpp
+	DESCRIPTION:       Keeps database pages in a fixed number of frames, evicting them with the CLOCK algorithm
+	COMPILER:          Built on g++ with c++11
+
+	Pages which are only read by a scan come in without their referenced bit set,
+	and a scan never sets the bit on a page that was already in the pool. That way a scan
+	through the whole file (like a report) only ever pushes out other scanned pages,
+	while pages used by lookups and updates stay in the pool.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <unistd.h>
+#include "bufpool.h"
+
+using namespace std;
+
+BufferPool::BufferPool(unsigned int pages, unsigned int size) : fd(-1), pageSize(size), memory((size_t) pages * size), frames(pages), hand(0) {
+	memset(&counts, 0, sizeof(PoolStats));
+	for(Frame& frame : frames) {
+		frame.pins = 0;
+		frame.valid = false;
+		frame.dirty = false;
+		frame.referenced = false;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          pin()
+DESCRIPTION:       Gets a page into the pool and keeps it there until it is unpinned
+RETURNS:           The page's memory, or nullptr if it couldn't be read or every frame is pinned
+----------------------------------------------------------------------------- */
+char* BufferPool::pin(unsigned int page, int mode) {
+	unordered_map<unsigned int, unsigned int>::iterator it = table.find(page);
+	if(it != table.end()) {
+		Frame& frame = frames[it->second];
+		counts.hits++;
+		frame.pins++;
+		if(mode != PIN_SCAN) frame.referenced = true;
+		return memory.data() + (size_t) it->second * pageSize;
+	}
+
+	counts.misses++;
+	unsigned int frameNum = victim();
+	if(frameNum == NO_FRAME) return nullptr;
+	Frame& frame = frames[frameNum];
+	char* data = memory.data() + (size_t) frameNum * pageSize;
+
+	if(mode == PIN_FRESH) {
+		memset(data, 0, pageSize);
+	} else {
+		ssize_t got = pread(fd, data, pageSize, (off_t) page * pageSize);
+		if(got < 0) return nullptr;
+		//Anything past the end of the file reads as zeroes
+		memset(data + got, 0, pageSize - got);
+	}
+
+	frame.page = page;
+	frame.pins = 1;
+	frame.valid = true;
+	frame.dirty = mode == PIN_FRESH;
+	frame.referenced = mode != PIN_SCAN;
+	table[page] = frameNum;
+	return data;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          unpin()
+DESCRIPTION:       Lets go of a pinned page, marking it to be written back if it was changed
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void BufferPool::unpin(unsigned int page, bool dirty) {
+	unordered_map<unsigned int, unsigned int>::iterator it = table.find(page);
+	if(it == table.end()) return;
+	Frame& frame = frames[it->second];
+	if(frame.pins > 0) frame.pins--;
+	if(dirty) frame.dirty = true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          victim()
+DESCRIPTION:       Moves the clock hand until it finds a frame to reuse, writing it back if it is dirty
+RETURNS:           The frame, or NO_FRAME if every frame is pinned
+NOTES:             Two trips around the clock are enough to clear every referenced bit
+----------------------------------------------------------------------------- */
+unsigned int BufferPool::victim() {
+	for(size_t tries = 0; tries < frames.size() * 2; tries++) {
+		unsigned int frameNum = hand;
+		Frame& frame = frames[frameNum];
+		hand = (hand + 1) % frames.size();
+
+		if(!frame.valid) return frameNum;
+		if(frame.pins > 0) continue;
+		if(frame.referenced) {
+			frame.referenced = false;
+			continue;
+		}
+		if(frame.dirty && !writeBack(frameNum)) continue;
+		table.erase(frame.page);
+		frame.valid = false;
+		counts.evictions++;
+		return frameNum;
+	}
+	return NO_FRAME;
+}
+
+bool BufferPool::writeBack(unsigned int frameNum) {
+	Frame& frame = frames[frameNum];
+	if(pwrite(fd, memory.data() + (size_t) frameNum * pageSize, pageSize, (off_t) frame.page * pageSize) != (ssize_t) pageSize) return false;
+	frame.dirty = false;
+	counts.writeBacks++;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          flush()
+DESCRIPTION:       Writes every dirty page back to the file
+RETURNS:           Whether every page could be written
+----------------------------------------------------------------------------- */
+bool BufferPool::flush() {
+	bool ok = true;
+	for(unsigned int frameNum = 0; frameNum < frames.size(); frameNum++) {
+		if(frames[frameNum].valid && frames[frameNum].dirty) ok = writeBack(frameNum) && ok;
+	}
+	return ok;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          discard()
+DESCRIPTION:       Drops every page from a given page onwards without writing them back,
+                   for when the file is about to be cut short
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void BufferPool::discard(unsigned int from) {
+	for(Frame& frame : frames) {
+		if(!frame.valid || frame.page < from) continue;
+		table.erase(frame.page);
+		frame.valid = false;
+		frame.dirty = false;
+		frame.pins = 0;
+	}
+}
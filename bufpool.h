@@ -0,0 +1,72 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              bufpool.h
+
+DESCRIPTION:       Buffer pool which keeps a fixed number of database pages in memory,
+                   so a binary database doesn't have to fit in memory to be used
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __BUFPOOL_H__
+#define __BUFPOOL_H__
+
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+//Number of pages the buffer pool keeps in memory
+#define POOL_PAGES 256
+
+//Frame number used when a page isn't in the pool
+#define NO_FRAME ((unsigned int) -1)
+
+//How pages are being asked for
+#define PIN_READ  0
+//The page is being read as part of a scan through the whole file, so it shouldn't push out anything else
+#define PIN_SCAN  1
+//The page is new and doesn't need to be read from the file
+#define PIN_FRESH 2
+
+struct Frame {
+	unsigned int page;
+	unsigned int pins;
+	bool valid;
+	bool dirty;
+	//Set whenever the page is used, and cleared as the clock hand goes past
+	bool referenced;
+};
+
+struct PoolStats {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	unsigned long long writeBacks;
+};
+
+class BufferPool {
+	private:
+		int fd;
+		unsigned int pageSize;
+		vector<char> memory;
+		vector<Frame> frames;
+		unordered_map<unsigned int, unsigned int> table;
+		unsigned int hand;
+		PoolStats counts;
+
+		unsigned int victim();
+		bool writeBack(unsigned int);
+	public:
+		BufferPool(unsigned int, unsigned int);
+
+		void attach(int a) { fd = a; }
+		char* pin(unsigned int, int);
+		void unpin(unsigned int, bool);
+		bool flush();
+		void discard(unsigned int);
+		PoolStats stats() { return counts; }
+};
+
+#endif
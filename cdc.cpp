@@ -0,0 +1,307 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              cdc.cpp
+	DESCRIPTION:       A feed of every change made to the database, for other programs to follow
+	COMPILER:          Built on g++ with c++11
+
+	The feed is looked after by the Replica's thread, which reads each change straight out of the
+	journal it keeps in memory once the change has been made, so nothing is copied for the feed
+	except into the bytes being sent. Subscribers are never waited on: each one is only given up to
+	CDC_BUFFER of events at a time, and the rest are read out of the journal again once it has caught up.
+	Before a snapshot drops the changes from the journal, everything is handed over regardless, so a
+	subscriber which stays connected never misses a change. One which comes back after they were
+	dropped is sent CDC_RESET instead.
+
+	The file is written the same way, and always has every change this server made. It's rotated like
+	a log, to file.1, file.2 and so on, and when the server starts again it carries on after the last
+	whole event in it, so the file never has a change twice or leaves one out. A follower which fell so
+	far behind that the leader sent it a snapshot never makes the changes in that snapshot itself,
+	so its file has a CDC_RESET in their place, the same as a subscriber would be sent.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cdc.h"
+#include "wire.h"
+
+using namespace std;
+
+//writeFull() is only for sockets
+static bool writeAll(int fd, const char* data, size_t length) {
+	while(length > 0) {
+		ssize_t done = write(fd, data, length);
+		if(done == -1 && errno == EINTR) continue;
+		if(done <= 0) return false;
+		data += done;
+		length -= done;
+	}
+	return true;
+}
+
+ChangeFeed::ChangeFeed() : listener(-1), file(-1), fileSize(0), fileNext(1) {
+}
+
+ChangeFeed::~ChangeFeed() {
+	stop();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          addEvents()
+DESCRIPTION:       Adds events for the changes from next onwards, until there are no more or there's enough waiting
+RETURNS:           Void function
+NOTES:             next is left at the first change which wasn't looked at
+----------------------------------------------------------------------------- */
+void ChangeFeed::addEvents(vector<char>* out, unsigned long long* next, ChangeSource* source, size_t limit) {
+	ChangeEvent event;
+	memset(&event, 0, sizeof(ChangeEvent));
+	event.magic = CDC_MAGIC;
+	if(*next < source->firstChange()) {
+		event.kind = CDC_RESET;
+		event.index = source->firstChange() - 1;
+		out->insert(out->end(), (char*) &event, (char*) &event + sizeof(ChangeEvent));
+		*next = source->firstChange();
+	}
+
+	event.kind = CDC_CHANGE;
+	unsigned long long last = source->lastChange();
+	while(*next <= last && out->size() < limit) {
+		const string* op;
+		const string* result;
+		event.index = (*next)++;
+		source->change(event.index, &event.term, &op, &result);
+		ResultHeader answer;
+		if(op->empty() || result->size() < sizeof(ResultHeader)) continue;
+		memcpy(&answer, result->data(), sizeof(ResultHeader));
+		if(answer.status != 0) continue;
+		event.opLength = op->size();
+		event.resultLength = result->size();
+		out->insert(out->end(), (char*) &event, (char*) &event + sizeof(ChangeEvent));
+		out->insert(out->end(), op->begin(), op->end());
+		out->insert(out->end(), result->begin(), result->end());
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          resumeFile()
+DESCRIPTION:       Finds the last whole event in a feed file, so the feed can carry on after it
+RETURNS:           Whether the file had any events in it
+NOTES:             The file being written to has anything after the last whole event cut off,
+                   which is what's left of a write the server didn't get to finish
+----------------------------------------------------------------------------- */
+bool ChangeFeed::resumeFile(const string& fileName, bool current) {
+	int fd = current ? file : open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return false;
+	struct stat info;
+	off_t size = fstat(fd, &info) == 0 ? info.st_size : 0;
+	off_t at = 0;
+	bool found = false;
+	ChangeEvent event;
+	while(size - at >= (off_t) sizeof(ChangeEvent) && pread(fd, &event, sizeof(ChangeEvent), at) == sizeof(ChangeEvent)) {
+		if(event.magic != CDC_MAGIC) break;
+		off_t length = sizeof(ChangeEvent) + (off_t) event.opLength + event.resultLength;
+		if(size - at < length) break;
+		at += length;
+		fileNext = event.index + 1;
+		found = true;
+	}
+	if(current) {
+		if(at != size && ftruncate(fd, at) != 0) return false;
+		fileSize = at;
+	} else {
+		::close(fd);
+	}
+	return found;
+}
+
+//Moves every file along one, dropping the oldest, and starts a new one
+bool ChangeFeed::rotateFile() {
+	for(int i = CDC_FILES - 1; i > 0; i--) {
+		string from = filePrefix + "." + to_string(i);
+		if(rename(from.c_str(), (filePrefix + "." + to_string(i + 1)).c_str()) != 0 && errno != ENOENT) return false;
+	}
+	if(rename(filePrefix.c_str(), (filePrefix + ".1").c_str()) != 0) return false;
+	int fd = open(filePrefix.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if(fd == -1) return false;
+	::close(file);
+	file = fd;
+	fileSize = 0;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          writeFile()
+DESCRIPTION:       Writes every change which isn't in the file yet
+RETURNS:           Whether they were all written
+NOTES:             A file is only rotated just before it's written to, so the newest one is never empty.
+                   If a write fails it's cut back off, and tried again next time
+----------------------------------------------------------------------------- */
+bool ChangeFeed::writeFile(ChangeSource* source) {
+	if(file == -1) return true;
+	while(fileNext <= source->lastChange()) {
+		unsigned long long from = fileNext;
+		fileOut.clear();
+		addEvents(&fileOut, &fileNext, source, CDC_BUFFER);
+		if(fileOut.empty()) continue;
+		if(fileSize > 0 && fileSize + (off_t) fileOut.size() > CDC_FILE_SIZE && !rotateFile()) {
+			fileNext = from;
+			return false;
+		}
+		if(!writeAll(file, fileOut.data(), fileOut.size())) {
+			if(ftruncate(file, fileSize) != 0) {}
+			fileNext = from;
+			return false;
+		}
+		fileSize += fileOut.size();
+	}
+	return true;
+}
+
+//Sends as much as a subscriber will take without waiting, returning false once it has hung up
+bool ChangeFeed::flushSubscriber(Subscriber* subscriber) {
+	size_t at = 0;
+	while(at < subscriber->out.size()) {
+		ssize_t done = send(subscriber->fd, subscriber->out.data() + at, subscriber->out.size() - at, MSG_NOSIGNAL);
+		if(done > 0) {
+			at += done;
+			continue;
+		}
+		if(done == -1 && errno == EINTR) continue;
+		if(done == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		return false;
+	}
+	subscriber->out.erase(subscriber->out.begin(), subscriber->out.begin() + at);
+	return true;
+}
+
+void ChangeFeed::closeSubscriber(Subscriber* subscriber) {
+	if(subscriber->fd != -1) ::close(subscriber->fd);
+	subscriber->fd = -1;
+}
+
+bool ChangeFeed::listen(const char* path) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	if(listener != -1 || strlen(path) >= sizeof(addr.sun_path)) return false;
+	strcpy(addr.sun_path, path);
+	listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(listener == -1) return false;
+	unlink(path);
+	if(bind(listener, (sockaddr*) &addr, sizeof(sockaddr_un)) != 0 || ::listen(listener, CDC_MAX_SUBSCRIBERS) != 0) {
+		::close(listener);
+		listener = -1;
+		return false;
+	}
+	socketPath = path;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          openFile()
+DESCRIPTION:       Opens the feed file, working out where it left off
+RETURNS:           Whether the file could be opened
+NOTES:             If the newest file has nothing in it, the one before it says where to carry on from.
+                   A file with nothing before it starts from the first change in the group
+----------------------------------------------------------------------------- */
+bool ChangeFeed::openFile(const char* prefix) {
+	if(file != -1) return false;
+	filePrefix = prefix;
+	file = open(prefix, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if(file == -1) return false;
+	if(!resumeFile(filePrefix, true)) resumeFile(filePrefix + ".1", false);
+	return true;
+}
+
+size_t ChangeFeed::watch(vector<pollfd>* polled) {
+	size_t count = 0;
+	if(listener != -1) {
+		polled->push_back({listener, POLLIN, 0});
+		count++;
+	}
+	for(Subscriber& subscriber : subscribers) {
+		polled->push_back({subscriber.fd, (short) (POLLIN | (subscriber.out.empty() ? 0 : POLLOUT)), 0});
+		count++;
+	}
+	return count;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          serve()
+DESCRIPTION:       Takes new subscribers and where they want to start, then sends each one whatever it's missing
+                   and writes the file
+RETURNS:           Void function
+NOTES:             The pollfds have to be the ones watch() added, in the same order
+----------------------------------------------------------------------------- */
+void ChangeFeed::serve(pollfd* polled, ChangeSource* source) {
+	size_t at = 0;
+	bool accepting = false;
+	if(listener != -1) accepting = polled[at++].revents & POLLIN;
+	for(Subscriber& subscriber : subscribers) {
+		//A snapshot since the poll() might have dropped it already
+		short events = polled[at++].revents;
+		if(subscriber.fd == -1 || events == 0) continue;
+		char buffer[256];
+		ssize_t done;
+		while((done = recv(subscriber.fd, buffer, sizeof(buffer), 0)) > 0 || (done == -1 && errno == EINTR)) {
+			if(done > 0 && !subscriber.started) subscriber.in.insert(subscriber.in.end(), buffer, buffer + done);
+		}
+		if(done == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+			closeSubscriber(&subscriber);
+			continue;
+		}
+		if(!subscriber.started && subscriber.in.size() >= sizeof(unsigned long long)) {
+			unsigned long long cursor;
+			memcpy(&cursor, subscriber.in.data(), sizeof(unsigned long long));
+			//Nobody can be further along than this server, so anything past it means from now on
+			subscriber.next = min(cursor, source->lastChange()) + 1;
+			if(cursor == CDC_FROM_NOW) subscriber.next = source->lastChange() + 1;
+			subscriber.started = true;
+			subscriber.in.clear();
+		}
+	}
+
+	if(accepting) {
+		int fd;
+		while((fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+			if(subscribers.size() >= CDC_MAX_SUBSCRIBERS) ::close(fd);
+			else subscribers.push_back({fd, {}, {}, false, 0});
+		}
+	}
+
+	for(Subscriber& subscriber : subscribers) {
+		if(subscriber.fd == -1 || !subscriber.started) continue;
+		if(subscriber.out.size() < CDC_BUFFER) addEvents(&subscriber.out, &subscriber.next, source, CDC_BUFFER);
+		if(!subscriber.out.empty() && !flushSubscriber(&subscriber)) closeSubscriber(&subscriber);
+	}
+	subscribers.erase(remove_if(subscribers.begin(), subscribers.end(), [](const Subscriber& subscriber) {
+		return subscriber.fd == -1;
+	}), subscribers.end());
+	writeFile(source);
+}
+
+//The file is synced here too, since the changes it's missing won't be kept anywhere else after this
+void ChangeFeed::drain(ChangeSource* source) {
+	for(Subscriber& subscriber : subscribers) {
+		if(subscriber.fd == -1 || !subscriber.started) continue;
+		addEvents(&subscriber.out, &subscriber.next, source, (size_t) -1);
+		if(!flushSubscriber(&subscriber)) closeSubscriber(&subscriber);
+	}
+	if(writeFile(source) && file != -1) fdatasync(file);
+}
+
+void ChangeFeed::stop() {
+	for(Subscriber& subscriber : subscribers) closeSubscriber(&subscriber);
+	subscribers.clear();
+	if(listener != -1) {
+		::close(listener);
+		unlink(socketPath.c_str());
+	}
+	if(file != -1) ::close(file);
+	listener = file = -1;
+}
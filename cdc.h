@@ -0,0 +1,119 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              cdc.h
+
+DESCRIPTION:       A feed of every change made to the database, in the order it was made, for other programs
+                   to follow instead of reading the whole database to see what's different. Each change is
+                   sent straight out of the replicated journal as it's made, to subscribers on a Unix socket
+                   or into a file which is rotated once it gets big. Every change has the same index on every
+                   server in the group, so a subscriber can pick up where it left off from any of them
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __CDC_H__
+#define __CDC_H__
+
+#include <vector>
+#include <string>
+#include <sys/types.h>
+#include <poll.h>
+
+using namespace std;
+
+//Start of every event
+#define CDC_MAGIC 0x46434443
+
+//A change which was made, followed by the change as it is in the journal (an OpHeader and its fields)
+//and then what making it gave back (a ResultHeader and the account's Record as it was afterwards, or no Record
+//for an account which was closed). Changes which were turned down, and the empty ones a new leader makes, aren't sent
+#define CDC_CHANGE 1
+//Changes up to the index are only in the snapshot now (the database's .snapshot file, which is saved to the
+//database at the same time), so a subscriber which is behind it has to start over from there. Nothing follows it.
+//A feed file only has one when it was started after a snapshot, or its server was sent a snapshot by the leader
+#define CDC_RESET 2
+
+//A subscriber sends this as where to start to only be sent changes made from now on
+#define CDC_FROM_NOW 0xFFFFFFFFFFFFFFFFull
+
+//Most subscribers at once, and how much is kept waiting for a subscriber before it has to catch up
+#define CDC_MAX_SUBSCRIBERS 16
+#define CDC_BUFFER (1 << 20)
+
+//Size a feed file is rotated at, and how many old ones are kept as file.1, file.2, ...
+#define CDC_FILE_SIZE (64 << 20)
+#define CDC_FILES 8
+
+//Events are written in the machine's own byte order, like the frames they come from
+struct ChangeEvent {
+	unsigned int magic;
+	unsigned int kind;
+	unsigned long long index;
+	unsigned long long term;
+	unsigned int opLength;
+	unsigned int resultLength;
+};
+
+/* -----------------------------------------------------------------------------
+CLASS:             ChangeSource
+DESCRIPTION:       Where a ChangeFeed reads the changes from, without anything being copied out for it
+----------------------------------------------------------------------------- */
+class ChangeSource {
+	public:
+		virtual ~ChangeSource() {}
+
+		//The oldest change still kept, and the last one made
+		virtual unsigned long long firstChange() = 0;
+		virtual unsigned long long lastChange() = 0;
+		//Gives back the term, the change and its answer, for a change between the two
+		virtual void change(unsigned long long, unsigned long long*, const string**, const string**) = 0;
+};
+
+//Someone following the feed, who sends where to start as 8 bytes (the last index they have, or 0 for everything)
+struct Subscriber {
+	int fd;
+	vector<char> in;
+	vector<char> out;
+	bool started;
+	unsigned long long next;
+};
+
+class ChangeFeed {
+	private:
+		string socketPath;
+		int listener;
+		vector<Subscriber> subscribers;
+
+		string filePrefix;
+		int file;
+		off_t fileSize;
+		unsigned long long fileNext;
+		vector<char> fileOut;
+
+		void addEvents(vector<char>*, unsigned long long*, ChangeSource*, size_t);
+		bool resumeFile(const string&, bool);
+		bool rotateFile();
+		bool writeFile(ChangeSource*);
+		bool flushSubscriber(Subscriber*);
+		void closeSubscriber(Subscriber*);
+	public:
+		ChangeFeed();
+		~ChangeFeed();
+		ChangeFeed(const ChangeFeed&) = delete;
+		ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+		//Takes subscribers on a Unix socket
+		bool listen(const char*);
+		//Writes every change into a file, carrying on from the last change already in it
+		bool openFile(const char*);
+		//Adds whatever needs watching to a poll(), then deals with whatever the poll() turned up,
+		//giving back how many were added so the caller can hand the same ones back
+		size_t watch(vector<pollfd>*);
+		void serve(pollfd*, ChangeSource*);
+		//Sends out every change made so far, however far behind a subscriber is, before they stop being kept
+		void drain(ChangeSource*);
+		void stop();
+};
+
+#endif
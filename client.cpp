@@ -0,0 +1,179 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              client.cpp
+	DESCRIPTION:       Talks to the server using the binary framing in wire.h
+	COMPILER:          Built on g++ with c++11
+
+	Nothing is sent until send(), so any number of operations go out together in one frame.
+	The server answers frames in the order they were sent, so a client can send several
+	before reading the answers to any of them.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "client.h"
+#include "wire.h"
+#include "ring.h"
+
+using namespace std;
+
+BankClient::~BankClient() {
+	transport.reset();
+	if(fd != -1) ::close(fd);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          connect()
+DESCRIPTION:       Connects to a server listening on a Unix socket
+RETURNS:           Whether the connection was made
+----------------------------------------------------------------------------- */
+bool BankClient::connect(const char* path) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)) return false;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1) return false;
+	if(::connect(fd, (sockaddr*) &addr, sizeof(sockaddr_un)) == 0) {
+		transport.reset(new SocketTransport(fd));
+		return true;
+	}
+	::close(fd);
+	fd = -1;
+	return false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          attachShared()
+DESCRIPTION:       Makes a shared memory channel and asks the server to move the connection onto it
+RETURNS:           Whether the server took the channel, otherwise the connection stays on the socket
+NOTES:             Any queued operations go out in the same frame as the request
+----------------------------------------------------------------------------- */
+bool BankClient::attachShared() {
+	string name;
+	SharedChannel* channel = createChannel(&name);
+	if(channel == nullptr) return false;
+	unique_ptr<Transport> ring(new RingTransport(channel, false, fd));
+
+	addOp(OP_ATTACH, 0, 1);
+	addField(name.c_str());
+	unsigned int id;
+	vector<WireResult> results;
+	bool ok = send() != 0 && receive(&id, &results) && results.back().status == 0;
+	//Both sides have it mapped by now, so the name isn't needed any more
+	shm_unlink(name.c_str());
+	if(ok) transport = move(ring);
+	return ok;
+}
+
+void BankClient::addOp(unsigned char op, unsigned char change, unsigned short fields) {
+	OpHeader header;
+	header.op = op;
+	header.change = change;
+	header.fields = fields;
+	frame.insert(frame.end(), (char*) &header, (char*) &header + sizeof(OpHeader));
+	count++;
+}
+
+void BankClient::addField(const char* field) {
+	unsigned short length = strlen(field);
+	frame.insert(frame.end(), (char*) &length, (char*) &length + sizeof(length));
+	frame.insert(frame.end(), field, field + length);
+}
+
+void BankClient::get(const char* number, const char* password) {
+	addOp(OP_GET, 0, 2);
+	addField(number);
+	addField(password);
+}
+
+void BankClient::change(const char* number, const char* password, char option, const char* value) {
+	addOp(OP_CHANGE, option, 3);
+	addField(number);
+	addField(password);
+	addField(value);
+}
+
+void BankClient::transfer(const char* number, const char* password, const char* amount, const char* toNumber, const char* toPassword) {
+	addOp(OP_CHANGE, O_TRANS, 5);
+	addField(number);
+	addField(password);
+	addField(amount);
+	addField(toNumber);
+	addField(toPassword);
+}
+
+void BankClient::close(const char* number, const char* password) {
+	change(number, password, O_CLOSE, "");
+}
+
+void BankClient::create(const char* value) {
+	addOp(OP_CREATE, 0, 1);
+	addField(value);
+}
+
+void BankClient::shutdown() {
+	addOp(OP_SHUTDOWN, 0, 0);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          send()
+DESCRIPTION:       Sends every queued operation to the server as one frame
+RETURNS:           The frame's id, or 0 if it couldn't be sent
+NOTES:             The queue is emptied either way
+----------------------------------------------------------------------------- */
+unsigned int BankClient::send() {
+	FrameHeader header;
+	header.magic = WIRE_MAGIC;
+	header.version = WIRE_VERSION;
+	header.id = nextId++;
+	header.count = count;
+	header.length = frame.size();
+
+	bool ok = transport != nullptr && frame.size() <= WIRE_MAX_FRAME && transport->write(&header, sizeof(FrameHeader)) && transport->write(frame.data(), frame.size());
+	frame.clear();
+	count = 0;
+	return ok ? header.id : 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          receive()
+DESCRIPTION:       Reads the answer to the oldest frame which hasn't been answered yet
+RETURNS:           Whether a well formed answer arrived
+NOTES:             The frame's id is handed back along with one result for each of its operations
+----------------------------------------------------------------------------- */
+bool BankClient::receive(unsigned int* id, vector<WireResult>* results) {
+	FrameHeader header;
+	if(transport == nullptr || !transport->read(&header, sizeof(FrameHeader))) return false;
+	if(header.magic != WIRE_MAGIC || header.version != WIRE_VERSION || header.length > WIRE_MAX_FRAME) return false;
+	vector<char> body(header.length);
+	if(!transport->read(body.data(), body.size())) return false;
+
+	*id = header.id;
+	results->clear();
+	size_t at = 0;
+	for(unsigned int i = 0; i < header.count; i++) {
+		ResultHeader result;
+		if(body.size() - at < sizeof(ResultHeader)) return false;
+		memcpy(&result, body.data() + at, sizeof(ResultHeader));
+		at += sizeof(ResultHeader);
+
+		WireResult answer;
+		answer.status = result.status;
+		answer.found = result.found;
+		if(answer.found) {
+			Record rec;
+			if(body.size() - at < sizeof(Record)) return false;
+			memcpy(&rec, body.data() + at, sizeof(Record));
+			at += sizeof(Record);
+			fromRecord(&rec, &answer.acc, NO_SLOT);
+		}
+		results->push_back(answer);
+	}
+	return at == body.size();
+}
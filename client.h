@@ -0,0 +1,64 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              client.h
+
+DESCRIPTION:       Client side of the server's binary framing. Operations are queued up and sent
+                   together as one frame, and several frames can be sent before reading any answers.
+                   Clients on the same machine as the server can switch to shared memory
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __CLIENT_H__
+#define __CLIENT_H__
+
+#include <vector>
+#include <memory>
+#include "bankacct.h"
+#include "wire.h"
+
+//The answer to one operation
+struct WireResult {
+	//0, or one of the exit codes
+	int status;
+	//Whether acc holds the account the operation was on
+	bool found;
+	Account acc;
+};
+
+class BankClient {
+	private:
+		int fd;
+		unique_ptr<Transport> transport;
+		unsigned int nextId;
+		unsigned int count;
+		//Operations queued for the next frame
+		vector<char> frame;
+
+		void addOp(unsigned char, unsigned char, unsigned short);
+		void addField(const char*);
+	public:
+		BankClient() : fd(-1), nextId(1), count(0) {}
+		~BankClient();
+
+		bool connect(const char*);
+		//Moves the connection onto a shared memory channel, which only works with nothing left unanswered
+		bool attachShared();
+
+		void get(const char*, const char*);
+		//Any batch change, using the action option letters
+		void change(const char*, const char*, char, const char*);
+		void transfer(const char*, const char*, const char*, const char*, const char*);
+		void close(const char*, const char*);
+		void create(const char*);
+		void shutdown();
+
+		//Sends every queued operation as one frame, returning its id, or 0 if it couldn't be sent
+		//Keep the number of unanswered frames bounded, since the server stops reading while its answers go unread
+		unsigned int send();
+		//Reads the answer to the oldest frame which hasn't been answered yet
+		bool receive(unsigned int*, vector<WireResult>*);
+};
+
+#endif
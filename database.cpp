@@ -0,0 +1,573 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              database.cpp
+	DESCRIPTION:       Everything done to the table of accounts, which the library, the server and the command line share
+	COMPILER:          Built on g++ with c++11
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <fstream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <regex>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <memory>
+#include <unistd.h>
+#include "bankacct.h"
+#include "textstore.h"
+#include "binstore.h"
+#include "lsmstore.h"
+#include "memstore.h"
+
+using namespace std;
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          validValue()
+DESCRIPTION:       Checks a single option value
+RETURNS:           Whether the value is valid for that option, which is always true for options without a format
+----------------------------------------------------------------------------- */
+bool validValue(char option, char* value) {
+	//Built once, since a batch can check thousands of values
+	static const regex area(R_AREA), name(R_NAME), phone(R_PHONE), middle(R_MIDDLE), ssn(R_SSN), amount(R_AMOUNT), pass(R_PASS), cores(R_CORES);
+	switch(option) {
+		case O_CHANGE_AREA:
+			return regex_match(value, area);
+		case O_CHANGE_F:
+			return strlen(value) <= FIRST_NAME_LENGTH && regex_match(value, name);
+		case O_CHANGE_L:
+			return strlen(value) <= LAST_NAME_LENGTH && regex_match(value, name);
+		case O_CHANGE_PHONE:
+			return regex_match(value, phone);
+		case O_CHANGE_M:
+			return regex_match(value, middle);
+		case O_CHANGE_SSN:
+			return regex_match(value, ssn);
+		case O_TRANS:
+			return regex_match(value, amount);
+		case O_NEWPASS:
+			return regex_match(value, pass);
+		case O_CORES:
+		case O_SETTLE:
+			return regex_match(value, cores);
+		case O_CREATE: {
+			//Splitting the fields writes into the value, so check a copy of it
+			string copy(value);
+			char* fields[CREATE_FIELDS];
+			return createFields(&copy[0], fields);
+		}
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          validBatchOp()
+DESCRIPTION:       Checks that a batch change is one which can be made, with the right fields and a valid value
+RETURNS:           Whether the change is valid
+----------------------------------------------------------------------------- */
+bool validBatchOp(BatchOp* op) {
+	switch(op->change) {
+		case O_CHANGE_AREA:
+		case O_CHANGE_F:
+		case O_CHANGE_PHONE:
+		case O_CHANGE_L:
+		case O_CHANGE_M:
+		case O_CHANGE_SSN:
+		case O_NEWPASS:
+			return op->toNumber == nullptr && validValue(op->change, op->value);
+		case O_TRANS:
+			return op->toPassword != nullptr && validValue(op->change, op->value);
+		case O_CLOSE:
+			return op->toNumber == nullptr && *op->value == '\0';
+	}
+	return false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          findAccount()
+DESCRIPTION:       Finds an account based on the account number and password
+RETURNS:           A pointer to the found account
+NOTES:             The database must already be sorted by account number,
+                   since this does a binary search for the first account with a matching number
+----------------------------------------------------------------------------- */
+Account* findAccount(vector<Account>* people, char* number, char* password) {
+	if(number == nullptr || password == nullptr) return nullptr;
+	unsigned long long key = accountKey(number);
+	vector<Account>::iterator it = lower_bound(people->begin(), people->end(), key, [](const Account& acc, unsigned long long key) {
+		return accountKey(acc.number) < key;
+	});
+	for(; it != people->end() && accountKey(it->number) == key; it++) {
+		if(!it->closed && !strcmp(it->password, password)) return &*it;
+	}
+	return nullptr;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          findBatchAccounts()
+DESCRIPTION:       Finds the accounts for every change in a batch
+RETURNS:           Void function
+NOTES:             The lookups are sorted by account number, so they can all be matched up
+                   in a single pass through the sorted database instead of a search each.
+                   Any account which couldn't be found is left as nullptr.
+----------------------------------------------------------------------------- */
+void findBatchAccounts(vector<Account>* people, vector<BatchOp>* batch) {
+	struct Lookup {
+		unsigned long long key;
+		char* password;
+		Account** found;
+	};
+	vector<Lookup> lookups;
+	for(BatchOp& op : *batch) {
+		lookups.push_back({accountKey(op.number), op.password, &op.acc});
+		if(op.toNumber != nullptr) lookups.push_back({accountKey(op.toNumber), op.toPassword, &op.to});
+	}
+	sort(lookups.begin(), lookups.end(), [](const Lookup& a, const Lookup& b) {
+		return a.key < b.key;
+	});
+
+	vector<Account>::iterator it = people->begin();
+	for(Lookup& lookup : lookups) {
+		while(it != people->end() && accountKey(it->number) < lookup.key) it++;
+		//More than one lookup can be for the same number, so look ahead without moving on
+		for(vector<Account>::iterator same = it; same != people->end() && accountKey(same->number) == lookup.key; same++) {
+			if(!same->closed && !strcmp(same->password, lookup.password)) {
+				*lookup.found = &*same;
+				break;
+			}
+		}
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          changeAccount()
+DESCRIPTION:       Sets one field of an account from an option's value
+RETURNS:           Void function
+NOTES:             The value must already have been checked with validValue()
+----------------------------------------------------------------------------- */
+void changeAccount(Account* acc, char option, char* value) {
+	switch(option) {
+		case O_CHANGE_AREA:
+			acc->area = atoi(value);
+			break;
+		case O_CHANGE_F:
+			strcpy(acc->first, value);
+			break;
+		case O_CHANGE_PHONE:
+			acc->phone = atoi(value);
+			break;
+		case O_CHANGE_L:
+			strcpy(acc->last, value);
+			break;
+		case O_CHANGE_M:
+			acc->middle = *value;
+			break;
+		case O_CHANGE_SSN:
+			acc->social = atoi(value);
+			break;
+		case O_NEWPASS:
+			strcpy(acc->password, value);
+			break;
+	}
+	acc->nameLength = strlen(acc->first) + strlen(acc->last) + 4;
+	acc->dirty = true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          transfer()
+DESCRIPTION:       Moves money from one account to another
+RETURNS:           0, or ERR_TOO_MUCH_TRANSFER if the first account doesn't have enough
+NOTES:             Worked out in whole cents, like every other way money moves, so they all round the same
+----------------------------------------------------------------------------- */
+int transfer(Account* from, Account* to, char* amount) {
+	long long cents = toCents(atof(amount));
+	if(toCents(from->balance) < cents) return ERR_TOO_MUCH_TRANSFER;
+	from->balance = (toCents(from->balance) - cents) / 100.0;
+	to->balance = (toCents(to->balance) + cents) / 100.0;
+	from->dirty = true;
+	to->dirty = true;
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runBatch()
+DESCRIPTION:       Looks up every account in a batch at once, then makes the changes in order
+RETURNS:           0, or the error code of the first change which couldn't be made
+NOTES:             Changes before the one which failed are kept, like with separate options
+----------------------------------------------------------------------------- */
+int runBatch(vector<Account>* people, vector<BatchOp>* batch) {
+	findBatchAccounts(people, batch);
+	int err;
+	for(BatchOp& op : *batch) {
+		err = runBatchOp(&op);
+		if(err != 0) return err;
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runBatchOp()
+DESCRIPTION:       Makes a single batch change, once its accounts have been looked up
+RETURNS:           0, or the error code if the change couldn't be made
+----------------------------------------------------------------------------- */
+int runBatchOp(BatchOp* op) {
+	//An account closed earlier in the batch can't be changed any more
+	if(op->acc == nullptr || op->acc->closed) return ERR_NO_ACCOUNT;
+	switch(op->change) {
+		case O_TRANS:
+			if(op->to == nullptr || op->to->closed) return ERR_NO_TRANSFER_ACCOUNT;
+			return transfer(op->acc, op->to, op->value);
+		case O_CLOSE:
+			op->acc->closed = true;
+			op->acc->dirty = true;
+			break;
+		default:
+			changeAccount(op->acc, op->change, op->value);
+			break;
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          createFields()
+DESCRIPTION:       Splits the value of a create option into its fields and checks each of them
+RETURNS:           Whether there were the right number of fields and every one was valid
+NOTES:             The separators in the value are overwritten, like with strtok
+----------------------------------------------------------------------------- */
+bool createFields(char* value, char** fields) {
+	int count = 0;
+	for(char* field = strtok(value, CREATE_SEPARATOR); field != nullptr; field = strtok(nullptr, CREATE_SEPARATOR)) {
+		if(count == CREATE_FIELDS) return false;
+		fields[count++] = field;
+	}
+	if(count != CREATE_FIELDS) return false;
+
+	if(strlen(fields[0]) > FIRST_NAME_LENGTH || !regex_match(fields[0], regex(R_NAME))) return false;
+	if(strlen(fields[1]) > LAST_NAME_LENGTH || !regex_match(fields[1], regex(R_NAME))) return false;
+	if(!regex_match(fields[2], regex(R_MIDDLE))) return false;
+	if(!regex_match(fields[3], regex(R_SSN))) return false;
+	if(!regex_match(fields[4], regex(R_AREA))) return false;
+	if(!regex_match(fields[5], regex(R_PHONE))) return false;
+	return regex_match(fields[6], regex(R_PASS));
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          createAccount()
+DESCRIPTION:       Opens a new account from the value of a create option and gives it a new account number
+RETURNS:           0 with the new account, ERR_NO_INFO if any of the fields were invalid,
+                   or ERR_NO_ACCOUNT_NUMBERS if there are no account numbers left
+NOTES:             The value is every field separated by CREATE_SEPARATOR, in this order:
+                   first,last,middle,social,area,phone,password
+----------------------------------------------------------------------------- */
+int createAccount(vector<Account>* people, char* value, Account** created) {
+	char* fields[CREATE_FIELDS];
+	if(!createFields(value, fields)) return ERR_NO_INFO;
+
+	Account person;
+	strcpy(person.first, fields[0]);
+	strcpy(person.last, fields[1]);
+	person.middle = *fields[2];
+	person.social = atoi(fields[3]);
+	person.area = atoi(fields[4]);
+	person.phone = atoi(fields[5]);
+	strcpy(person.password, fields[6]);
+	person.balance = 0;
+	person.nameLength = strlen(person.first) + strlen(person.last) + 4;
+	person.closed = false;
+	person.slot = NO_SLOT;
+	person.dirty = true;
+	person.version = 0;
+
+	if(!nextAccountNumber(people, person.number)) return ERR_NO_ACCOUNT_NUMBERS;
+	*created = insertAccount(people, &person);
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          insertAccount()
+DESCRIPTION:       Puts an account into its sorted place in the database
+RETURNS:           A pointer to the account's place in the database
+NOTES:             If the account right before the new one's place is closed, its place gets reused,
+                   since the new account sorts in between the same neighbours.
+                   It takes over the closed account's slot as well, so the storage engine replaces the closed account.
+                   New account numbers always come after every other one, so otherwise this is just a push_back.
+----------------------------------------------------------------------------- */
+Account* insertAccount(vector<Account>* people, Account* person) {
+	unsigned long long key = accountKey(person->number);
+	vector<Account>::iterator it = upper_bound(people->begin(), people->end(), key, [](unsigned long long key, const Account& acc) {
+		return key < accountKey(acc.number);
+	});
+	if(it != people->begin() && (it - 1)->closed) {
+		unsigned int slot = (it - 1)->slot;
+		*(it - 1) = *person;
+		(it - 1)->slot = slot;
+		return &*(it - 1);
+	}
+	return &*people->insert(it, *person);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          nextAccountNumber()
+DESCRIPTION:       Comes up with an account number which comes after every account number in the database
+RETURNS:           Whether there was an account number left to give out
+NOTES:             Numbers count up following ACC_NUM_PATTERN, so after A999Z comes B000A.
+                   Closed accounts still count, and so does the highest number the storage engine kept
+                   (see addHighestNumber()), so a number never gets handed out twice.
+----------------------------------------------------------------------------- */
+bool nextAccountNumber(vector<Account>* people, char* number) {
+	if(people->empty()) {
+		strcpy(number, FIRST_ACC_NUM);
+		return true;
+	}
+	strcpy(number, people->back().number);
+	for(int i = strlen(number); i < ACC_NUM_LENGTH; i++) number[i] = ' ';
+	number[ACC_NUM_LENGTH] = '\0';
+
+	for(int i = ACC_NUM_LENGTH - 1; i >= 0; i--) {
+		char low = ACC_NUM_PATTERN[i] == 'A' ? 'A' : '0';
+		char high = ACC_NUM_PATTERN[i] == 'A' ? 'Z' : '9';
+		if(number[i] < low) {
+			number[i] = low;
+			return true;
+		}
+		if(number[i] < high) {
+			number[i]++;
+			return true;
+		}
+		//Carry into the next place
+		number[i] = low;
+	}
+	return false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          accountKey()
+DESCRIPTION:       Packs an account number into an integer which orders the same way strcmp does
+RETURNS:           The packed key
+NOTES:             Each character takes up one byte, with the first character being the most significant.
+                   Anything after the null terminator is treated as 0, so shorter numbers sort first.
+----------------------------------------------------------------------------- */
+unsigned long long accountKey(const char* number) {
+	unsigned long long key = 0;
+	bool ended = false;
+	for(int i = 0; i < ACC_NUM_LENGTH; i++) {
+		if(number[i] == '\0') ended = true;
+		key = (key << 8) | (ended ? 0 : (unsigned char) number[i]);
+	}
+	return key;
+}
+
+//Amounts are checked to have at most two decimal places, so they are whole numbers of cents
+long long toCents(double amount) {
+	return llround(amount * 100);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          radixSort()
+DESCRIPTION:       Sorts the database by account number using an LSD radix sort
+RETURNS:           Void function
+NOTES:             The sort works on an array of indices so that each pass only moves integers around,
+                   and the accounts themselves are only moved once at the very end.
+                   The sort is stable, so duplicate account numbers keep the order they were loaded in.
+
+                   Once there are at least RADIX_PARALLEL_MIN accounts, each pass is split into chunks.
+                   Every thread counts the digits in its own chunk, and then scatters its chunk
+                   starting from offsets which come after every chunk before it, which keeps the sort stable.
+----------------------------------------------------------------------------- */
+void radixSort(vector<Account>* people) {
+	size_t size = people->size();
+	if(size < 2) return;
+
+	vector<unsigned long long> keys(size);
+	vector<size_t> order(size);
+	vector<size_t> scratch(size);
+	for(size_t i = 0; i < size; i++) {
+		keys[i] = accountKey(people->at(i).number);
+		order[i] = i;
+	}
+
+	unsigned int threads = 1;
+	if(size >= RADIX_PARALLEL_MIN) threads = max(1u, thread::hardware_concurrency());
+	size_t chunk = (size + threads - 1) / threads;
+
+	//Runs the given function on every chunk, in parallel if there is more than one
+	auto forEachChunk = [&](function<void(unsigned int, size_t, size_t)> work) {
+		if(threads == 1) {
+			work(0, 0, size);
+			return;
+		}
+		vector<thread> workers;
+		for(unsigned int t = 0; t < threads; t++) {
+			workers.push_back(thread(work, t, min(size, t * chunk), min(size, (t + 1) * chunk)));
+		}
+		for(thread& worker : workers) worker.join();
+	};
+
+	vector<vector<size_t>> counts(threads, vector<size_t>(256));
+	for(int digit = 0; digit < ACC_NUM_LENGTH; digit++) {
+		int shift = digit * 8;
+
+		forEachChunk([&](unsigned int t, size_t begin, size_t end) {
+			fill(counts[t].begin(), counts[t].end(), 0);
+			for(size_t i = begin; i < end; i++) counts[t][(keys[order[i]] >> shift) & 0xFF]++;
+		});
+
+		//Skip digits which are the same for every account, since they wouldn't move anything
+		bool skip = false;
+		for(int bucket = 0; bucket < 256 && !skip; bucket++) {
+			size_t count = 0;
+			for(unsigned int t = 0; t < threads; t++) count += counts[t][bucket];
+			if(count == size) skip = true;
+		}
+		if(skip) continue;
+
+		//Turn the counts into starting offsets
+		size_t total = 0;
+		for(int bucket = 0; bucket < 256; bucket++) {
+			for(unsigned int t = 0; t < threads; t++) {
+				size_t count = counts[t][bucket];
+				counts[t][bucket] = total;
+				total += count;
+			}
+		}
+
+		forEachChunk([&](unsigned int t, size_t begin, size_t end) {
+			for(size_t i = begin; i < end; i++) scratch[counts[t][(keys[order[i]] >> shift) & 0xFF]++] = order[i];
+		});
+		order.swap(scratch);
+	}
+
+	vector<Account> sorted;
+	sorted.reserve(size);
+	for(size_t i : order) sorted.push_back(people->at(i));
+	people->swap(sorted);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          createReport()
+DESCRIPTION:       Creates a human-readable text file at a given file name
+RETURNS:           Whether the report file was actually able to be created
+----------------------------------------------------------------------------- */
+bool createReport(vector<Account>* people, const char* fileName) {
+	ofstream file(fileName);
+	if(!file.is_open()) {
+		return false;
+	}
+	file << "-------  ----            -----           --  ---------  ------------  -------" << endl
+	     << "Account  Last            First           MI  SS         Phone         Account" << endl
+		 << "Number   Name            Name                Number     Number        Balance" << endl
+		 << "-------  ----            -----           --  ---------  ------------  -------" << endl;
+	
+	for(Account& person : *people) {
+		if(person.closed) continue;
+		file <<  " " << person.number << "   "
+		     << left << setw(14) << person.last << "  "
+			 << setw(14) << person.first << "  "
+			 << person.middle << ".  "
+			 << person.social << "  "
+		     << "(" << person.area << ")" << person.phone << "  "
+			 << fixed << setprecision(2) << person.balance << endl;
+	}
+	return true;
+}
+
+/*----------------------------------------------------------------------------
+FUNCTION:          makeStorage()
+DESCRIPTION:       Makes a storage engine from its name
+RETURNS:           The storage engine, or nullptr if there isn't one with that name
+----------------------------------------------------------------------------- */
+Storage* makeStorage(const char* engine) {
+	if(!strcmp(engine, ENGINE_TEXT)) return new TextStore();
+	if(!strcmp(engine, ENGINE_BINARY)) return new BinaryStore();
+	if(!strcmp(engine, ENGINE_LSM)) return new LsmStore();
+	if(!strcmp(engine, ENGINE_MEMORY)) return new MemoryStore(false);
+	if(!strcmp(engine, ENGINE_MEMORY_FORK)) return new MemoryStore(true);
+	return nullptr;
+}
+
+/*----------------------------------------------------------------------------
+FUNCTION:          openStorage()
+DESCRIPTION:       Opens the database with the given storage engine, creating it if the file doesn't exist yet.
+                   If no engine is given, each one gets a try, with text going last since it will read anything.
+RETURNS:           The opened storage engine, or nullptr if the database couldn't be opened
+----------------------------------------------------------------------------- */
+Storage* openStorage(const char* fileName, const char* engine) {
+	if(engine != nullptr) {
+		unique_ptr<Storage> storage(makeStorage(engine));
+		bool exists = access(fileName, F_OK) == 0;
+		if(storage == nullptr || !(exists ? storage->open(fileName) : storage->create(fileName))) return nullptr;
+		return storage.release();
+	}
+
+	const char* engines[] = {ENGINE_BINARY, ENGINE_LSM, ENGINE_MEMORY, ENGINE_TEXT};
+	for(const char* name : engines) {
+		unique_ptr<Storage> storage(makeStorage(name));
+		if(storage->open(fileName)) return storage.release();
+	}
+	return nullptr;
+}
+
+/*----------------------------------------------------------------------------
+FUNCTION:          copyDatabase()
+DESCRIPTION:       Writes a copy of the database to a new file with the given storage engine
+RETURNS:           Whether the copy could be written
+----------------------------------------------------------------------------- */
+bool copyDatabase(vector<Account>* people, const char* engine, const char* fileName) {
+	if(fileName == nullptr) return false;
+	unique_ptr<Storage> out(makeStorage(engine));
+	if(!out->create(fileName)) return false;
+	for(Account& acc : *people) {
+		if(acc.closed) continue;
+		Account copy = acc;
+		copy.slot = NO_SLOT;
+		if(!out->put(&copy)) return false;
+	}
+	//Closed accounts aren't copied, but the numbers they had still can't be handed out again
+	if(!people->empty() && people->back().closed) out->keepNumber(people->back().number);
+	return out->checkpoint();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          addHighestNumber()
+DESCRIPTION:       Puts a closed account with the highest number the storage engine kept at the end of the database,
+                   if none of the accounts read in has a number that high
+RETURNS:           Void function
+NOTES:             The highest number belonged to an account which was closed and dropped when it was saved.
+                   As a closed account it's never shown, saved or copied, but nextAccountNumber() still counts it
+----------------------------------------------------------------------------- */
+void addHighestNumber(vector<Account>* people, Storage* storage) {
+	char number[ACC_NUM_LENGTH + 1];
+	storage->highestNumber(number);
+	if(number[0] == '\0' || (!people->empty() && accountKey(number) <= accountKey(people->back().number))) return;
+	Account closed;
+	memset(&closed, 0, sizeof(Account));
+	strcpy(closed.number, number);
+	closed.closed = true;
+	closed.slot = NO_SLOT;
+	people->push_back(closed);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          saveDatabase()
+DESCRIPTION:       Hands every changed account back to the storage engine and commits them
+RETURNS:           Whether the storage engine took every change
+NOTES:             Closed accounts go first, so that new accounts can reuse their space
+----------------------------------------------------------------------------- */
+bool WriteOnShutdown::saveDatabase(vector<Account>* people, Storage* storage) {
+	bool ok = true;
+	//The table is sorted, so the last account has the highest number, which stays taken once it's closed
+	if(!people->empty() && people->back().closed) storage->keepNumber(people->back().number);
+	for(Account& acc : *people) {
+		if(!acc.dirty || !acc.closed) continue;
+		ok = storage->put(&acc) && ok;
+		acc.dirty = false;
+	}
+	for(Account& acc : *people) {
+		if(!acc.dirty) continue;
+		ok = storage->put(&acc) && ok;
+		acc.dirty = false;
+	}
+	return storage->commit() && ok;
+}
@@ -0,0 +1,580 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              lsmstore.cpp
+	DESCRIPTION:       Keeps a log structured merge tree database, where saving changes
+	                   only ever appends to the write ahead log
+	COMPILER:          Built on g++ with c++11
+
+	The database is made up of these files:
+		- <name>: The manifest, which lists every run and the level it is on
+		- <name>.wal: The write ahead log, which holds every change since the memtable was last written out
+		- <name>.<seq>.run: A sorted run, made up of a header, a bloom filter, and entries sorted by key
+
+	Level 0 holds runs written straight from the memtable, which can overlap each other.
+	Every level after that holds a single run, and gets merged into the next level
+	once it holds more than its share of entries.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <fstream>
+#include <sstream>
+#include <ostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lsmstore.h"
+
+using namespace std;
+
+//How many entries are read or written at a time when going through a run
+#define RUN_IO_BATCH 256
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          mix()
+DESCRIPTION:       Scrambles a key for the bloom filter (the splitmix64 finalizer)
+RETURNS:           The scrambled key
+----------------------------------------------------------------------------- */
+static unsigned long long mix(unsigned long long key) {
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	return key ^ (key >> 31);
+}
+
+static void bloomAdd(vector<unsigned long long>* bloom, unsigned long long bits, unsigned long long key) {
+	unsigned long long h1 = mix(key);
+	unsigned long long h2 = mix(h1) | 1;
+	for(int i = 0; i < BLOOM_HASHES; i++) {
+		unsigned long long bit = (h1 + i * h2) % bits;
+		(*bloom)[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+static bool bloomHas(vector<unsigned long long>* bloom, unsigned long long bits, unsigned long long key) {
+	unsigned long long h1 = mix(key);
+	unsigned long long h2 = mix(h1) | 1;
+	for(int i = 0; i < BLOOM_HASHES; i++) {
+		unsigned long long bit = (h1 + i * h2) % bits;
+		if(!((*bloom)[bit / 64] & (1ULL << (bit % 64)))) return false;
+	}
+	return true;
+}
+
+static unsigned long long checksum(const char* data, size_t length) {
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static off_t entryOffset(Run* run, unsigned long long i) {
+	return sizeof(RunHeader) + run->header.bloomBits / 8 + i * sizeof(RunEntry);
+}
+
+//Something which hands out entries in key order, for merging
+class Cursor {
+	public:
+		virtual ~Cursor() {}
+		virtual bool next(RunEntry*) = 0;
+};
+
+class MemtableCursor : public Cursor {
+	private:
+		map<unsigned long long, RunEntry>::iterator it;
+		map<unsigned long long, RunEntry>::iterator end;
+	public:
+		MemtableCursor(map<unsigned long long, RunEntry>* a) : it(a->begin()), end(a->end()) {}
+		bool next(RunEntry* out) {
+			if(it == end) return false;
+			*out = (it++)->second;
+			return true;
+		}
+};
+
+class RunCursor : public Cursor {
+	private:
+		Run* run;
+		unsigned long long read;
+		vector<RunEntry> buf;
+		size_t at;
+	public:
+		RunCursor(Run* a) : run(a), read(0), at(0) {}
+		bool next(RunEntry* out) {
+			if(at == buf.size()) {
+				unsigned long long count = min((unsigned long long) RUN_IO_BATCH, run->header.count - read);
+				if(count == 0) return false;
+				buf.resize(count);
+				ssize_t size = count * sizeof(RunEntry);
+				if(pread(run->fd, buf.data(), size, entryOffset(run, read)) != size) return false;
+				read += count;
+				at = 0;
+			}
+			*out = buf[at++];
+			return true;
+		}
+};
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          merge()
+DESCRIPTION:       Merges several sorted sources together, passing on each key once
+RETURNS:           Whether every entry was taken by the output function
+NOTES:             Sources are given newest first, so when more than one source has the same key,
+                   the entry from the earliest source wins.
+----------------------------------------------------------------------------- */
+static bool merge(vector<Cursor*>* sources, bool dropDeleted, function<bool(RunEntry*)> out) {
+	typedef pair<unsigned long long, unsigned int> Head;
+	vector<RunEntry> heads(sources->size());
+	priority_queue<Head, vector<Head>, greater<Head>> heap;
+	for(unsigned int i = 0; i < sources->size(); i++) {
+		if(sources->at(i)->next(&heads[i])) heap.push(make_pair(heads[i].key, i));
+	}
+
+	RunEntry winner;
+	while(!heap.empty()) {
+		Head top = heap.top();
+		heap.pop();
+		winner = heads[top.second];
+		if(sources->at(top.second)->next(&heads[top.second])) heap.push(make_pair(heads[top.second].key, top.second));
+
+		//Older versions of the same key
+		while(!heap.empty() && heap.top().first == top.first) {
+			unsigned int i = heap.top().second;
+			heap.pop();
+			if(sources->at(i)->next(&heads[i])) heap.push(make_pair(heads[i].key, i));
+		}
+
+		if(winner.deleted && dropDeleted) continue;
+		if(!out(&winner)) return false;
+	}
+	return true;
+}
+
+LsmStore::~LsmStore() {
+	if(walFd != -1) close(walFd);
+	for(Run& run : runs) close(run.fd);
+}
+
+string LsmStore::runName(unsigned int seq) {
+	return name + "." + to_string(seq) + ".run";
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          open()
+DESCRIPTION:       Opens an existing database from its manifest, replaying the write ahead log into the memtable
+RETURNS:           Whether the file is a manifest
+NOTES:             If any of the runs or the log can't be read, the database still counts as open,
+                   but it can't be loaded. That way it never gets mistaken for a text database.
+----------------------------------------------------------------------------- */
+bool LsmStore::open(const char* fileName) {
+	ifstream manifest(fileName);
+	string magic;
+	if(!manifest.is_open() || !getline(manifest, magic) || magic != LSM_MAGIC) return false;
+
+	name = fileName;
+	//Manifests from before the highest account number was kept only have nextSeq on this line
+	string line, kept;
+	getline(manifest, line);
+	istringstream(line) >> nextSeq >> kept;
+	if(kept.size() == ACC_NUM_LENGTH) strcpy(highest, kept.c_str());
+	unsigned int level, seq;
+	while(manifest >> level >> seq) {
+		if(!openRun(level, seq)) broken = true;
+	}
+
+	walFd = ::open((name + ".wal").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if(walFd == -1 || !replayWal()) broken = true;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          create()
+DESCRIPTION:       Creates an empty database, replacing whatever manifest and log were there
+RETURNS:           Whether the files could be created
+----------------------------------------------------------------------------- */
+bool LsmStore::create(const char* fileName) {
+	name = fileName;
+	if(!saveManifest()) return false;
+	walFd = ::open((name + ".wal").c_str(), O_RDWR | O_CREAT | O_APPEND | O_TRUNC, 0644);
+	return walFd != -1;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          openRun()
+DESCRIPTION:       Opens a run, keeping its header and bloom filter in memory
+RETURNS:           Whether the run could be read
+----------------------------------------------------------------------------- */
+bool LsmStore::openRun(unsigned int level, unsigned int seq) {
+	Run run;
+	run.level = level;
+	run.seq = seq;
+	run.fd = ::open(runName(seq).c_str(), O_RDONLY);
+	if(run.fd == -1) return false;
+	if(pread(run.fd, &run.header, sizeof(RunHeader), 0) != sizeof(RunHeader) || memcmp(run.header.magic, RUN_MAGIC, RUN_MAGIC_LENGTH)) {
+		close(run.fd);
+		return false;
+	}
+	run.bloom.resize(run.header.bloomBits / 64);
+	ssize_t size = run.header.bloomBits / 8;
+	if(pread(run.fd, run.bloom.data(), size, sizeof(RunHeader)) != size) {
+		close(run.fd);
+		return false;
+	}
+
+	runs.push_back(run);
+	sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) {
+		if(a.level != b.level) return a.level < b.level;
+		return a.seq > b.seq;
+	});
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          replayWal()
+DESCRIPTION:       Puts every complete batch in the write ahead log back into the memtable
+RETURNS:           Whether the log could be read
+NOTES:             A batch which was cut off or doesn't match its checksum ends the log,
+                   and is cut off the end of the file.
+----------------------------------------------------------------------------- */
+bool LsmStore::replayWal() {
+	off_t offset = 0;
+	WalBatch batch;
+	vector<RunEntry> entries;
+	while(pread(walFd, &batch, sizeof(WalBatch), offset) == sizeof(WalBatch) && batch.magic == WAL_MAGIC) {
+		entries.resize(batch.count);
+		ssize_t size = batch.count * sizeof(RunEntry);
+		if(pread(walFd, entries.data(), size, offset + sizeof(WalBatch)) != size) break;
+		if(checksum((char*) entries.data(), size) != batch.checksum) break;
+		for(RunEntry& entry : entries) memtable[entry.key] = entry;
+		offset += sizeof(WalBatch) + size;
+	}
+	return ftruncate(walFd, offset) == 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          appendWal()
+DESCRIPTION:       Appends a batch of changes to the write ahead log in a single write
+RETURNS:           Whether the batch made it to disk
+----------------------------------------------------------------------------- */
+bool LsmStore::appendWal(vector<RunEntry>* entries) {
+	size_t size = entries->size() * sizeof(RunEntry);
+	vector<char> buf(sizeof(WalBatch) + size);
+	WalBatch* batch = (WalBatch*) buf.data();
+	batch->magic = WAL_MAGIC;
+	batch->count = entries->size();
+	batch->checksum = checksum((char*) entries->data(), size);
+	memcpy(buf.data() + sizeof(WalBatch), entries->data(), size);
+	if(write(walFd, buf.data(), buf.size()) != (ssize_t) buf.size()) return false;
+	return fdatasync(walFd) == 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          writeRun()
+DESCRIPTION:       Merges some runs, and maybe the memtable, into a new run on a given level
+RETURNS:           Whether the new run could be written and opened
+NOTES:             The runs are given as places in the runs list, newest first.
+                   The new run gets added to the runs list, but the old ones are left for the caller.
+----------------------------------------------------------------------------- */
+bool LsmStore::writeRun(unsigned int level, vector<unsigned int> from, bool withMemtable, bool dropDeleted) {
+	vector<Cursor*> sources;
+	unsigned long long upper = 0;
+	if(withMemtable) {
+		sources.push_back(new MemtableCursor(&memtable));
+		upper += memtable.size();
+	}
+	for(unsigned int i : from) {
+		sources.push_back(new RunCursor(&runs[i]));
+		upper += runs[i].header.count;
+	}
+
+	Run run;
+	run.level = level;
+	run.seq = nextSeq++;
+	memcpy(run.header.magic, RUN_MAGIC, RUN_MAGIC_LENGTH);
+	run.header.count = 0;
+	run.header.bloomBits = max(64ULL, (upper * BLOOM_BITS_PER_ENTRY + 63) / 64 * 64);
+	run.bloom.assign(run.header.bloomBits / 64, 0);
+	run.fd = ::open(runName(run.seq).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	bool ok = run.fd != -1;
+	vector<RunEntry> buf;
+	function<bool()> spill = [&]() {
+		ssize_t size = buf.size() * sizeof(RunEntry);
+		if(pwrite(run.fd, buf.data(), size, entryOffset(&run, run.header.count)) != size) return false;
+		run.header.count += buf.size();
+		buf.clear();
+		return true;
+	};
+	if(ok) {
+		ok = merge(&sources, dropDeleted, [&](RunEntry* entry) {
+			bloomAdd(&run.bloom, run.header.bloomBits, entry->key);
+			buf.push_back(*entry);
+			return buf.size() < RUN_IO_BATCH || spill();
+		}) && spill();
+	}
+	for(Cursor* source : sources) delete source;
+
+	ok = ok && pwrite(run.fd, run.bloom.data(), run.header.bloomBits / 8, sizeof(RunHeader)) == (ssize_t) (run.header.bloomBits / 8);
+	ok = ok && pwrite(run.fd, &run.header, sizeof(RunHeader), 0) == sizeof(RunHeader);
+	ok = ok && fsync(run.fd) == 0;
+	if(run.fd != -1) close(run.fd);
+	return ok && openRun(level, run.seq);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          saveManifest()
+DESCRIPTION:       Writes out the list of runs, replacing the old manifest all at once
+RETURNS:           Whether the manifest could be written
+----------------------------------------------------------------------------- */
+bool LsmStore::saveManifest() {
+	string temp = name + ".tmp";
+	{
+		ofstream out(temp);
+		if(!out.is_open()) return false;
+		out << LSM_MAGIC << endl << nextSeq;
+		if(highest[0] != '\0') out << " " << highest;
+		out << endl;
+		for(Run& run : runs) out << run.level << " " << run.seq << endl;
+		if(!out.good()) return false;
+	}
+	if(rename(temp.c_str(), name.c_str()) != 0) return false;
+	highestChanged = false;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          flushMemtable()
+DESCRIPTION:       Writes the memtable out as a new level 0 run and empties the write ahead log
+RETURNS:           Whether the run and manifest could be written
+----------------------------------------------------------------------------- */
+bool LsmStore::flushMemtable() {
+	if(!writeRun(0, vector<unsigned int>(), true, false) || !saveManifest()) return false;
+	memtable.clear();
+	if(ftruncate(walFd, 0) != 0) return false;
+	return compactLevels();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          mergeLevels()
+DESCRIPTION:       Merges some runs into a new run on a given level, and then gets rid of the old ones
+RETURNS:           Whether the new run and manifest could be written
+----------------------------------------------------------------------------- */
+bool LsmStore::mergeLevels(unsigned int target, vector<unsigned int> from, bool dropDeleted) {
+	vector<unsigned int> oldSeqs;
+	for(unsigned int i : from) oldSeqs.push_back(runs[i].seq);
+	if(!writeRun(target, from, false, dropDeleted)) return false;
+
+	//Take the merged runs out of the list before the manifest stops pointing at them
+	for(unsigned int seq : oldSeqs) {
+		for(vector<Run>::iterator it = runs.begin(); it != runs.end(); it++) {
+			if(it->seq != seq) continue;
+			close(it->fd);
+			runs.erase(it);
+			break;
+		}
+	}
+	if(!saveManifest()) return false;
+	for(unsigned int seq : oldSeqs) unlink(runName(seq).c_str());
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          compactLevels()
+DESCRIPTION:       Merges levels into the next one down until every level is within its size
+RETURNS:           Whether every merge worked
+NOTES:             Deletions are only dropped when nothing below the new run could still have the key.
+----------------------------------------------------------------------------- */
+bool LsmStore::compactLevels() {
+	while(true) {
+		unsigned int deepest = runs.empty() ? 0 : runs.back().level;
+		vector<unsigned int> from;
+		unsigned int target = 0;
+
+		unsigned int level0 = 0;
+		while(level0 < runs.size() && runs[level0].level == 0) level0++;
+		if(level0 > LSM_L0_RUNS) {
+			target = 1;
+			for(unsigned int i = 0; i < runs.size() && runs[i].level <= 1; i++) from.push_back(i);
+		} else {
+			for(unsigned int i = level0; i < runs.size(); i++) {
+				unsigned long long limit = LSM_LEVEL_BASE;
+				for(unsigned int level = 1; level < runs[i].level; level++) limit *= LSM_LEVEL_RATIO;
+				if(runs[i].header.count <= limit) continue;
+				target = runs[i].level + 1;
+				from.push_back(i);
+				if(i + 1 < runs.size() && runs[i + 1].level == target) from.push_back(i + 1);
+				break;
+			}
+		}
+		if(from.empty()) return true;
+		if(!mergeLevels(target, from, target >= deepest)) return false;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          compact()
+DESCRIPTION:       Writes out the memtable and merges every run into one, dropping every deletion
+RETURNS:           Whether the merge worked
+NOTES:             Slots stand for account numbers rather than places in a file, so no account has to be updated
+----------------------------------------------------------------------------- */
+bool LsmStore::compact(vector<Account>*) {
+	if(!checkpoint()) return false;
+	if(runs.size() < 2) return true;
+	vector<unsigned int> from;
+	for(unsigned int i = 0; i < runs.size(); i++) from.push_back(i);
+	return mergeLevels(max(1u, runs.back().level), from, true);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          scan()
+DESCRIPTION:       Merges the memtable and every run together, going through every account in order
+RETURNS:           Whether every run could be read
+----------------------------------------------------------------------------- */
+bool LsmStore::scan(function<bool(Account*)> visit) {
+	if(broken) return false;
+	vector<Cursor*> sources;
+	sources.push_back(new MemtableCursor(&memtable));
+	for(Run& run : runs) sources.push_back(new RunCursor(&run));
+
+	bool more = true;
+	bool ok = merge(&sources, true, [&](RunEntry* entry) {
+		Account person;
+		slots.push_back(entry->key);
+		fromRecord(&entry->rec, &person, slots.size());
+		more = visit(&person);
+		return more;
+	});
+	for(Cursor* source : sources) delete source;
+	return ok || !more;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          findInRun()
+DESCRIPTION:       Looks for a key in a single run, checking its bloom filter before searching the file
+RETURNS:           Whether the run has an entry for the key
+----------------------------------------------------------------------------- */
+bool LsmStore::findInRun(Run* run, unsigned long long key, RunEntry* out) {
+	if(!bloomHas(&run->bloom, run->header.bloomBits, key)) return false;
+	unsigned long long low = 0;
+	unsigned long long high = run->header.count;
+	while(low < high) {
+		unsigned long long mid = (low + high) / 2;
+		if(pread(run->fd, out, sizeof(RunEntry), entryOffset(run, mid)) != sizeof(RunEntry)) return false;
+		if(out->key == key) return true;
+		if(out->key < key) low = mid + 1;
+		else high = mid;
+	}
+	return false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          get()
+DESCRIPTION:       Looks up a single account, checking the memtable and then each run from newest to oldest
+RETURNS:           Whether the account was found and the password matched
+----------------------------------------------------------------------------- */
+bool LsmStore::get(const char* number, const char* password, Account* acc) {
+	unsigned long long key = accountKey(number);
+	RunEntry entry;
+	bool found = false;
+
+	map<unsigned long long, RunEntry>::iterator it = memtable.find(key);
+	if(it != memtable.end()) {
+		entry = it->second;
+		found = true;
+	}
+	for(unsigned int i = 0; !found && i < runs.size(); i++) found = findInRun(&runs[i], key, &entry);
+
+	if(!found || entry.deleted || strcmp(entry.rec.password, password)) return false;
+	slots.push_back(key);
+	fromRecord(&entry.rec, acc, slots.size());
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          put()
+DESCRIPTION:       Adds a change to the batch which the next commit appends to the log
+RETURNS:           Whether the change could be added
+NOTES:             If the account took over the slot of an account with a different number,
+                   or was closed, a deletion for the old number goes in first.
+----------------------------------------------------------------------------- */
+bool LsmStore::put(Account* acc) {
+	RunEntry entry;
+	memset(&entry, 0, sizeof(RunEntry));
+	unsigned long long key = accountKey(acc->number);
+
+	if(acc->slot != NO_SLOT && (acc->closed || slots[acc->slot - 1] != key)) {
+		entry.key = slots[acc->slot - 1];
+		entry.deleted = 1;
+		pending.push_back(entry);
+	}
+	if(acc->closed) {
+		acc->slot = NO_SLOT;
+		return true;
+	}
+
+	entry.key = key;
+	entry.deleted = 0;
+	toRecord(acc, &entry.rec);
+	pending.push_back(entry);
+	if(acc->slot == NO_SLOT) {
+		slots.push_back(key);
+		acc->slot = slots.size();
+	} else {
+		slots[acc->slot - 1] = key;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          commit()
+DESCRIPTION:       Appends every change since the last commit to the log as one batch, then puts them in the memtable
+RETURNS:           Whether the batch, and any runs it caused, could be written
+NOTES:             A new highest account number goes into the manifest first, so it's never lost
+                   once the account is in the log
+----------------------------------------------------------------------------- */
+bool LsmStore::commit() {
+	if(highestChanged && !saveManifest()) return false;
+	if(pending.empty()) return true;
+	if(!appendWal(&pending)) return false;
+	for(RunEntry& change : pending) memtable[change.key] = change;
+	pending.clear();
+
+	if(memtable.size() >= LSM_MEMTABLE_LIMIT) return flushMemtable();
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          checkpoint()
+DESCRIPTION:       Commits, and then writes out the memtable so the log can be emptied
+RETURNS:           Whether everything could be written
+----------------------------------------------------------------------------- */
+bool LsmStore::checkpoint() {
+	if(!commit()) return false;
+	return memtable.empty() || flushMemtable();
+}
+
+void LsmStore::highestNumber(char* number) {
+	strcpy(number, highest);
+}
+
+void LsmStore::keepNumber(const char* number) {
+	if(accountKey(number) <= accountKey(highest)) return;
+	strcpy(highest, number);
+	highestChanged = true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          stats()
+DESCRIPTION:       Displays how many entries are in the memtable and on each level
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void LsmStore::stats(ostream& out) {
+	out << "Memtable: " << memtable.size() << " entries" << endl;
+	for(Run& run : runs) {
+		out << "Level " << run.level << ": run " << run.seq << ", " << run.header.count << " entries" << endl;
+	}
+}
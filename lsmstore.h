@@ -0,0 +1,115 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              lsmstore.h
+
+DESCRIPTION:       Log structured merge tree database. Changes are appended to a write ahead log
+                   and kept in a memtable, which gets written out as sorted runs that are merged
+                   together level by level
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __LSMSTORE_H__
+#define __LSMSTORE_H__
+
+#include <vector>
+#include <map>
+#include <string>
+#include "bankacct.h"
+#include "binstore.h"
+
+//First line of the manifest, which is the file the database is opened with
+#define LSM_MAGIC "BANKLSM1"
+//Start of every sorted run file
+#define RUN_MAGIC "BANKRUN1"
+#define RUN_MAGIC_LENGTH 8
+//Start of every batch in the write ahead log
+#define WAL_MAGIC 0x4C415742
+
+//How many entries the memtable holds before it is written out as a run
+#define LSM_MEMTABLE_LIMIT 4096
+//How many runs level 0 holds before they are merged into level 1
+#define LSM_L0_RUNS 4
+//How many entries level 1 holds, with each level after that holding LSM_LEVEL_RATIO times more
+#define LSM_LEVEL_BASE (LSM_MEMTABLE_LIMIT * LSM_L0_RUNS)
+#define LSM_LEVEL_RATIO 10
+
+//Bloom filter size and number of hashes, which gives about a 1% false positive rate
+#define BLOOM_BITS_PER_ENTRY 10
+#define BLOOM_HASHES 7
+
+//A single account, or the deletion of one, in the memtable, log, or a run
+struct RunEntry {
+	unsigned long long key;
+	unsigned int deleted;
+	Record rec;
+};
+
+struct RunHeader {
+	char magic[RUN_MAGIC_LENGTH];
+	unsigned long long count;
+	unsigned long long bloomBits;
+};
+
+struct WalBatch {
+	unsigned int magic;
+	unsigned int count;
+	//FNV-1a hash of the entries, so a batch that was only partly written gets thrown away
+	unsigned long long checksum;
+};
+
+struct Run {
+	unsigned int level;
+	unsigned int seq;
+	int fd;
+	RunHeader header;
+	vector<unsigned long long> bloom;
+};
+
+class LsmStore : public Storage {
+	private:
+		string name;
+		int walFd;
+		bool broken;
+		unsigned int nextSeq;
+		//The highest account number the database has had, kept in the manifest after nextSeq
+		char highest[ACC_NUM_LENGTH + 1];
+		//Whether highest has gone up since the manifest was last written
+		bool highestChanged;
+		map<unsigned long long, RunEntry> memtable;
+		//Level 0 runs newest first, then one run for each level after that
+		vector<Run> runs;
+		//The account number key behind every slot that has been handed out
+		vector<unsigned long long> slots;
+		//Changes which haven't been committed yet
+		vector<RunEntry> pending;
+
+		string runName(unsigned int);
+		bool openRun(unsigned int, unsigned int);
+		bool replayWal();
+		bool appendWal(vector<RunEntry>*);
+		bool writeRun(unsigned int, vector<unsigned int>, bool, bool);
+		bool saveManifest();
+		bool flushMemtable();
+		bool mergeLevels(unsigned int, vector<unsigned int>, bool);
+		bool compactLevels();
+		bool findInRun(Run*, unsigned long long, RunEntry*);
+	public:
+		LsmStore() : walFd(-1), broken(false), nextSeq(1), highest(""), highestChanged(false) {}
+		~LsmStore();
+
+		bool open(const char*);
+		bool create(const char*);
+		bool get(const char*, const char*, Account*);
+		bool put(Account*);
+		bool scan(function<bool(Account*)>);
+		bool commit();
+		bool checkpoint();
+		void highestNumber(char*);
+		void keepNumber(const char*);
+		bool compact(vector<Account>*);
+		void stats(ostream&);
+};
+
+#endif
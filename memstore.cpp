@@ -0,0 +1,405 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              memstore.cpp
+	DESCRIPTION:       Keeps the whole database in memory, with a background thread writing snapshots
+	COMPILER:          Built on g++ with c++11
+
+	The table is split into chunks which are shared with the snapshot thread. Taking a snapshot
+	only copies the list of chunks, and a change to a chunk the snapshot is still writing
+	copies that one chunk first, so changes never wait for a snapshot to be written.
+	Snapshots are only taken between commits, so they never hold half of a transfer.
+
+	In forking mode, the snapshot thread forks instead, and the child writes the table as it was
+	at the fork while the kernel copies any page either side writes to afterwards.
+	The child can't allocate memory, since another thread might have been holding the allocator's
+	lock when it forked, so it only uses buffers on its stack and plain system calls.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "memstore.h"
+
+using namespace std;
+
+MemoryStore::~MemoryStore() {
+	if(!writer.joinable()) return;
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+	//Changes which were never committed never will be now, so they can't go in a snapshot
+	if(mutations > 0 && uncommitted == 0) snapshot();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          open()
+DESCRIPTION:       Loads the latest snapshot and starts the snapshot thread
+RETURNS:           Whether the file is a snapshot and could be read
+----------------------------------------------------------------------------- */
+bool MemoryStore::open(const char* fileName) {
+	int fd = ::open(fileName, O_RDONLY);
+	if(fd == -1) return false;
+	SnapshotHeader header;
+	if(read(fd, &header, sizeof(SnapshotHeader)) != sizeof(SnapshotHeader) || memcmp(header.magic, MEM_MAGIC, MEM_MAGIC_LENGTH)) {
+		close(fd);
+		return false;
+	}
+
+	vector<Record> buf(MEM_CHUNK);
+	for(unsigned long long done = 0; done < header.count;) {
+		unsigned long long count = min((unsigned long long) MEM_CHUNK, header.count - done);
+		ssize_t bytes = count * sizeof(Record);
+		if(read(fd, buf.data(), bytes) != bytes) {
+			close(fd);
+			return false;
+		}
+		shared_ptr<Chunk> chunk = make_shared<Chunk>(count);
+		for(unsigned int i = 0; i < count; i++) {
+			fromRecord(&buf[i], &chunk->at(i), ++size);
+			index.insert(make_pair(accountKey(buf[i].number), size));
+		}
+		table.push_back(chunk);
+		done += count;
+	}
+	//Snapshots from before the highest account number was kept end with the last record
+	if(read(fd, highest, sizeof(highest)) != sizeof(highest) || highest[ACC_NUM_LENGTH] != '\0') highest[0] = '\0';
+	close(fd);
+
+	name = fileName;
+	writer = thread(&MemoryStore::snapshotLoop, this);
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          create()
+DESCRIPTION:       Writes an empty snapshot and starts the snapshot thread
+RETURNS:           Whether the snapshot could be written
+----------------------------------------------------------------------------- */
+bool MemoryStore::create(const char* fileName) {
+	name = fileName;
+	if(!snapshot()) return false;
+	writer = thread(&MemoryStore::snapshotLoop, this);
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          slot()
+DESCRIPTION:       Finds a slot so it can be changed, copying its chunk first if a snapshot still has it
+RETURNS:           A pointer to the account in the slot
+NOTES:             The lock has to be held
+----------------------------------------------------------------------------- */
+Account* MemoryStore::slot(unsigned int n) {
+	shared_ptr<Chunk>& chunk = table[(n - 1) / MEM_CHUNK];
+	if(chunk.use_count() > 1) chunk = make_shared<Chunk>(*chunk);
+	return &chunk->at((n - 1) % MEM_CHUNK);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          get()
+DESCRIPTION:       Finds the first open account with a given number and password
+RETURNS:           Whether the account was found
+----------------------------------------------------------------------------- */
+bool MemoryStore::get(const char* number, const char* password, Account* acc) {
+	pair<multimap<unsigned long long, unsigned int>::iterator, multimap<unsigned long long, unsigned int>::iterator> range = index.equal_range(accountKey(number));
+	for(multimap<unsigned long long, unsigned int>::iterator it = range.first; it != range.second; it++) {
+		Account& person = table[(it->second - 1) / MEM_CHUNK]->at((it->second - 1) % MEM_CHUNK);
+		if(person.closed || strcmp(person.password, password)) continue;
+		*acc = person;
+		return true;
+	}
+	return false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          put()
+DESCRIPTION:       Changes the table straight away, keeping the index up to date
+RETURNS:           Whether the account could be stored
+----------------------------------------------------------------------------- */
+bool MemoryStore::put(Account* acc) {
+	lock_guard<mutex> guard(lock);
+	uncommitted++;
+
+	if(acc->slot == NO_SLOT) {
+		if(acc->closed) return true;
+		if(size % MEM_CHUNK == 0) table.push_back(make_shared<Chunk>());
+		shared_ptr<Chunk>& chunk = table.back();
+		if(chunk.use_count() > 1) chunk = make_shared<Chunk>(*chunk);
+		acc->slot = ++size;
+		chunk->push_back(*acc);
+		index.insert(make_pair(accountKey(acc->number), acc->slot));
+		return true;
+	}
+
+	Account* old = slot(acc->slot);
+	unsigned long long oldKey = accountKey(old->number);
+	unsigned long long key = accountKey(acc->number);
+	if(!old->closed && (acc->closed || oldKey != key)) {
+		pair<multimap<unsigned long long, unsigned int>::iterator, multimap<unsigned long long, unsigned int>::iterator> range = index.equal_range(oldKey);
+		for(multimap<unsigned long long, unsigned int>::iterator it = range.first; it != range.second; it++) {
+			if(it->second != acc->slot) continue;
+			index.erase(it);
+			break;
+		}
+	}
+	if(!acc->closed && (old->closed || oldKey != key)) index.insert(make_pair(key, acc->slot));
+	*old = *acc;
+	if(acc->closed) acc->slot = NO_SLOT;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          scan()
+DESCRIPTION:       Goes through every open account in the order they were added
+RETURNS:           Whether every account was visited
+----------------------------------------------------------------------------- */
+bool MemoryStore::scan(function<bool(Account*)> visit) {
+	for(shared_ptr<Chunk>& chunk : table) {
+		for(Account& acc : *chunk) {
+			if(acc.closed) continue;
+			Account person = acc;
+			if(!visit(&person)) return false;
+		}
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          commit()
+DESCRIPTION:       Marks the changes since the last commit as safe to snapshot, waking the snapshot thread if enough have built up
+RETURNS:           Always true, since nothing is written here
+----------------------------------------------------------------------------- */
+bool MemoryStore::commit() {
+	bool full;
+	{
+		lock_guard<mutex> guard(lock);
+		mutations += uncommitted;
+		uncommitted = 0;
+		full = mutations >= MEM_SNAPSHOT_MUTATIONS;
+	}
+	committed.notify_all();
+	if(full) wake.notify_one();
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          checkpoint()
+DESCRIPTION:       Commits and writes a snapshot straight away
+RETURNS:           Whether the snapshot could be written
+----------------------------------------------------------------------------- */
+bool MemoryStore::checkpoint() {
+	return commit() && snapshot();
+}
+
+void MemoryStore::highestNumber(char* number) {
+	lock_guard<mutex> guard(lock);
+	strcpy(number, highest);
+}
+
+//Counts as a change, so it goes in the next snapshot even if nothing else does
+void MemoryStore::keepNumber(const char* number) {
+	lock_guard<mutex> guard(lock);
+	if(accountKey(number) <= accountKey(highest)) return;
+	strcpy(highest, number);
+	mutations++;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          snapshot()
+DESCRIPTION:       Writes every open account to a new snapshot file, which then replaces the old one
+RETURNS:           Whether the snapshot could be written
+NOTES:             The lock is only held long enough to copy the list of chunks. If another thread is partway
+                   through its changes, the copy waits for it to commit them, so it never has half of a transfer
+----------------------------------------------------------------------------- */
+bool MemoryStore::snapshot() {
+	lock_guard<mutex> one(writing);
+	if(forking) return forkSnapshot();
+
+	vector<shared_ptr<Chunk>> chunks;
+	char kept[ACC_NUM_LENGTH + 1];
+	{
+		unique_lock<mutex> guard(lock);
+		committed.wait(guard, [&]() {
+			return uncommitted == 0;
+		});
+		chunks = table;
+		strcpy(kept, highest);
+		mutations = 0;
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	string temp = name + ".tmp";
+	int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1) return false;
+
+	SnapshotHeader header;
+	memcpy(header.magic, MEM_MAGIC, MEM_MAGIC_LENGTH);
+	header.count = 0;
+	bool ok = write(fd, &header, sizeof(SnapshotHeader)) == sizeof(SnapshotHeader);
+
+	vector<Record> buf;
+	buf.reserve(MEM_CHUNK);
+	for(unsigned int i = 0; ok && i < chunks.size(); i++) {
+		buf.clear();
+		for(Account& acc : *chunks[i]) {
+			if(acc.closed) continue;
+			buf.push_back(Record());
+			toRecord(&acc, &buf.back());
+		}
+		ssize_t bytes = buf.size() * sizeof(Record);
+		ok = write(fd, buf.data(), bytes) == bytes;
+		header.count += buf.size();
+	}
+	chunks.clear();
+
+	ok = ok && write(fd, kept, sizeof(kept)) == sizeof(kept);
+	ok = ok && pwrite(fd, &header, sizeof(SnapshotHeader), 0) == sizeof(SnapshotHeader);
+	ok = ok && fdatasync(fd) == 0;
+	close(fd);
+	ok = ok && rename(temp.c_str(), name.c_str()) == 0;
+
+	lock_guard<mutex> guard(lock);
+	snapshots++;
+	lastSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          forkSnapshot()
+DESCRIPTION:       Forks a child to write the snapshot, and waits for it to finish
+RETURNS:           Whether the child wrote the snapshot
+NOTES:             The lock is only held for the fork itself, once every change has been committed
+----------------------------------------------------------------------------- */
+bool MemoryStore::forkSnapshot() {
+	string temp = name + ".tmp";
+	int report[2];
+	if(pipe(report) != 0) return false;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	pid_t child;
+	{
+		unique_lock<mutex> guard(lock);
+		committed.wait(guard, [&]() {
+			return uncommitted == 0;
+		});
+		mutations = 0;
+		child = fork();
+		if(child == 0) {
+			close(report[0]);
+			writeChild(temp.c_str(), report[1]);
+		}
+	}
+	double forked = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	close(report[1]);
+	if(child == -1) {
+		close(report[0]);
+		return false;
+	}
+
+	ForkReport done;
+	bool ok = read(report[0], &done, sizeof(ForkReport)) == sizeof(ForkReport) && done.ok;
+	close(report[0]);
+	int status;
+	ok = waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+
+	lock_guard<mutex> guard(lock);
+	snapshots++;
+	forkSeconds = forked;
+	lastSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if(ok) copiedPages = done.copiedPages;
+	return ok;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          writeChild()
+DESCRIPTION:       Runs in the forked child, writing the snapshot and then reporting how many pages were copied
+RETURNS:           Never returns
+----------------------------------------------------------------------------- */
+void MemoryStore::writeChild(const char* temp, int report) {
+	ForkReport done;
+	done.ok = false;
+	done.copiedPages = 0;
+
+	int fd = ::open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd != -1) {
+		SnapshotHeader header;
+		memcpy(header.magic, MEM_MAGIC, MEM_MAGIC_LENGTH);
+		header.count = 0;
+		bool ok = write(fd, &header, sizeof(SnapshotHeader)) == sizeof(SnapshotHeader);
+
+		Record buf[64];
+		unsigned int used = 0;
+		for(unsigned int i = 0; ok && i < table.size(); i++) {
+			for(Account& acc : *table[i]) {
+				if(acc.closed) continue;
+				toRecord(&acc, &buf[used++]);
+				header.count++;
+				if(used < 64) continue;
+				ok = ok && write(fd, buf, sizeof(buf)) == sizeof(buf);
+				used = 0;
+			}
+		}
+		ok = ok && write(fd, buf, used * sizeof(Record)) == (ssize_t) (used * sizeof(Record));
+		ok = ok && write(fd, highest, sizeof(highest)) == sizeof(highest);
+		ok = ok && pwrite(fd, &header, sizeof(SnapshotHeader), 0) == sizeof(SnapshotHeader);
+		ok = ok && fdatasync(fd) == 0;
+		close(fd);
+		done.ok = ok && rename(temp, name.c_str()) == 0;
+	}
+
+	//Whatever the child has as private dirty memory is what got copied since the fork
+	char smaps[4096];
+	int proc = ::open("/proc/self/smaps_rollup", O_RDONLY);
+	if(proc != -1) {
+		ssize_t got = read(proc, smaps, sizeof(smaps) - 1);
+		close(proc);
+		smaps[got > 0 ? got : 0] = '\0';
+		char* line = strstr(smaps, "Private_Dirty:");
+		if(line != nullptr) done.copiedPages = strtoull(line + strlen("Private_Dirty:"), nullptr, 10) * 1024 / sysconf(_SC_PAGESIZE);
+	}
+
+	ssize_t sent = write(report, &done, sizeof(ForkReport));
+	_exit(done.ok && sent == sizeof(ForkReport) ? 0 : 1);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          snapshotLoop()
+DESCRIPTION:       Runs on the snapshot thread, writing a snapshot whenever enough time has gone by
+                   or enough changes have been committed
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void MemoryStore::snapshotLoop() {
+	unique_lock<mutex> guard(lock);
+	while(!stopping) {
+		wake.wait_for(guard, chrono::seconds(MEM_SNAPSHOT_SECONDS), [&]() {
+			return stopping || (mutations >= MEM_SNAPSHOT_MUTATIONS && uncommitted == 0);
+		});
+		if(stopping || mutations == 0 || uncommitted != 0) continue;
+		guard.unlock();
+		snapshot();
+		guard.lock();
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          stats()
+DESCRIPTION:       Displays how many accounts there are and how snapshots have been going
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void MemoryStore::stats(ostream& out) {
+	lock_guard<mutex> guard(lock);
+	out << "Accounts: " << index.size() << endl
+	    << "Snapshots written: " << snapshots << endl
+	    << "Last snapshot took: " << lastSeconds << " seconds" << endl;
+	if(forking) {
+		out << "Last fork took: " << forkSeconds << " seconds" << endl
+		    << "Pages copied on write: " << copiedPages << endl;
+	}
+	out << "Changes since the last snapshot: " << mutations + uncommitted << endl;
+}
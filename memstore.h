@@ -0,0 +1,100 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              memstore.h
+
+DESCRIPTION:       In memory database, which is only written out as snapshots by a background thread,
+                   or by a forked child process. Anything since the last snapshot is lost if the program
+                   doesn't shut down cleanly
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __MEMSTORE_H__
+#define __MEMSTORE_H__
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "bankacct.h"
+#include "binstore.h"
+
+//Start of every snapshot file
+#define MEM_MAGIC "BANKMEM1"
+#define MEM_MAGIC_LENGTH 8
+
+//A snapshot gets written once this many seconds have gone by with changes, or once this many changes have been committed
+#define MEM_SNAPSHOT_SECONDS 5
+#define MEM_SNAPSHOT_MUTATIONS 10000
+
+//Number of accounts in each chunk of the table
+#define MEM_CHUNK 1024
+
+//What a forked snapshot child sends back once it is done
+struct ForkReport {
+	bool ok;
+	//Pages the child ended up with its own copy of, because one side wrote to them after the fork
+	unsigned long long copiedPages;
+};
+
+struct SnapshotHeader {
+	char magic[MEM_MAGIC_LENGTH];
+	unsigned long long count;
+};
+
+typedef vector<Account> Chunk;
+
+class MemoryStore : public Storage {
+	private:
+		string name;
+		//Whether snapshots are written by a forked child instead of the snapshot thread
+		bool forking;
+		//Slot n is in chunk (n - 1) / MEM_CHUNK. A chunk being written by a snapshot is copied before it is changed
+		vector<shared_ptr<Chunk>> table;
+		unsigned int size;
+		multimap<unsigned long long, unsigned int> index;
+		//Changes which have been made to the table but not committed yet
+		unsigned long long uncommitted;
+		//The highest account number the database has had, written after the last record of every snapshot
+		char highest[ACC_NUM_LENGTH + 1];
+
+		mutex lock;
+		//Only one snapshot gets written at a time
+		mutex writing;
+		condition_variable wake;
+		//Signalled whenever the changes made so far have all been committed
+		condition_variable committed;
+		thread writer;
+		bool stopping;
+		unsigned long long mutations;
+		unsigned long long snapshots;
+		double lastSeconds;
+		double forkSeconds;
+		unsigned long long copiedPages;
+
+		Account* slot(unsigned int);
+		bool snapshot();
+		bool forkSnapshot();
+		void writeChild(const char*, int);
+		void snapshotLoop();
+	public:
+		MemoryStore(bool a) : forking(a), size(0), uncommitted(0), highest(""), stopping(false), mutations(0), snapshots(0), lastSeconds(0), forkSeconds(0), copiedPages(0) {}
+		~MemoryStore();
+
+		bool open(const char*);
+		bool create(const char*);
+		bool get(const char*, const char*, Account*);
+		bool put(Account*);
+		bool scan(function<bool(Account*)>);
+		bool commit();
+		bool checkpoint();
+		void highestNumber(char*);
+		void keepNumber(const char*);
+		void stats(ostream&);
+};
+
+#endif
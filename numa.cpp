@@ -0,0 +1,135 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              numa.cpp
+	DESCRIPTION:       Finds the machine's NUMA nodes, pins threads to them, and hands out memory on them
+	COMPILER:          Built on g++ with c++11
+
+	Memory for a node is mapped on its own and bound to the node with mbind(), preferring it rather
+	than insisting on it, so running out of memory on one node doesn't fail the allocation.
+	With only one node there's nothing to gain, so everything comes from the normal heap.
+----------------------------------------------------------------------------- */
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "numa.h"
+
+using namespace std;
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          readCpuList()
+DESCRIPTION:       Reads a list of processors like 0-3,8-11 out of a file in /sys
+RETURNS:           Whether the file was there
+----------------------------------------------------------------------------- */
+static bool readCpuList(const string& path, vector<int>* cpus) {
+	ifstream file(path);
+	string list;
+	if(!file || !getline(file, list)) return false;
+
+	stringstream ranges(list);
+	string range;
+	while(getline(ranges, range, ',')) {
+		if(range.empty()) continue;
+		size_t dash = range.find('-');
+		int low = atoi(range.c_str());
+		int high = dash == string::npos ? low : atoi(range.c_str() + dash + 1);
+		for(int cpu = low; cpu <= high; cpu++) cpus->push_back(cpu);
+	}
+	return true;
+}
+
+struct NumaNode {
+	//The kernel's number for the node, which can skip some
+	unsigned int id;
+	vector<int> cpus;
+};
+
+//Every node which has processors, worked out the first time they're needed.
+//Everything else numbers nodes by their place in here
+static const vector<NumaNode>& topology() {
+	static const vector<NumaNode> nodes = [] {
+		vector<NumaNode> found;
+		for(unsigned int id = 0; id < NUMA_MAX_NODES; id++) {
+			NumaNode node;
+			node.id = id;
+			if(!readCpuList("/sys/devices/system/node/node" + to_string(id) + "/cpulist", &node.cpus)) continue;
+			if(!node.cpus.empty()) found.push_back(node);
+		}
+		return found;
+	}();
+	return nodes;
+}
+
+unsigned int numaNodes() {
+	return topology().empty() ? 1 : topology().size();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          pinToNode()
+DESCRIPTION:       Keeps the calling thread on the processors of one node
+RETURNS:           Whether it worked, which it can't on a machine without NUMA
+----------------------------------------------------------------------------- */
+bool pinToNode(unsigned int node) {
+	if(node >= topology().size()) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(int cpu : topology()[node].cpus) {
+		if(cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+	}
+	return sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          pinToCore()
+DESCRIPTION:       Keeps the calling thread on one of the processors it's allowed to run on,
+                   counting around them if there are fewer than the number given
+RETURNS:           Whether it worked
+----------------------------------------------------------------------------- */
+bool pinToCore(unsigned int core) {
+	cpu_set_t allowed;
+	if(sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0 || CPU_COUNT(&allowed) == 0) return false;
+	core %= CPU_COUNT(&allowed);
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(!CPU_ISSET(cpu, &allowed) || core-- > 0) continue;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0;
+	}
+	return false;
+}
+
+static bool bound(unsigned int node) {
+	return node < topology().size() && numaNodes() > 1;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          nodeAlloc()
+DESCRIPTION:       Allocates memory which lives on a node
+RETURNS:           The memory, or nullptr if there wasn't any
+NOTES:             NO_NODE means anywhere. nodeFree() has to be told the same size and node
+----------------------------------------------------------------------------- */
+void* nodeAlloc(size_t size, unsigned int node) {
+	if(!bound(node)) return malloc(size);
+	void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED) return nullptr;
+	//Nothing has touched the pages yet, so they all get placed by the policy
+	unsigned int id = topology()[node].id;
+	unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = {};
+	mask[id / (8 * sizeof(unsigned long))] = 1UL << (id % (8 * sizeof(unsigned long)));
+	syscall(SYS_mbind, mem, size, MPOL_PREFERRED, mask, NUMA_MAX_NODES, 0);
+	return mem;
+}
+
+void nodeFree(void* mem, size_t size, unsigned int node) {
+	if(mem == nullptr) return;
+	if(!bound(node)) free(mem);
+	else munmap(mem, size);
+}
@@ -0,0 +1,64 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              numa.h
+
+DESCRIPTION:       Finds the machine's NUMA nodes, pins threads to them, and hands out memory
+                   which lives on a given node. Everything works out of /sys and raw system calls,
+                   and a machine without NUMA looks like it has a single node
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __NUMA_H__
+#define __NUMA_H__
+
+#include <cstddef>
+#include <new>
+
+using namespace std;
+
+//Most nodes looked for, which is also as many as mbind() is told about
+#define NUMA_MAX_NODES 64
+
+//Node given for memory which can live anywhere
+#define NO_NODE ((unsigned int) -1)
+
+unsigned int numaNodes();
+bool pinToNode(unsigned int);
+bool pinToCore(unsigned int);
+void* nodeAlloc(size_t, unsigned int);
+void nodeFree(void*, size_t, unsigned int);
+
+//Lets a standard container keep its memory on one node
+template <class T>
+class NodeAllocator {
+	public:
+		typedef T value_type;
+		unsigned int node;
+
+		NodeAllocator(unsigned int a = NO_NODE) : node(a) {}
+		template <class U>
+		NodeAllocator(const NodeAllocator<U>& other) : node(other.node) {}
+
+		T* allocate(size_t count) {
+			void* mem = nodeAlloc(count * sizeof(T), node);
+			if(mem == nullptr) throw bad_alloc();
+			return (T*) mem;
+		}
+		void deallocate(T* mem, size_t count) {
+			nodeFree(mem, count * sizeof(T), node);
+		}
+};
+
+template <class T, class U>
+bool operator==(const NodeAllocator<T>& a, const NodeAllocator<U>& b) {
+	return a.node == b.node;
+}
+
+template <class T, class U>
+bool operator!=(const NodeAllocator<T>& a, const NodeAllocator<U>& b) {
+	return a.node != b.node;
+}
+
+#endif
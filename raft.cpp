@@ -0,0 +1,1012 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              raft.cpp
+	DESCRIPTION:       Replicates the server's journal of changes between a group of servers with Raft
+	COMPILER:          Built on g++ with c++11
+
+	Everything about the group is looked after by one thread, which goes around a poll() of the other
+	servers' connections, so nothing here needs a lock except what the client threads hand over.
+	Each server connects to every other one to send it requests, and answers requests on the
+	connections the others made to it, so a slow server never holds up one it's asking something of.
+
+	A client thread's change goes into the leader's journal with whatever else came in at the same time,
+	and the journal is synced once for all of them. The leader keeps sending changes to each follower
+	without waiting for it to answer for the ones before, up to RAFT_IN_FLIGHT of them, and a follower
+	syncs its journal before it answers for them. Once most of the group has a change on disk it's
+	committed, made by every server in journal order, and the client thread is told how it went.
+
+	Every RAFT_SNAPSHOT_EVERY changes, the whole state is written to a snapshot file and saved to the
+	database, and the journal starts over from there. A follower which needs a change from before the
+	snapshot is sent the snapshot in one message instead. Between snapshots the database itself isn't
+	written to, so it can be behind, and the journal is what's safe.
+
+	Each change's answer is kept with it in the journal in memory, so a ChangeFeed can send both out
+	from here once the change has been made, without another copy of either.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "raft.h"
+
+using namespace std;
+
+//How long the thread waits in poll() before looking at its timers, and how often it tries to reconnect, in milliseconds
+#define RAFT_TICK 10
+#define RAFT_RECONNECT 100
+
+//FNV-1a, which is plenty to tell a torn write apart from a good one
+static unsigned int checksum(const char* data, size_t length) {
+	unsigned int hash = 2166136261u;
+	for(size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static bool writeAll(int fd, const char* data, size_t length) {
+	while(length > 0) {
+		ssize_t done = write(fd, data, length);
+		if(done == -1 && errno == EINTR) continue;
+		if(done <= 0) return false;
+		data += done;
+		length -= done;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          replaceFile()
+DESCRIPTION:       Writes a whole file under another name and renames it over the old one once it's on disk
+RETURNS:           Whether the new file was put in place
+NOTES:             Anybody reading the file sees either all of the old one or all of the new one
+----------------------------------------------------------------------------- */
+static bool replaceFile(const string& fileName, const string& data) {
+	string temp = fileName + ".tmp";
+	int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd == -1) return false;
+	bool ok = writeAll(fd, data.data(), data.size()) && fsync(fd) == 0;
+	close(fd);
+	return ok && rename(temp.c_str(), fileName.c_str()) == 0;
+}
+
+static bool readFile(const string& fileName, string* data) {
+	int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return false;
+	data->clear();
+	char buffer[65536];
+	ssize_t done;
+	while((done = read(fd, buffer, sizeof(buffer))) != 0) {
+		if(done == -1 && errno == EINTR) continue;
+		if(done == -1) break;
+		data->append(buffer, done);
+	}
+	close(fd);
+	return done == 0;
+}
+
+static void addEntry(string* out, unsigned long long index, JournalEntry* entry) {
+	EntryHeader header;
+	header.index = index;
+	header.term = entry->term;
+	header.length = entry->op.size();
+	header.check = checksum(entry->op.data(), entry->op.size());
+	out->append((char*) &header, sizeof(EntryHeader));
+	out->append(entry->op);
+}
+
+Replica::Replica(const char* a, unsigned int b, vector<const char*>* c) : fileName(a), me(b), machine(nullptr), feed(nullptr), term(0), votedFor(-1),
+	journal(-1), journalSize(0), snapshotIndex(0), snapshotTerm(0), role(RAFT_FOLLOWER), leader(-1), commitIndex(0), lastApplied(0),
+	votes(0), random(chrono::steady_clock::now().time_since_epoch().count() + b), listener(-1), stopping(false) {
+	for(const char* peer : *c) peers.push_back(peer);
+	wake[0] = wake[1] = -1;
+}
+
+Replica::~Replica() {
+	stop();
+}
+
+unsigned long long Replica::lastIndex() {
+	return snapshotIndex + log.size();
+}
+
+//The term a change was proposed in, or 0 for a change this server doesn't have
+unsigned long long Replica::termAt(unsigned long long index) {
+	if(index == snapshotIndex) return snapshotTerm;
+	if(index < snapshotIndex || index > lastIndex()) return 0;
+	return log[index - snapshotIndex - 1].term;
+}
+
+//The term and vote have to be on disk before anybody is told about them, or a server could vote twice in a term
+bool Replica::saveTerm() {
+	TermFile out;
+	memset(&out, 0, sizeof(TermFile));
+	memcpy(out.magic, TERM_MAGIC, RAFT_MAGIC_LENGTH);
+	out.term = term;
+	out.votedFor = votedFor;
+	return replaceFile(fileName + TERM_SUFFIX, string((char*) &out, sizeof(TermFile)));
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          loadJournal()
+DESCRIPTION:       Reads back every change in the journal after the snapshot
+RETURNS:           Whether the journal could be opened, or made if there wasn't one
+NOTES:             The journal is cut short at the first change which was only partly written,
+                   or which doesn't follow on from the one before it. Changes already in the
+                   snapshot are left where they are until the journal is next rewritten
+----------------------------------------------------------------------------- */
+bool Replica::loadJournal() {
+	string name = fileName + JOURNAL_SUFFIX;
+	journal = open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(journal == -1) return false;
+	string data;
+	if(!readFile(name, &data)) return false;
+	if(data.size() < RAFT_MAGIC_LENGTH || memcmp(data.data(), JOURNAL_MAGIC, RAFT_MAGIC_LENGTH) != 0) {
+		if(ftruncate(journal, 0) != 0 || pwrite(journal, JOURNAL_MAGIC, RAFT_MAGIC_LENGTH, 0) != RAFT_MAGIC_LENGTH) return false;
+		journalSize = RAFT_MAGIC_LENGTH;
+		return fdatasync(journal) == 0;
+	}
+
+	size_t at = RAFT_MAGIC_LENGTH;
+	while(data.size() - at >= sizeof(EntryHeader)) {
+		EntryHeader header;
+		memcpy(&header, data.data() + at, sizeof(EntryHeader));
+		if(data.size() - at - sizeof(EntryHeader) < header.length) break;
+		const char* op = data.data() + at + sizeof(EntryHeader);
+		if(header.check != checksum(op, header.length)) break;
+		if(header.index > snapshotIndex) {
+			if(header.index != lastIndex() + 1) break;
+			log.push_back({header.term, string(op, header.length)});
+			offsets.push_back(at);
+		}
+		at += sizeof(EntryHeader) + header.length;
+	}
+	journalSize = at;
+	if(at != data.size() && (ftruncate(journal, at) != 0 || fdatasync(journal) != 0)) return false;
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          appendJournal()
+DESCRIPTION:       Writes every change from this place in the log onwards to the end of the journal, and syncs it
+RETURNS:           Whether the changes are on disk
+NOTES:             However many changes are written, there's only one sync for all of them
+----------------------------------------------------------------------------- */
+bool Replica::appendJournal(size_t from) {
+	if(from >= log.size()) return true;
+	string out;
+	for(size_t k = from; k < log.size(); k++) {
+		offsets.push_back(journalSize + out.size());
+		addEntry(&out, snapshotIndex + k + 1, &log[k]);
+	}
+	if(pwrite(journal, out.data(), out.size(), journalSize) != (ssize_t) out.size()) return false;
+	journalSize += out.size();
+	return fdatasync(journal) == 0;
+}
+
+//Throws away every change from this one onwards, which a new leader didn't have
+bool Replica::truncateJournal(unsigned long long index) {
+	size_t k = index - snapshotIndex - 1;
+	if(k >= log.size()) return true;
+	journalSize = offsets[k];
+	log.resize(k);
+	offsets.resize(k);
+	return ftruncate(journal, journalSize) == 0 && fdatasync(journal) == 0;
+}
+
+//Writes the journal over again with just the changes after the snapshot
+bool Replica::rewriteJournal() {
+	string out(JOURNAL_MAGIC, RAFT_MAGIC_LENGTH);
+	offsets.clear();
+	for(size_t k = 0; k < log.size(); k++) {
+		offsets.push_back(out.size());
+		addEntry(&out, snapshotIndex + k + 1, &log[k]);
+	}
+	string name = fileName + JOURNAL_SUFFIX;
+	if(!replaceFile(name, out)) return false;
+	if(journal != -1) close(journal);
+	journal = open(name.c_str(), O_RDWR | O_CLOEXEC);
+	journalSize = out.size();
+	return journal != -1;
+}
+
+bool Replica::writeSnapshot() {
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(SnapshotHeader));
+	memcpy(header.magic, SNAPSHOT_MAGIC, RAFT_MAGIC_LENGTH);
+	header.index = snapshotIndex;
+	header.term = snapshotTerm;
+	header.length = snapshot.size();
+	return replaceFile(fileName + SNAPSHOT_SUFFIX, string((char*) &header, sizeof(SnapshotHeader)) + snapshot);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          takeSnapshot()
+DESCRIPTION:       Writes out everything made so far as the new snapshot, and starts the journal over after it
+RETURNS:           Whether the snapshot and the database were saved
+NOTES:             The database is only saved once the snapshot is, so a crash partway through
+                   still leaves a snapshot and journal which have everything
+----------------------------------------------------------------------------- */
+bool Replica::takeSnapshot() {
+	if(lastApplied == snapshotIndex) return true;
+	if(feed != nullptr) feed->drain(this);
+	unsigned long long indexTerm = termAt(lastApplied);
+	machine->save(&snapshot);
+	//The journal keeps the changes in the snapshot until it's rewritten, so where the rest of them are doesn't change
+	log.erase(log.begin(), log.begin() + (lastApplied - snapshotIndex));
+	offsets.erase(offsets.begin(), offsets.begin() + (lastApplied - snapshotIndex));
+	snapshotIndex = lastApplied;
+	snapshotTerm = indexTerm;
+	if(!writeSnapshot()) return false;
+	bool ok = machine->persist();
+	return rewriteJournal() && ok;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          installSnapshot()
+DESCRIPTION:       Replaces everything on this server with a snapshot from the leader
+RETURNS:           Whether the snapshot could be loaded and saved
+NOTES:             Every change in the log is thrown away, since the leader sends anything after the snapshot.
+                   The feed is sent every change made before then, but this server never makes the ones
+                   in the snapshot it didn't have, so the feed only gets a CDC_RESET for those.
+                   Like takeSnapshot(), the database is only saved and the journal started over once the snapshot is
+----------------------------------------------------------------------------- */
+bool Replica::installSnapshot(unsigned long long index, unsigned long long indexTerm, const char* data, size_t length) {
+	if(feed != nullptr) feed->drain(this);
+	string loaded(data, length);
+	if(!machine->load(loaded)) return false;
+	//Anybody waiting on a change which was in the log has lost it
+	for(unsigned long long at = snapshotIndex + 1; at <= lastIndex(); at++) {
+		map<unsigned long long, Proposal*>::iterator it = waiting.find(at);
+		if(it != waiting.end()) finish(it->second, ERR_NOT_LEADER, "");
+	}
+	snapshot.swap(loaded);
+	snapshotIndex = index;
+	snapshotTerm = indexTerm;
+	log.clear();
+	commitIndex = lastApplied = index;
+	if(!writeSnapshot()) return false;
+	bool ok = machine->persist();
+	return rewriteJournal() && ok;
+}
+
+void Replica::resetElection() {
+	electionDeadline = chrono::steady_clock::now() + chrono::milliseconds(RAFT_ELECTION_MIN + random() % RAFT_ELECTION_SPREAD);
+}
+
+//A term which can't be saved isn't taken, since after a restart this server could vote in it again
+bool Replica::setTerm(unsigned long long newTerm) {
+	unsigned long long oldTerm = term;
+	int oldVote = votedFor;
+	term = newTerm;
+	votedFor = -1;
+	if(saveTerm()) return true;
+	term = oldTerm;
+	votedFor = oldVote;
+	return false;
+}
+
+//Steps down either way, but only joins the new term if it could be saved
+bool Replica::becomeFollower(unsigned long long newTerm) {
+	role = RAFT_FOLLOWER;
+	leader = -1;
+	resetElection();
+	return newTerm <= term || setTerm(newTerm);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          startElection()
+DESCRIPTION:       Stands for leader in a new term, voting for itself and asking everybody else for their vote
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void Replica::startElection() {
+	resetElection();
+	unsigned long long oldTerm = term;
+	int oldVote = votedFor;
+	term++;
+	votedFor = me;
+	if(!saveTerm()) {
+		//Tried again at the next deadline
+		term = oldTerm;
+		votedFor = oldVote;
+		return;
+	}
+	role = RAFT_CANDIDATE;
+	leader = -1;
+	votes = 1;
+	if(votes > peers.size() / 2) {
+		becomeLeader();
+		return;
+	}
+
+	RaftMessage message;
+	memset(&message, 0, sizeof(RaftMessage));
+	message.type = RAFT_VOTE;
+	message.index = lastIndex();
+	message.indexTerm = termAt(lastIndex());
+	for(unsigned int peer = 0; peer < peers.size(); peer++) {
+		if(peer != me) queue(&outgoing[peer], &message, nullptr, 0);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          becomeLeader()
+DESCRIPTION:       Takes over as leader once most of the group voted for this server
+RETURNS:           Void function
+NOTES:             A leader can only commit changes from its own term, so it starts with one which does nothing,
+                   which commits everything before it once most of the group has it
+----------------------------------------------------------------------------- */
+void Replica::becomeLeader() {
+	role = RAFT_LEADER;
+	leader = me;
+	for(unsigned int peer = 0; peer < peers.size(); peer++) {
+		nextIndex[peer] = lastIndex() + 1;
+		matchIndex[peer] = 0;
+		lastSent[peer] = chrono::steady_clock::time_point();
+		snapshotSent[peer] = chrono::steady_clock::time_point();
+	}
+	vector<JournalEntry> entries(1, {term, ""});
+	appendEntries(&entries);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          appendEntries()
+DESCRIPTION:       Adds changes to the leader's log and journal, and sends them on to the followers
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void Replica::appendEntries(vector<JournalEntry>* entries) {
+	size_t from = log.size();
+	for(JournalEntry& entry : *entries) log.push_back(entry);
+	if(!appendJournal(from)) {
+		//Nothing which isn't on disk can be counted, so step down and let somebody else lead
+		truncateJournal(snapshotIndex + from + 1);
+		becomeFollower(term);
+		return;
+	}
+	matchIndex[me] = lastIndex();
+	for(unsigned int peer = 0; peer < peers.size(); peer++) {
+		if(peer != me) sendAppends(peer);
+	}
+	advanceCommit();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          takeProposals()
+DESCRIPTION:       Puts every change the client threads handed over since last time into the journal together
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void Replica::takeProposals() {
+	vector<Proposal*> taken;
+	{
+		lock_guard<mutex> hold(lock);
+		taken.swap(proposed);
+	}
+	if(taken.empty()) return;
+	if(role != RAFT_LEADER) {
+		for(Proposal* proposal : taken) finish(proposal, ERR_NOT_LEADER, "");
+		return;
+	}
+
+	vector<JournalEntry> entries;
+	{
+		lock_guard<mutex> hold(lock);
+		for(Proposal* proposal : taken) {
+			proposal->index = lastIndex() + entries.size() + 1;
+			proposal->term = term;
+			waiting[proposal->index] = proposal;
+			entries.push_back({term, proposal->op});
+		}
+	}
+	appendEntries(&entries);
+}
+
+//Hands a client thread back the answer to its change
+void Replica::finish(Proposal* proposal, int status, const string& result) {
+	lock_guard<mutex> hold(lock);
+	if(proposal->index != 0) waiting.erase(proposal->index);
+	proposal->status = status;
+	proposal->result = result;
+	proposal->done = true;
+	answered.notify_all();
+}
+
+void Replica::queue(PeerLink* link, RaftMessage* message, const char* payload, size_t length) {
+	if(link->fd == -1) return;
+	message->magic = RAFT_MAGIC;
+	message->from = me;
+	message->term = term;
+	message->length = length;
+	link->out.insert(link->out.end(), (char*) message, (char*) message + sizeof(RaftMessage));
+	if(length > 0) link->out.insert(link->out.end(), payload, payload + length);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          sendAppends()
+DESCRIPTION:       Sends a follower whatever changes it doesn't have yet, in batches, without waiting for it to answer
+RETURNS:           Void function
+NOTES:             A follower which has nothing to be sent gets an empty batch once in a while,
+                   so it knows the leader is still there and how far it has committed
+----------------------------------------------------------------------------- */
+void Replica::sendAppends(unsigned int peer) {
+	PeerLink* link = &outgoing[peer];
+	if(link->fd == -1) return;
+	if(nextIndex[peer] <= snapshotIndex) {
+		sendSnapshot(peer);
+		return;
+	}
+
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	bool sent = false;
+	while(nextIndex[peer] <= lastIndex() && nextIndex[peer] - matchIndex[peer] <= RAFT_IN_FLIGHT) {
+		RaftMessage message;
+		memset(&message, 0, sizeof(RaftMessage));
+		message.type = RAFT_APPEND;
+		message.index = nextIndex[peer] - 1;
+		message.indexTerm = termAt(message.index);
+		message.commit = commitIndex;
+		string payload;
+		for(; message.count < RAFT_BATCH && nextIndex[peer] <= lastIndex(); message.count++) {
+			addEntry(&payload, nextIndex[peer], &log[nextIndex[peer] - snapshotIndex - 1]);
+			nextIndex[peer]++;
+		}
+		queue(link, &message, payload.data(), payload.size());
+		sent = true;
+	}
+	if(sent) lastSent[peer] = now;
+	if(sent || now - lastSent[peer] < chrono::milliseconds(RAFT_HEARTBEAT)) return;
+
+	RaftMessage message;
+	memset(&message, 0, sizeof(RaftMessage));
+	message.type = RAFT_APPEND;
+	message.index = nextIndex[peer] - 1;
+	message.indexTerm = termAt(message.index);
+	message.commit = commitIndex;
+	queue(link, &message, nullptr, 0);
+	lastSent[peer] = now;
+}
+
+//Sends a follower the whole snapshot, since the changes it needs have been thrown away
+void Replica::sendSnapshot(unsigned int peer) {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if(snapshotSent[peer] != chrono::steady_clock::time_point() && now - snapshotSent[peer] < chrono::milliseconds(RAFT_SNAPSHOT_RETRY)) return;
+	RaftMessage message;
+	memset(&message, 0, sizeof(RaftMessage));
+	message.type = RAFT_SNAPSHOT;
+	message.index = snapshotIndex;
+	message.indexTerm = snapshotTerm;
+	message.commit = commitIndex;
+	queue(&outgoing[peer], &message, snapshot.data(), snapshot.size());
+	snapshotSent[peer] = lastSent[peer] = now;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          handle()
+DESCRIPTION:       Acts on one message from another server
+RETURNS:           Void function
+NOTES:             Anybody in a later term means this server is behind, so it follows whoever that is
+----------------------------------------------------------------------------- */
+void Replica::handle(PeerLink* link, RaftMessage* message, const char* payload) {
+	if(message->from >= peers.size() || message->from == me) return;
+	if(message->term > term && !becomeFollower(message->term)) return;
+
+	switch(message->type) {
+		case RAFT_VOTE:
+			handleVote(link, message);
+			break;
+		case RAFT_VOTE_REPLY:
+			handleVoteReply(message);
+			break;
+		case RAFT_APPEND:
+			handleAppend(link, message, payload);
+			break;
+		case RAFT_APPEND_REPLY:
+		case RAFT_SNAPSHOT_REPLY:
+			handleAppendReply(message);
+			break;
+		case RAFT_SNAPSHOT:
+			handleSnapshot(link, message, payload);
+			break;
+	}
+}
+
+//Votes for a candidate as long as this server hasn't voted for anybody else this term, and the candidate's log is at least as far along
+void Replica::handleVote(PeerLink* link, RaftMessage* message) {
+	unsigned long long lastTerm = termAt(lastIndex());
+	bool upToDate = message->indexTerm > lastTerm || (message->indexTerm == lastTerm && message->index >= lastIndex());
+	RaftMessage reply;
+	memset(&reply, 0, sizeof(RaftMessage));
+	reply.type = RAFT_VOTE_REPLY;
+	if(message->term == term && upToDate && (votedFor == -1 || votedFor == (int) message->from)) {
+		//A vote which can't be saved is turned down, so it doesn't count here either
+		int oldVote = votedFor;
+		votedFor = message->from;
+		reply.success = saveTerm();
+		if(reply.success) resetElection();
+		else votedFor = oldVote;
+	}
+	queue(link, &reply, nullptr, 0);
+}
+
+void Replica::handleVoteReply(RaftMessage* message) {
+	if(role != RAFT_CANDIDATE || message->term != term || !message->success) return;
+	votes++;
+	if(votes > peers.size() / 2) becomeLeader();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          handleAppend()
+DESCRIPTION:       Takes a batch of changes from the leader, if they follow on from what this server has
+RETURNS:           Void function
+NOTES:             Anything which disagrees with the leader is thrown away. A refusal says how far back to start over,
+                   skipping the rest of the term which disagreed, so the leader finds where they agree quickly
+----------------------------------------------------------------------------- */
+void Replica::handleAppend(PeerLink* link, RaftMessage* message, const char* payload) {
+	RaftMessage reply;
+	memset(&reply, 0, sizeof(RaftMessage));
+	reply.type = RAFT_APPEND_REPLY;
+	if(message->term < term) {
+		reply.index = lastIndex();
+		queue(link, &reply, nullptr, 0);
+		return;
+	}
+	role = RAFT_FOLLOWER;
+	leader = message->from;
+	resetElection();
+
+	unsigned long long previous = message->index;
+	if(previous > lastIndex()) {
+		reply.index = lastIndex();
+		queue(link, &reply, nullptr, 0);
+		return;
+	}
+	if(previous >= snapshotIndex && termAt(previous) != message->indexTerm) {
+		unsigned long long conflict = termAt(previous);
+		unsigned long long back = previous - 1;
+		while(back > snapshotIndex && back > commitIndex && termAt(back) == conflict) back--;
+		reply.index = back;
+		queue(link, &reply, nullptr, 0);
+		return;
+	}
+
+	size_t from = log.size();
+	bool ok = true;
+	size_t at = 0;
+	for(unsigned int i = 0; i < message->count; i++) {
+		EntryHeader header;
+		if(message->length - at < sizeof(EntryHeader)) {
+			ok = false;
+			break;
+		}
+		memcpy(&header, payload + at, sizeof(EntryHeader));
+		at += sizeof(EntryHeader);
+		if(message->length - at < header.length || header.check != checksum(payload + at, header.length) || header.index != previous + i + 1) {
+			ok = false;
+			break;
+		}
+		const char* op = payload + at;
+		at += header.length;
+		if(header.index <= snapshotIndex) continue;
+		if(header.index <= lastIndex()) {
+			if(termAt(header.index) == header.term) continue;
+			//Everything from here on is something an old leader never got committed
+			for(unsigned long long gone = header.index; gone <= lastIndex(); gone++) {
+				map<unsigned long long, Proposal*>::iterator it = waiting.find(gone);
+				if(it != waiting.end()) finish(it->second, ERR_NOT_LEADER, "");
+			}
+			if(!truncateJournal(header.index)) {
+				ok = false;
+				break;
+			}
+			from = log.size();
+		}
+		log.push_back({header.term, string(op, header.length)});
+	}
+	ok = ok && appendJournal(from);
+	if(!ok) {
+		//Whatever couldn't be written is thrown away, and the leader is asked to send it again
+		truncateJournal(snapshotIndex + from + 1);
+		reply.index = min(previous, lastIndex());
+		queue(link, &reply, nullptr, 0);
+		return;
+	}
+
+	unsigned long long last = previous + message->count;
+	if(message->commit > commitIndex) commitIndex = max(commitIndex, min(message->commit, last));
+	reply.success = 1;
+	reply.index = last;
+	queue(link, &reply, nullptr, 0);
+}
+
+//Moves a follower on after it answered for changes or a snapshot, sending it more if there are any
+void Replica::handleAppendReply(RaftMessage* message) {
+	if(role != RAFT_LEADER || message->term != term) return;
+	unsigned int peer = message->from;
+	if(message->success) {
+		matchIndex[peer] = max(matchIndex[peer], message->index);
+		nextIndex[peer] = max(nextIndex[peer], matchIndex[peer] + 1);
+		if(message->type == RAFT_SNAPSHOT_REPLY) snapshotSent[peer] = chrono::steady_clock::time_point();
+		advanceCommit();
+	} else {
+		nextIndex[peer] = max(matchIndex[peer] + 1, min(nextIndex[peer], message->index + 1));
+	}
+	sendAppends(peer);
+}
+
+void Replica::handleSnapshot(PeerLink* link, RaftMessage* message, const char* payload) {
+	RaftMessage reply;
+	memset(&reply, 0, sizeof(RaftMessage));
+	reply.type = RAFT_SNAPSHOT_REPLY;
+	reply.index = lastIndex();
+	if(message->term < term) {
+		queue(link, &reply, nullptr, 0);
+		return;
+	}
+	role = RAFT_FOLLOWER;
+	leader = message->from;
+	resetElection();
+
+	//A snapshot of what this server already made doesn't need to be loaded
+	if(message->index <= commitIndex) {
+		reply.success = 1;
+		reply.index = commitIndex;
+	} else if(installSnapshot(message->index, message->indexTerm, payload, message->length)) {
+		reply.success = 1;
+		reply.index = message->index;
+	}
+	queue(link, &reply, nullptr, 0);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          advanceCommit()
+DESCRIPTION:       Commits as far as most of the group has in their journals
+RETURNS:           Void function
+NOTES:             Only a change from this leader's own term can be committed by counting,
+                   and everything before it goes along with it
+----------------------------------------------------------------------------- */
+void Replica::advanceCommit() {
+	for(unsigned long long index = lastIndex(); index > commitIndex && termAt(index) == term; index--) {
+		unsigned int count = 0;
+		for(unsigned long long match : matchIndex) {
+			if(match >= index) count++;
+		}
+		if(count > peers.size() / 2) {
+			commitIndex = index;
+			break;
+		}
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          applyCommitted()
+DESCRIPTION:       Makes every change which has been committed but not made yet, answering anybody waiting on them
+RETURNS:           Void function
+NOTES:             A client is only given the answer if its change is still the one at that place in the journal
+----------------------------------------------------------------------------- */
+void Replica::applyCommitted() {
+	while(lastApplied < commitIndex) {
+		lastApplied++;
+		JournalEntry& entry = log[lastApplied - snapshotIndex - 1];
+		if(!entry.op.empty()) machine->apply(entry.op, &entry.result);
+
+		Proposal* proposal = nullptr;
+		{
+			lock_guard<mutex> hold(lock);
+			map<unsigned long long, Proposal*>::iterator it = waiting.find(lastApplied);
+			if(it != waiting.end()) proposal = it->second;
+		}
+		if(proposal != nullptr) finish(proposal, proposal->term == entry.term ? 0 : ERR_NOT_LEADER, entry.result);
+	}
+	if(lastApplied - snapshotIndex >= RAFT_SNAPSHOT_EVERY) takeSnapshot();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          connectPeers()
+DESCRIPTION:       Tries to connect to every server which this one doesn't have a connection to yet
+RETURNS:           Whether any new connections were made
+----------------------------------------------------------------------------- */
+bool Replica::connectPeers() {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if(now - lastConnect < chrono::milliseconds(RAFT_RECONNECT)) return false;
+	lastConnect = now;
+	bool connected = false;
+	for(unsigned int peer = 0; peer < peers.size(); peer++) {
+		if(peer == me || outgoing[peer].fd != -1) continue;
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(sockaddr_un));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, peers[peer].c_str());
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(fd == -1) continue;
+		if(connect(fd, (sockaddr*) &addr, sizeof(sockaddr_un)) != 0) {
+			close(fd);
+			continue;
+		}
+		outgoing[peer].fd = fd;
+		//Anything sent on the old connection might never have arrived
+		nextIndex[peer] = matchIndex[peer] + 1;
+		snapshotSent[peer] = chrono::steady_clock::time_point();
+		connected = true;
+	}
+	return connected;
+}
+
+//Reads everything waiting on a connection, returning false once it has been hung up
+bool Replica::readLink(PeerLink* link) {
+	char buffer[65536];
+	while(true) {
+		ssize_t done = recv(link->fd, buffer, sizeof(buffer), 0);
+		if(done > 0) {
+			link->in.insert(link->in.end(), buffer, buffer + done);
+			continue;
+		}
+		if(done == -1 && errno == EINTR) continue;
+		return done == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+	}
+}
+
+//Sends as much as a connection will take without waiting, returning false once it has been hung up
+bool Replica::flushLink(PeerLink* link) {
+	size_t at = 0;
+	while(at < link->out.size()) {
+		ssize_t done = send(link->fd, link->out.data() + at, link->out.size() - at, MSG_NOSIGNAL);
+		if(done > 0) {
+			at += done;
+			continue;
+		}
+		if(done == -1 && errno == EINTR) continue;
+		if(done == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		return false;
+	}
+	link->out.erase(link->out.begin(), link->out.begin() + at);
+	return true;
+}
+
+void Replica::closeLink(PeerLink* link) {
+	if(link->fd != -1) close(link->fd);
+	link->fd = -1;
+	link->in.clear();
+	link->out.clear();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          tick()
+DESCRIPTION:       Stands for election if the leader has gone quiet, or sends heartbeats as the leader
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void Replica::tick() {
+	if(role == RAFT_LEADER) {
+		for(unsigned int peer = 0; peer < peers.size(); peer++) {
+			if(peer != me) sendAppends(peer);
+		}
+	} else if(chrono::steady_clock::now() >= electionDeadline) {
+		startElection();
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          run()
+DESCRIPTION:       The Replica's thread, which does everything to do with the group until it's told to stop
+RETURNS:           Void function
+NOTES:             Each time around, messages from the other servers are handled, then any changes the clients
+                   handed over, then whatever has been committed is made, and last everything is sent.
+                   A final snapshot is taken on the way out, so the database has every committed change
+----------------------------------------------------------------------------- */
+void Replica::run() {
+	vector<pollfd> polled;
+	//Which link each pollfd after the listener and the wake pipe belongs to
+	vector<PeerLink*> links;
+	while(!stopping) {
+		polled.clear();
+		links.clear();
+		polled.push_back({listener, POLLIN, 0});
+		polled.push_back({wake[0], POLLIN, 0});
+		//The feed's are added last, so the links' stay where they are
+		size_t fed = 0;
+		for(PeerLink& link : outgoing) {
+			if(link.fd == -1) continue;
+			polled.push_back({link.fd, (short) (POLLIN | (link.out.empty() ? 0 : POLLOUT)), 0});
+			links.push_back(&link);
+		}
+		for(PeerLink& link : incoming) {
+			polled.push_back({link.fd, (short) (POLLIN | (link.out.empty() ? 0 : POLLOUT)), 0});
+			links.push_back(&link);
+		}
+		if(feed != nullptr) fed = feed->watch(&polled);
+		if(poll(polled.data(), polled.size(), RAFT_TICK) == -1 && errno != EINTR) break;
+
+		if(polled[1].revents & POLLIN) {
+			char drained[256];
+			while(read(wake[0], drained, sizeof(drained)) > 0) {}
+		}
+		for(size_t i = 0; i < links.size(); i++) {
+			PeerLink* link = links[i];
+			if(polled[i + 2].revents == 0) continue;
+			if(!readLink(link)) {
+				closeLink(link);
+				continue;
+			}
+			size_t at = 0;
+			while(link->fd != -1 && link->in.size() - at >= sizeof(RaftMessage)) {
+				RaftMessage message;
+				memcpy(&message, link->in.data() + at, sizeof(RaftMessage));
+				if(message.magic != RAFT_MAGIC || message.length > RAFT_MAX_MESSAGE) {
+					closeLink(link);
+					break;
+				}
+				if(link->in.size() - at - sizeof(RaftMessage) < message.length) break;
+				handle(link, &message, link->in.data() + at + sizeof(RaftMessage));
+				at += sizeof(RaftMessage) + message.length;
+			}
+			if(link->fd != -1) link->in.erase(link->in.begin(), link->in.begin() + at);
+		}
+		incoming.erase(remove_if(incoming.begin(), incoming.end(), [](const PeerLink& link) {
+			return link.fd == -1;
+		}), incoming.end());
+		if(polled[0].revents & POLLIN) {
+			int fd;
+			while((fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) incoming.push_back({fd, {}, {}});
+		}
+
+		connectPeers();
+		takeProposals();
+		tick();
+		applyCommitted();
+		if(feed != nullptr) feed->serve(polled.data() + polled.size() - fed, this);
+
+		for(PeerLink& link : outgoing) {
+			if(link.fd != -1 && !link.out.empty() && !flushLink(&link)) closeLink(&link);
+		}
+		for(PeerLink& link : incoming) {
+			if(link.fd != -1 && !link.out.empty() && !flushLink(&link)) closeLink(&link);
+		}
+	}
+	takeSnapshot();
+}
+
+void Replica::feedTo(ChangeFeed* changes) {
+	if(journal == -1) feed = changes;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          start()
+DESCRIPTION:       Picks up the term, snapshot and journal from disk, and starts the Replica's thread
+RETURNS:           Whether the files could be read and the thread started
+NOTES:             The first time a server starts, its database becomes the first snapshot.
+                   Every server in the group has to start from the same database
+----------------------------------------------------------------------------- */
+bool Replica::start(ReplicatedState* state) {
+	if(me >= peers.size() || journal != -1) return false;
+	machine = state;
+
+	string data;
+	if(readFile(fileName + TERM_SUFFIX, &data) && data.size() == sizeof(TermFile) && memcmp(data.data(), TERM_MAGIC, RAFT_MAGIC_LENGTH) == 0) {
+		TermFile saved;
+		memcpy(&saved, data.data(), sizeof(TermFile));
+		term = saved.term;
+		votedFor = saved.votedFor;
+	}
+
+	if(readFile(fileName + SNAPSHOT_SUFFIX, &data) && data.size() >= sizeof(SnapshotHeader) && memcmp(data.data(), SNAPSHOT_MAGIC, RAFT_MAGIC_LENGTH) == 0) {
+		SnapshotHeader header;
+		memcpy(&header, data.data(), sizeof(SnapshotHeader));
+		if(data.size() - sizeof(SnapshotHeader) != header.length) return false;
+		snapshot = data.substr(sizeof(SnapshotHeader));
+		snapshotIndex = header.index;
+		snapshotTerm = header.term;
+		if(!machine->load(snapshot) || !machine->persist()) return false;
+	} else {
+		machine->save(&snapshot);
+		if(!writeSnapshot()) return false;
+	}
+	commitIndex = lastApplied = snapshotIndex;
+	if(!loadJournal()) return false;
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	for(string& peer : peers) {
+		if(peer.size() >= sizeof(addr.sun_path)) return false;
+	}
+	strcpy(addr.sun_path, peers[me].c_str());
+	listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(listener == -1) return false;
+	unlink(addr.sun_path);
+	if(bind(listener, (sockaddr*) &addr, sizeof(sockaddr_un)) != 0 || listen(listener, 16) != 0) return false;
+	if(pipe2(wake, O_NONBLOCK | O_CLOEXEC) != 0) return false;
+
+	outgoing.assign(peers.size(), {-1, {}, {}});
+	nextIndex.assign(peers.size(), lastIndex() + 1);
+	matchIndex.assign(peers.size(), 0);
+	lastSent.assign(peers.size(), chrono::steady_clock::time_point());
+	snapshotSent.assign(peers.size(), chrono::steady_clock::time_point());
+	resetElection();
+	worker = thread(&Replica::run, this);
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          stop()
+DESCRIPTION:       Stops the Replica's thread, failing every change a client is still waiting on
+RETURNS:           Void function
+NOTES:             A change which fails here might still be committed by the rest of the group
+----------------------------------------------------------------------------- */
+void Replica::stop() {
+	{
+		lock_guard<mutex> hold(lock);
+		if(stopping) return;
+		stopping = true;
+	}
+	if(worker.joinable()) {
+		char poke = 0;
+		if(write(wake[1], &poke, 1) < 0) {}
+		worker.join();
+	}
+
+	{
+		lock_guard<mutex> hold(lock);
+		for(Proposal* proposal : proposed) {
+			proposal->status = ERR_SERVER_ERR;
+			proposal->done = true;
+		}
+		for(pair<const unsigned long long, Proposal*>& entry : waiting) {
+			entry.second->status = ERR_SERVER_ERR;
+			entry.second->done = true;
+		}
+		proposed.clear();
+		waiting.clear();
+		answered.notify_all();
+	}
+
+	for(PeerLink& link : outgoing) closeLink(&link);
+	for(PeerLink& link : incoming) closeLink(&link);
+	if(listener != -1) {
+		close(listener);
+		unlink(peers[me].c_str());
+	}
+	if(wake[0] != -1) close(wake[0]);
+	if(wake[1] != -1) close(wake[1]);
+	if(journal != -1) close(journal);
+	listener = wake[0] = wake[1] = journal = -1;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          propose()
+DESCRIPTION:       Hands a change to the Replica's thread and waits until it has been committed and made
+RETURNS:           0 with the change's answer, ERR_NOT_LEADER if this server isn't the leader
+                   or stopped being it before the change was committed, or ERR_SERVER_ERR if it stopped
+----------------------------------------------------------------------------- */
+int Replica::propose(const string& op, string* result) {
+	if(role != RAFT_LEADER) return ERR_NOT_LEADER;
+	Proposal proposal = {op, 0, 0, false, 0, ""};
+	unique_lock<mutex> hold(lock);
+	if(stopping) return ERR_SERVER_ERR;
+	proposed.push_back(&proposal);
+	char poke = 0;
+	if(write(wake[1], &poke, 1) < 0) {}
+	answered.wait(hold, [&]() {
+		return proposal.done;
+	});
+	if(proposal.status == 0) result->swap(proposal.result);
+	return proposal.status;
+}
+
+unsigned long long Replica::firstChange() {
+	return snapshotIndex + 1;
+}
+
+unsigned long long Replica::lastChange() {
+	return lastApplied;
+}
+
+void Replica::change(unsigned long long index, unsigned long long* indexTerm, const string** op, const string** result) {
+	JournalEntry& entry = log[index - snapshotIndex - 1];
+	*indexTerm = entry.term;
+	*op = &entry.op;
+	*result = &entry.result;
+}
@@ -0,0 +1,270 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              raft.h
+
+DESCRIPTION:       Replicates the server's journal of changes between a group of servers with Raft.
+                   One server is elected leader, every change it is asked for goes into its journal,
+                   and a change is only made once most of the group has it in their journals on disk.
+                   Every server makes the same changes in the same order, so any of them can take over
+                   without losing anything which was answered. Servers which fall too far behind are
+                   sent a snapshot of the whole database instead of the changes they missed
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __RAFT_H__
+#define __RAFT_H__
+
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include "bankacct.h"
+#include "cdc.h"
+
+using namespace std;
+
+//Added to the database's file name for the files each server keeps
+#define JOURNAL_SUFFIX ".journal"
+#define SNAPSHOT_SUFFIX ".snapshot"
+#define TERM_SUFFIX ".term"
+
+#define JOURNAL_MAGIC "BANKJRN1"
+#define SNAPSHOT_MAGIC "BANKSNP1"
+#define TERM_MAGIC "BANKTRM1"
+#define RAFT_MAGIC_LENGTH 8
+
+//Start of every message between servers
+#define RAFT_MAGIC 0x54464152
+//Biggest message a server will take, which has to hold a whole snapshot
+#define RAFT_MAX_MESSAGE (1 << 28)
+
+//How long a follower waits to hear from a leader before standing for election, in milliseconds.
+//Each wait is picked at random from the spread, so two servers rarely stand at once
+#define RAFT_ELECTION_MIN 300
+#define RAFT_ELECTION_SPREAD 300
+//How often a leader lets its followers know it's still there
+#define RAFT_HEARTBEAT 50
+//How long a leader waits on a snapshot before sending it again
+#define RAFT_SNAPSHOT_RETRY 2000
+
+//Most changes sent in one message, and most sent to a follower before it has answered for them
+#define RAFT_BATCH 512
+#define RAFT_IN_FLIGHT 8192
+
+//Changes made before a snapshot is taken and the journal is cut short
+#define RAFT_SNAPSHOT_EVERY 10000
+
+//Messages
+#define RAFT_VOTE 1
+#define RAFT_VOTE_REPLY 2
+#define RAFT_APPEND 3
+#define RAFT_APPEND_REPLY 4
+#define RAFT_SNAPSHOT 5
+#define RAFT_SNAPSHOT_REPLY 6
+
+//What a server is doing in the group
+#define RAFT_FOLLOWER 0
+#define RAFT_CANDIDATE 1
+#define RAFT_LEADER 2
+
+//Every message has the same header, with each field meaning something different for each message
+struct RaftMessage {
+	unsigned int magic;
+	unsigned int type;
+	unsigned int from;
+	//Size of everything after the header
+	unsigned int length;
+	unsigned long long term;
+	//The last change in the voter's journal, the change before the ones sent, the last change
+	//in a snapshot, or in a reply, the last change the follower has in its journal
+	unsigned long long index;
+	unsigned long long indexTerm;
+	//How far the leader has committed
+	unsigned long long commit;
+	//How many changes follow
+	unsigned int count;
+	//Whether the vote was given or the changes were taken
+	unsigned int success;
+};
+
+//Each change in a message or the journal is one of these, followed by the change itself
+struct EntryHeader {
+	unsigned long long index;
+	unsigned long long term;
+	unsigned int length;
+	//Hash of the change, so a change which was only partly written can be told apart
+	unsigned int check;
+};
+
+struct SnapshotHeader {
+	char magic[RAFT_MAGIC_LENGTH];
+	unsigned long long index;
+	unsigned long long term;
+	unsigned long long length;
+};
+
+struct TermFile {
+	char magic[RAFT_MAGIC_LENGTH];
+	unsigned long long term;
+	int votedFor;
+};
+
+struct JournalEntry {
+	unsigned long long term;
+	//An empty change does nothing, which a new leader puts in to commit whatever came before it
+	string op;
+	//What making it gave back, once it's been made. It isn't written to the journal, since
+	//making the changes after the snapshot again gives back the same thing
+	string result;
+};
+
+/* -----------------------------------------------------------------------------
+CLASS:             ReplicatedState
+DESCRIPTION:       What a Replica keeps in step between the servers, which only the Replica's thread ever calls
+----------------------------------------------------------------------------- */
+class ReplicatedState {
+	public:
+		virtual ~ReplicatedState() {}
+
+		//Makes a committed change, giving back its answer
+		virtual void apply(const string&, string*) = 0;
+		//Writes out the whole state, and replaces it from what was written out without saving it to the database
+		virtual void save(string*) = 0;
+		virtual bool load(const string&) = 0;
+		//Saves the state to the database, once a snapshot of it is safe
+		virtual bool persist() = 0;
+};
+
+//A connection to another server in the group, which is never waited on
+struct PeerLink {
+	int fd;
+	vector<char> in;
+	vector<char> out;
+};
+
+//A change a client is waiting on
+struct Proposal {
+	string op;
+	unsigned long long index;
+	unsigned long long term;
+	bool done;
+	int status;
+	string result;
+};
+
+class Replica : public ChangeSource {
+	private:
+		string fileName;
+		unsigned int me;
+		vector<string> peers;
+		ReplicatedState* machine;
+		ChangeFeed* feed;
+
+		//Kept on disk
+		unsigned long long term;
+		int votedFor;
+		int journal;
+		off_t journalSize;
+		//Changes after the snapshot, and where each of them starts in the journal
+		vector<JournalEntry> log;
+		vector<off_t> offsets;
+		unsigned long long snapshotIndex;
+		unsigned long long snapshotTerm;
+		string snapshot;
+
+		atomic<int> role;
+		int leader;
+		unsigned long long commitIndex;
+		unsigned long long lastApplied;
+		unsigned int votes;
+		chrono::steady_clock::time_point electionDeadline;
+		minstd_rand random;
+
+		//What the leader knows about each follower
+		vector<unsigned long long> nextIndex;
+		vector<unsigned long long> matchIndex;
+		vector<chrono::steady_clock::time_point> lastSent;
+		vector<chrono::steady_clock::time_point> snapshotSent;
+
+		int listener;
+		int wake[2];
+		//Connections this server made to send to each other server, and connections the others made to it
+		vector<PeerLink> outgoing;
+		vector<PeerLink> incoming;
+		chrono::steady_clock::time_point lastConnect;
+
+		//Client threads hand changes over through here, and wait to be told how they went
+		mutex lock;
+		condition_variable answered;
+		vector<Proposal*> proposed;
+		map<unsigned long long, Proposal*> waiting;
+		atomic<bool> stopping;
+		thread worker;
+
+		unsigned long long lastIndex();
+		unsigned long long termAt(unsigned long long);
+		bool saveTerm();
+		bool loadJournal();
+		bool appendJournal(size_t);
+		bool truncateJournal(unsigned long long);
+		bool rewriteJournal();
+		bool writeSnapshot();
+		bool takeSnapshot();
+		bool installSnapshot(unsigned long long, unsigned long long, const char*, size_t);
+
+		void resetElection();
+		bool setTerm(unsigned long long);
+		bool becomeFollower(unsigned long long);
+		void startElection();
+		void becomeLeader();
+		void appendEntries(vector<JournalEntry>*);
+		void takeProposals();
+		void finish(Proposal*, int, const string&);
+
+		void queue(PeerLink*, RaftMessage*, const char*, size_t);
+		void sendAppends(unsigned int);
+		void sendSnapshot(unsigned int);
+		void handle(PeerLink*, RaftMessage*, const char*);
+		void handleVote(PeerLink*, RaftMessage*);
+		void handleVoteReply(RaftMessage*);
+		void handleAppend(PeerLink*, RaftMessage*, const char*);
+		void handleAppendReply(RaftMessage*);
+		void handleSnapshot(PeerLink*, RaftMessage*, const char*);
+		void advanceCommit();
+		void applyCommitted();
+
+		bool connectPeers();
+		bool readLink(PeerLink*);
+		bool flushLink(PeerLink*);
+		void closeLink(PeerLink*);
+		void tick();
+		void run();
+	public:
+		Replica(const char*, unsigned int, vector<const char*>*);
+		~Replica();
+		Replica(const Replica&) = delete;
+		Replica& operator=(const Replica&) = delete;
+
+		//Sends every change made to a feed, from the Replica's thread. Has to be given before it starts
+		void feedTo(ChangeFeed*);
+		//Picks up from the files on disk and joins the group
+		bool start(ReplicatedState*);
+		//Leaves the group, taking a snapshot of everything made so far
+		void stop();
+		//Waits until a change has been made by most of the group, giving back its answer
+		int propose(const string&, string*);
+
+		//The changes still in the journal, for the feed
+		unsigned long long firstChange();
+		unsigned long long lastChange();
+		void change(unsigned long long, unsigned long long*, const string**, const string**);
+};
+
+#endif
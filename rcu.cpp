@@ -0,0 +1,298 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              rcu.cpp
+	DESCRIPTION:       Account number index which readers search without taking any lock
+	COMPILER:          Built on g++ with c++11
+
+	A reader writes down the epoch before it loads the current version, and clears it when it's done.
+	A writer publishes the new version before moving the epoch on, so a reader which wrote down
+	the new epoch is sure to see the new version, and anything taken out before that epoch
+	can't be in its hands. Only opening and closing accounts publishes a new version;
+	changes to an open account are copied into its cell where it is, under the cell's seqlock.
+
+	Each partition only ever publishes versions of its own range, and the epoch is shared by all of them.
+	Its cells and versions come from memory bound to its node, so a reader on that node never
+	has to go to another node's memory to search it.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include "rcu.h"
+
+using namespace std;
+
+static bool keyBefore(const IndexEntry& entry, unsigned long long key) {
+	return entry.key < key;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          readCell()
+DESCRIPTION:       Copies an account out of its cell, trying again until no change happened during the copy
+RETURNS:           Void function
+NOTES:             The copy might be torn partway through, but then the count will have moved and it's thrown away
+----------------------------------------------------------------------------- */
+static void readCell(IndexCell* cell, Account* out) {
+	while(true) {
+		unsigned int before = cell->sequence.load(memory_order_acquire);
+		//The writer might have been put to sleep partway through, so let it finish
+		if(before & 1) {
+			this_thread::yield();
+			continue;
+		}
+		memcpy(out, &cell->acc, sizeof(Account));
+		atomic_thread_fence(memory_order_acquire);
+		if(cell->sequence.load(memory_order_relaxed) == before) return;
+	}
+}
+
+//Only one writer can be changing cells at a time
+static void writeCell(IndexCell* cell, Account* acc) {
+	unsigned int before = cell->sequence.load(memory_order_relaxed);
+	cell->sequence.store(before + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(&cell->acc, acc, sizeof(Account));
+	cell->sequence.store(before + 2, memory_order_release);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          AccountIndex()
+DESCRIPTION:       Builds the first version of the index out of every open account
+NOTES:             The database must already be sorted by account number.
+                   The open accounts are split evenly between the nodes, and anything
+                   opened later goes in the last range, since it has the biggest number
+----------------------------------------------------------------------------- */
+AccountIndex::AccountIndex(vector<Account>* people) : epoch(RCU_QUIET + 1) {
+	vector<Account*> open;
+	for(Account& acc : *people) {
+		if(!acc.closed) open.push_back(&acc);
+	}
+
+	unsigned int count = max(1u, min(numaNodes(), (unsigned int) open.size()));
+	for(unsigned int node = 0; node < count; node++) {
+		IndexPartition* partition = new IndexPartition;
+		size_t first = open.size() * node / count;
+		partition->low = node == 0 ? 0 : accountKey(open[first]->number);
+		partition->node = count == 1 ? NO_NODE : node;
+		partitions.push_back(unique_ptr<IndexPartition>(partition));
+	}
+	//Two ranges can't start at the same key, or the second would never be used
+	for(unsigned int node = 1; node < partitions.size(); node++) {
+		if(partitions[node]->low <= partitions[node - 1]->low) partitions[node]->low = partitions[node - 1]->low + 1;
+	}
+
+	vector<IndexVersion*> versions;
+	for(unique_ptr<IndexPartition>& partition : partitions) versions.push_back(new IndexVersion(partition->node));
+	size_t at = 0;
+	for(Account* acc : open) {
+		unsigned long long key = accountKey(acc->number);
+		while(at + 1 < partitions.size() && key >= partitions[at + 1]->low) at++;
+		versions[at]->entries.push_back({key, makeCell(partitions[at].get(), acc)});
+	}
+	for(size_t i = 0; i < partitions.size(); i++) partitions[i]->current.store(versions[i]);
+
+	for(ReaderSlot& reader : readers) {
+		reader.epoch.store(RCU_QUIET);
+		for(unsigned int& hits : reader.hits) hits = 0;
+	}
+}
+
+AccountIndex::~AccountIndex() {
+	//Nobody can be reading by now, and every cell is freed along with its chunk
+	for(Retired& old : retired) delete old.version;
+	for(unique_ptr<IndexPartition>& partition : partitions) {
+		delete partition->current.load();
+		for(IndexCell* chunk : partition->chunks) {
+			for(unsigned int i = 0; i < RCU_CELLS_PER_CHUNK; i++) chunk[i].~IndexCell();
+			nodeFree(chunk, RCU_CELLS_PER_CHUNK * sizeof(IndexCell), partition->node);
+		}
+	}
+}
+
+//There are only ever as many partitions as nodes, so looking through them is quick
+IndexPartition* AccountIndex::partitionFor(unsigned long long key) {
+	size_t at = 0;
+	while(at + 1 < partitions.size() && key >= partitions[at + 1]->low) at++;
+	return partitions[at].get();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          makeCell()
+DESCRIPTION:       Takes a spare cell from a partition's node and puts an account in it
+RETURNS:           The cell
+NOTES:             When there aren't any spare, a whole chunk of them is taken from the node at once
+----------------------------------------------------------------------------- */
+IndexCell* AccountIndex::makeCell(IndexPartition* partition, Account* acc) {
+	if(partition->spare.empty()) {
+		void* mem = nodeAlloc(RCU_CELLS_PER_CHUNK * sizeof(IndexCell), partition->node);
+		if(mem == nullptr) throw bad_alloc();
+		IndexCell* chunk = (IndexCell*) mem;
+		for(unsigned int i = RCU_CELLS_PER_CHUNK; i > 0; i--) partition->spare.push_back(new(&chunk[i - 1]) IndexCell);
+		partition->chunks.push_back(chunk);
+	}
+	IndexCell* cell = partition->spare.back();
+	partition->spare.pop_back();
+	cell->sequence.store(0);
+	cell->acc = *acc;
+	return cell;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          find()
+DESCRIPTION:       Copies out an open account by its number and password
+RETURNS:           Whether there was such an account
+NOTES:             Nothing is locked, not even the account's own cell
+----------------------------------------------------------------------------- */
+bool AccountIndex::find(unsigned int reader, const char* number, const char* password, Account* out) {
+	if(number == nullptr || password == nullptr || reader >= RCU_MAX_READERS) return false;
+	ReaderSlot& slot = readers[reader];
+	slot.epoch.store(epoch.load());
+
+	unsigned long long key = accountKey(number);
+	IndexPartition* partition = partitionFor(key);
+	if(partition->node != NO_NODE) slot.hits[partition->node]++;
+	IndexVersion* version = partition->current.load();
+	bool found = false;
+	auto it = lower_bound(version->entries.begin(), version->entries.end(), key, keyBefore);
+	for(; !found && it != version->entries.end() && it->key == key; it++) {
+		readCell(it->cell, out);
+		//A cell which was closed after this version was published is still here until the version is freed
+		found = !out->closed && !strcmp(out->password, password);
+	}
+
+	slot.epoch.store(RCU_QUIET, memory_order_release);
+	return found;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          homeNode()
+DESCRIPTION:       Works out which node a reader has been looking up the most accounts on
+RETURNS:           The node, or NO_NODE if it hasn't looked anything up on any node since last time
+NOTES:             The counts start over every time, so a reader which moves on to other accounts follows them
+----------------------------------------------------------------------------- */
+unsigned int AccountIndex::homeNode(unsigned int reader) {
+	if(reader >= RCU_MAX_READERS) return NO_NODE;
+	unsigned int* hits = readers[reader].hits;
+	unsigned int home = NO_NODE;
+	for(unsigned int node = 0; node < NUMA_MAX_NODES; node++) {
+		if(hits[node] > 0 && (home == NO_NODE || hits[node] > hits[home])) home = node;
+	}
+	for(unsigned int node = 0; node < NUMA_MAX_NODES; node++) hits[node] = 0;
+	return home;
+}
+
+//Writers are the only ones who change anything, so they can look at the current version without any care
+IndexCell* AccountIndex::locate(IndexVersion* version, const char* number, const char* password) {
+	unsigned long long key = accountKey(number);
+	auto it = lower_bound(version->entries.begin(), version->entries.end(), key, keyBefore);
+	for(; it != version->entries.end() && it->key == key; it++) {
+		if(!strcmp(it->cell->acc.password, password)) return it->cell;
+	}
+	return nullptr;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          insert()
+DESCRIPTION:       Publishes a version of the index with a newly opened account in it
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void AccountIndex::insert(Account* acc) {
+	unsigned long long key = accountKey(acc->number);
+	IndexPartition* partition = partitionFor(key);
+	IndexVersion* version = new IndexVersion(*partition->current.load());
+	IndexCell* cell = makeCell(partition, acc);
+	auto it = upper_bound(version->entries.begin(), version->entries.end(), key, [](unsigned long long key, const IndexEntry& entry) {
+		return key < entry.key;
+	});
+	version->entries.insert(it, {key, cell});
+	publish(partition, version, nullptr);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          update()
+DESCRIPTION:       Copies a changed account into its cell, finding it by the password it had before the change
+RETURNS:           Void function
+NOTES:             A closed account is taken out of the index with a new version
+----------------------------------------------------------------------------- */
+void AccountIndex::update(const char* password, Account* acc) {
+	IndexPartition* partition = partitionFor(accountKey(acc->number));
+	IndexVersion* version = partition->current.load();
+	IndexCell* cell = locate(version, acc->number, password);
+	if(cell == nullptr) {
+		if(!acc->closed) insert(acc);
+		return;
+	}
+
+	writeCell(cell, acc);
+	if(!acc->closed) return;
+
+	IndexVersion* without = new IndexVersion(partition->node);
+	without->entries.reserve(version->entries.size() - 1);
+	for(IndexEntry& entry : version->entries) {
+		if(entry.cell != cell) without->entries.push_back(entry);
+	}
+	publish(partition, without, cell);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          rebuild()
+DESCRIPTION:       Publishes a version of every partition with the open accounts from a new database in it
+RETURNS:           Void function
+NOTES:             The ranges stay where they are. Every cell of the old versions is retired along with them,
+                   all in the same epoch, since readers could still be copying out of any of them
+----------------------------------------------------------------------------- */
+void AccountIndex::rebuild(vector<Account>* people) {
+	vector<IndexVersion*> versions;
+	for(unique_ptr<IndexPartition>& partition : partitions) versions.push_back(new IndexVersion(partition->node));
+	size_t at = 0;
+	for(Account& acc : *people) {
+		if(acc.closed) continue;
+		unsigned long long key = accountKey(acc.number);
+		while(at + 1 < partitions.size() && key >= partitions[at + 1]->low) at++;
+		versions[at]->entries.push_back({key, makeCell(partitions[at].get(), &acc)});
+	}
+
+	for(size_t i = 0; i < partitions.size(); i++) {
+		IndexPartition* partition = partitions[i].get();
+		IndexVersion* old = partition->current.exchange(versions[i]);
+		unsigned long long retiredIn = epoch.fetch_add(1);
+		retired.push_back({retiredIn, partition, old, nullptr});
+		for(IndexEntry& entry : old->entries) retired.push_back({retiredIn, partition, nullptr, entry.cell});
+	}
+	reclaim();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          publish()
+DESCRIPTION:       Swaps in a new version of a partition, and retires the old one along with a cell which was taken out
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void AccountIndex::publish(IndexPartition* partition, IndexVersion* version, IndexCell* cell) {
+	IndexVersion* old = partition->current.exchange(version);
+	retired.push_back({epoch.fetch_add(1), partition, old, cell});
+	reclaim();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          reclaim()
+DESCRIPTION:       Frees everything retired before the oldest epoch a reader is still searching in
+RETURNS:           Void function
+NOTES:             A reader stuck in an old epoch only holds up what was retired since then.
+                   Cells go back to their partition to be used again
+----------------------------------------------------------------------------- */
+void AccountIndex::reclaim() {
+	unsigned long long oldest = epoch.load();
+	for(ReaderSlot& reader : readers) {
+		unsigned long long seen = reader.epoch.load();
+		if(seen != RCU_QUIET) oldest = min(oldest, seen);
+	}
+
+	vector<Retired>::iterator keep = partition(retired.begin(), retired.end(), [&](const Retired& old) {
+		return old.epoch >= oldest;
+	});
+	for(vector<Retired>::iterator it = keep; it != retired.end(); it++) {
+		delete it->version;
+		if(it->cell != nullptr) it->partition->spare.push_back(it->cell);
+	}
+	retired.erase(keep, retired.end());
+}
@@ -0,0 +1,110 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              rcu.h
+
+DESCRIPTION:       Account number index which readers search without taking any lock.
+                   Writers never change a version of the index which has been published,
+                   they copy it and publish the copy, and old versions are freed once every
+                   reader which could still be looking at them has finished (read-copy-update).
+                   The index is split into account number ranges, one for each NUMA node,
+                   and each range keeps its accounts in memory on its own node
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __RCU_H__
+#define __RCU_H__
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "bankacct.h"
+#include "numa.h"
+
+using namespace std;
+
+//Most readers which can be searching the index at once
+#define RCU_MAX_READERS 64
+
+//Epoch a reader which isn't searching the index has
+#define RCU_QUIET 0
+
+//How many cells a partition gets from its node at a time
+#define RCU_CELLS_PER_CHUNK 1024
+
+//One open account. Cells stay where they are for as long as any version of the index points at them
+struct IndexCell {
+	//Odd while the account is being changed. Readers copy the account without locking anything,
+	//and copy it again if the count was odd or moved while they were copying (a seqlock)
+	atomic<unsigned int> sequence;
+	Account acc;
+};
+
+struct IndexEntry {
+	unsigned long long key;
+	IndexCell* cell;
+};
+
+//Sorted by key, and never changed once it has been published
+struct IndexVersion {
+	vector<IndexEntry, NodeAllocator<IndexEntry>> entries;
+
+	IndexVersion(unsigned int node) : entries(NodeAllocator<IndexEntry>(node)) {}
+};
+
+//One range of account numbers, and everything for it which lives on its node
+struct IndexPartition {
+	//Smallest key which goes in this partition
+	unsigned long long low;
+	unsigned int node;
+	atomic<IndexVersion*> current;
+	//Cells which aren't in use, and the chunks all of the cells came from
+	vector<IndexCell*> spare;
+	vector<IndexCell*> chunks;
+};
+
+//Something which was taken out of the index, and the epoch it was taken out in
+struct Retired {
+	unsigned long long epoch;
+	IndexPartition* partition;
+	IndexVersion* version;
+	IndexCell* cell;
+};
+
+class AccountIndex {
+	private:
+		vector<unique_ptr<IndexPartition>> partitions;
+		//Goes up every time a version is published
+		atomic<unsigned long long> epoch;
+		//The epoch each reader started searching in, on separate cache lines so readers don't slow each other down.
+		//Each reader also counts how many of its lookups went to each node, which only it touches
+		struct alignas(64) ReaderSlot {
+			atomic<unsigned long long> epoch;
+			unsigned int hits[NUMA_MAX_NODES];
+		} readers[RCU_MAX_READERS];
+		vector<Retired> retired;
+
+		IndexPartition* partitionFor(unsigned long long);
+		IndexCell* makeCell(IndexPartition*, Account*);
+		IndexCell* locate(IndexVersion*, const char*, const char*);
+		void publish(IndexPartition*, IndexVersion*, IndexCell*);
+		void reclaim();
+	public:
+		AccountIndex(vector<Account>*);
+		~AccountIndex();
+		AccountIndex(const AccountIndex&) = delete;
+		AccountIndex& operator=(const AccountIndex&) = delete;
+
+		//Readers, which each need their own reader number below RCU_MAX_READERS
+		bool find(unsigned int, const char*, const char*, Account*);
+		unsigned int homeNode(unsigned int);
+
+		//Writers, which have to take turns with each other
+		void insert(Account*);
+		void update(const char*, Account*);
+		//Publishes a whole new set of open accounts, for when the database was replaced
+		void rebuild(vector<Account>*);
+};
+
+#endif
@@ -0,0 +1,182 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              ring.cpp
+	DESCRIPTION:       Moves frames through shared memory rings instead of a socket
+	COMPILER:          Built on g++ with c++11
+
+	Each ring only ever has one side writing and the other reading, so head and tail are
+	the only things which need to be shared, and neither side ever takes a lock.
+	A side with nothing to do spins for a little while, then sets its waiter flag and
+	sleeps on a futex until the other side moves head or tail and wakes it up.
+	Sleeps time out now and then to check the socket the channel was set up over,
+	so a client which dies doesn't leave the server waiting forever.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "ring.h"
+
+using namespace std;
+
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "The ring size has to be a power of two");
+static_assert(sizeof(atomic<unsigned int>) == sizeof(unsigned int) && ATOMIC_INT_LOCK_FREE == 2, "Futexes need plain lock free words");
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          futexWait()
+DESCRIPTION:       Sleeps until the word is woken up, as long as it still holds what was expected
+RETURNS:           Whether the sleep timed out
+----------------------------------------------------------------------------- */
+static bool futexWait(atomic<unsigned int>* word, unsigned int expected) {
+	timespec timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = RING_WAIT_MS * 1000000L;
+	return syscall(SYS_futex, (unsigned int*) word, FUTEX_WAIT, expected, &timeout, nullptr, 0) == -1 && errno == ETIMEDOUT;
+}
+
+static void futexWake(atomic<unsigned int>* word) {
+	syscall(SYS_futex, (unsigned int*) word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static bool stillThere(int fd) {
+	char c;
+	ssize_t got = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return got > 0 || (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          waitFor()
+DESCRIPTION:       Waits until ready() says yes to the value of a ring's head or tail
+RETURNS:           Whether it did, which is false if the other side went away first
+NOTES:             The waiter flag is set before the word is checked one last time, and the other side
+                   moves the word before checking the flag, so a wakeup can't fall in between
+----------------------------------------------------------------------------- */
+static bool waitFor(atomic<unsigned int>* word, atomic<unsigned int>* waiter, int liveFd, function<bool(unsigned int)> ready) {
+	//With only one processor, the other side can't get anything done while this one spins
+	static const unsigned int maxSpins = thread::hardware_concurrency() > 1 ? RING_SPINS : 0;
+	for(unsigned int spins = 0; ; spins++) {
+		if(ready(word->load())) return true;
+		if(spins < maxSpins) continue;
+
+		waiter->store(1);
+		unsigned int seen = word->load();
+		if(ready(seen)) return true;
+		if(futexWait(word, seen) && !stillThere(liveFd)) return ready(word->load());
+	}
+}
+
+RingTransport::RingTransport(SharedChannel* a, bool server, int b) : channel(a), liveFd(b) {
+	in = server ? &channel->requests : &channel->answers;
+	out = server ? &channel->answers : &channel->requests;
+}
+
+RingTransport::~RingTransport() {
+	munmap(channel, sizeof(SharedChannel));
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          read()
+DESCRIPTION:       Takes bytes out of the incoming ring, waiting for the other side if there aren't enough yet
+RETURNS:           Whether every byte was read
+----------------------------------------------------------------------------- */
+bool RingTransport::read(void* buf, size_t size) {
+	char* at = (char*) buf;
+	while(size > 0) {
+		unsigned int tail = in->tail.load(memory_order_relaxed);
+		unsigned int head;
+		if(!waitFor(&in->head, &in->dataWaiter, liveFd, [&](unsigned int seen) {
+			head = seen;
+			return seen != tail;
+		})) return false;
+
+		size_t chunk = min(size, min((size_t) (head - tail), (size_t) (RING_SIZE - tail % RING_SIZE)));
+		memcpy(at, in->data + tail % RING_SIZE, chunk);
+		in->tail.store(tail + chunk);
+		if(in->spaceWaiter.exchange(0)) futexWake(&in->tail);
+		at += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          write()
+DESCRIPTION:       Puts bytes into the outgoing ring, waiting for the other side to make room if it's full
+RETURNS:           Whether every byte was written
+----------------------------------------------------------------------------- */
+bool RingTransport::write(const void* buf, size_t size) {
+	const char* at = (const char*) buf;
+	while(size > 0) {
+		unsigned int head = out->head.load(memory_order_relaxed);
+		unsigned int tail;
+		if(!waitFor(&out->tail, &out->spaceWaiter, liveFd, [&](unsigned int seen) {
+			tail = seen;
+			return head - seen < RING_SIZE;
+		})) return false;
+
+		size_t chunk = min(size, min((size_t) (RING_SIZE - (head - tail)), (size_t) (RING_SIZE - head % RING_SIZE)));
+		memcpy(out->data + head % RING_SIZE, at, chunk);
+		out->head.store(head + chunk);
+		if(out->dataWaiter.exchange(0)) futexWake(&out->head);
+		at += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          createChannel()
+DESCRIPTION:       Makes a new shared memory channel with a name no other channel is using
+RETURNS:           The mapped channel, or nullptr if it couldn't be made
+NOTES:             The name is handed back so it can be sent to the server, and should be
+                   unlinked once the server has it open
+----------------------------------------------------------------------------- */
+SharedChannel* createChannel(string* name) {
+	static atomic<unsigned int> made(0);
+	*name = "/bankacct." + to_string(getpid()) + "." + to_string(made++);
+
+	int fd = shm_open(name->c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd == -1) return nullptr;
+	void* mem = MAP_FAILED;
+	if(ftruncate(fd, sizeof(SharedChannel)) == 0) mem = mmap(nullptr, sizeof(SharedChannel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mem == MAP_FAILED) {
+		shm_unlink(name->c_str());
+		return nullptr;
+	}
+
+	//The new memory is all zeroes, which is an empty ring with nobody waiting
+	SharedChannel* channel = (SharedChannel*) mem;
+	channel->magic = RING_MAGIC;
+	return channel;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          openChannel()
+DESCRIPTION:       Maps a channel which a client made
+RETURNS:           The mapped channel, or nullptr if there isn't a channel by that name
+----------------------------------------------------------------------------- */
+SharedChannel* openChannel(const char* name) {
+	int fd = shm_open(name, O_RDWR, 0);
+	if(fd == -1) return nullptr;
+	struct stat info;
+	void* mem = MAP_FAILED;
+	if(fstat(fd, &info) == 0 && (size_t) info.st_size == sizeof(SharedChannel)) mem = mmap(nullptr, sizeof(SharedChannel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mem == MAP_FAILED) return nullptr;
+
+	SharedChannel* channel = (SharedChannel*) mem;
+	if(channel->magic == RING_MAGIC) return channel;
+	munmap(mem, sizeof(SharedChannel));
+	return nullptr;
+}
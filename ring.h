@@ -0,0 +1,64 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              ring.h
+
+DESCRIPTION:       Shared memory transport for clients on the same machine as the server.
+                   Each client gets its own channel, which is a pair of single producer,
+                   single consumer ring buffers with futex wakeups
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <atomic>
+#include <string>
+#include "wire.h"
+
+#define RING_MAGIC 0x474E4952
+//Bytes in each ring, which has to be a power of two
+#define RING_SIZE (1 << 20)
+//How many times to check a ring before going to sleep on it
+#define RING_SPINS 2000
+//How long to sleep before checking whether the other side is still there, in milliseconds
+#define RING_WAIT_MS 100
+
+//Bytes only ever go in at head and out at tail, which both just count up and wrap around
+struct Ring {
+	atomic<unsigned int> head;
+	atomic<unsigned int> tail;
+	//Set by a side which is asleep on head (waiting for data) or tail (waiting for space)
+	atomic<unsigned int> dataWaiter;
+	atomic<unsigned int> spaceWaiter;
+	char data[RING_SIZE];
+};
+
+struct SharedChannel {
+	unsigned int magic;
+	//Client to server
+	Ring requests;
+	//Server to client
+	Ring answers;
+};
+
+class RingTransport : public Transport {
+	private:
+		SharedChannel* channel;
+		Ring* in;
+		Ring* out;
+		//The socket the channel was set up over, which is watched to tell if the other side went away
+		int liveFd;
+	public:
+		RingTransport(SharedChannel*, bool, int);
+		~RingTransport();
+
+		bool read(void*, size_t);
+		bool write(const void*, size_t);
+};
+
+SharedChannel* createChannel(string*);
+SharedChannel* openChannel(const char*);
+
+#endif
@@ -0,0 +1,176 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              schedule.cpp
+	DESCRIPTION:       Runs a batch on many threads with exactly the same result as running it in order
+	COMPILER:          Built on g++ with c++11
+
+	Before anything runs, the batch is turned into a conflict graph: every change waits on the last
+	change before it to each account it touches, which is at most two. A change is ready once everything
+	it waits on is done, so the changes to any one account are made in batch order, and each change sees
+	its accounts exactly as it would have if the batch had been run in order.
+
+	Running in order stops at the first change which fails. Changes after it might already have been made
+	by then, since they didn't wait on it, so each change keeps a copy of its accounts from before it ran.
+	Once everything has stopped, the changes after the first failure are undone from the last one backwards,
+	leaving every account the way running in order would have left it.
+----------------------------------------------------------------------------- */
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include "schedule.h"
+
+using namespace std;
+
+//Index of a change which hasn't failed
+#define NO_FAILURE ((size_t) -1)
+
+struct ScheduledOp {
+	//Changes waiting on this one, and how many changes this one is still waiting on
+	vector<size_t> next;
+	atomic<unsigned int> waiting;
+	bool ran;
+	//The accounts from before the change ran, to undo it with
+	Account before[2];
+};
+
+struct Schedule {
+	vector<BatchOp>* batch;
+	vector<ScheduledOp> ops;
+	vector<int> status;
+	atomic<size_t> firstFailed;
+
+	mutex lock;
+	condition_variable wake;
+	deque<size_t> ready;
+	size_t done;
+};
+
+//The accounts a change touches, without the same one twice
+static unsigned int touched(BatchOp* op, Account** accounts) {
+	unsigned int count = 0;
+	if(op->acc != nullptr) accounts[count++] = op->acc;
+	if(op->to != nullptr && op->to != op->acc) accounts[count++] = op->to;
+	return count;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          buildGraph()
+DESCRIPTION:       Makes every change wait on the last change before it to each of its accounts
+RETURNS:           Void function
+NOTES:             A change which doesn't touch any account that was found waits on nothing, and fails straight away
+----------------------------------------------------------------------------- */
+static void buildGraph(Schedule* schedule) {
+	vector<BatchOp>& batch = *schedule->batch;
+	unordered_map<Account*, size_t> last;
+	for(size_t i = 0; i < batch.size(); i++) {
+		Account* accounts[2];
+		unsigned int count = touched(&batch[i], accounts);
+		unsigned int waiting = 0;
+		size_t before = NO_FAILURE;
+		for(unsigned int a = 0; a < count; a++) {
+			unordered_map<Account*, size_t>::iterator it = last.find(accounts[a]);
+			//Both accounts might last have been changed by the same change
+			if(it != last.end() && it->second != before) {
+				schedule->ops[it->second].next.push_back(i);
+				before = it->second;
+				waiting++;
+			}
+			last[accounts[a]] = i;
+		}
+		schedule->ops[i].waiting = waiting;
+		schedule->ops[i].ran = false;
+		if(waiting == 0) schedule->ready.push_back(i);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runOp()
+DESCRIPTION:       Makes one change, keeping copies of its accounts first
+RETURNS:           Void function
+NOTES:             A change after one which has already failed would only be undone, so it isn't made at all
+----------------------------------------------------------------------------- */
+static void runOp(Schedule* schedule, size_t i) {
+	if(i > schedule->firstFailed.load()) return;
+	BatchOp* op = &(*schedule->batch)[i];
+	ScheduledOp& scheduled = schedule->ops[i];
+	Account* accounts[2];
+	unsigned int count = touched(op, accounts);
+	for(unsigned int a = 0; a < count; a++) scheduled.before[a] = *accounts[a];
+	scheduled.ran = true;
+
+	int err = runBatchOp(op);
+	if(err == 0) return;
+	schedule->status[i] = err;
+	size_t failed = schedule->firstFailed.load();
+	while(i < failed && !schedule->firstFailed.compare_exchange_weak(failed, i)) {}
+}
+
+//Takes ready changes until every change is done, letting go of whatever waited on each one
+static void runWorker(Schedule* schedule) {
+	vector<size_t> freed;
+	unique_lock<mutex> hold(schedule->lock);
+	while(true) {
+		schedule->wake.wait(hold, [&]() {
+			return !schedule->ready.empty() || schedule->done == schedule->ops.size();
+		});
+		if(schedule->ready.empty()) return;
+		size_t i = schedule->ready.front();
+		schedule->ready.pop_front();
+		hold.unlock();
+
+		runOp(schedule, i);
+		freed.clear();
+		for(size_t next : schedule->ops[i].next) {
+			if(--schedule->ops[next].waiting == 0) freed.push_back(next);
+		}
+
+		hold.lock();
+		schedule->done++;
+		schedule->ready.insert(schedule->ready.end(), freed.begin(), freed.end());
+		if(schedule->done == schedule->ops.size() || freed.size() > 1) schedule->wake.notify_all();
+		else if(!freed.empty()) schedule->wake.notify_one();
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runScheduledBatch()
+DESCRIPTION:       Looks up every account in a batch at once, then makes the changes on many threads
+RETURNS:           0, or the error code of the first change which couldn't be made
+NOTES:             Exactly the same as runBatch(), changes before the one which failed being kept and none after it.
+                   Asking for 0 threads uses every core, and a small batch or a single thread just runs in order
+----------------------------------------------------------------------------- */
+int runScheduledBatch(vector<Account>* people, vector<BatchOp>* batch, unsigned int threads) {
+	if(threads == 0) threads = thread::hardware_concurrency();
+	threads = min(threads, (unsigned int) SCHEDULE_MAX_THREADS);
+	if(threads <= 1 || batch->size() < SCHEDULE_MIN_BATCH) return runBatch(people, batch);
+	findBatchAccounts(people, batch);
+
+	Schedule schedule;
+	schedule.batch = batch;
+	schedule.ops = vector<ScheduledOp>(batch->size());
+	schedule.status.assign(batch->size(), 0);
+	schedule.firstFailed = NO_FAILURE;
+	schedule.done = 0;
+	buildGraph(&schedule);
+
+	vector<thread> workers;
+	for(unsigned int i = 1; i < threads; i++) workers.push_back(thread(runWorker, &schedule));
+	runWorker(&schedule);
+	for(thread& worker : workers) worker.join();
+
+	size_t failed = schedule.firstFailed.load();
+	if(failed == NO_FAILURE) return 0;
+	//Undone from the last change backwards, so each account ends up as it was before the first change after the failure
+	for(size_t i = batch->size() - 1; i > failed; i--) {
+		if(!schedule.ops[i].ran) continue;
+		Account* accounts[2];
+		unsigned int count = touched(&(*batch)[i], accounts);
+		for(unsigned int a = 0; a < count; a++) *accounts[a] = schedule.ops[i].before[a];
+	}
+	return schedule.status[failed];
+}
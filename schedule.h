@@ -0,0 +1,27 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              schedule.h
+
+DESCRIPTION:       Runs a batch on many threads with exactly the same result as running it in order.
+                   Every change waits for the changes before it to the same accounts, and any
+                   changes which don't share an account run at the same time
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __SCHEDULE_H__
+#define __SCHEDULE_H__
+
+#include <vector>
+#include "bankacct.h"
+
+//Most threads a batch is run on
+#define SCHEDULE_MAX_THREADS 256
+
+//Batches smaller than this aren't worth starting threads for
+#define SCHEDULE_MIN_BATCH 64
+
+int runScheduledBatch(vector<Account>*, vector<BatchOp>*, unsigned int);
+
+#endif
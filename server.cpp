@@ -0,0 +1,496 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              server.cpp
+	DESCRIPTION:       Serves the database over a Unix socket, with a thread for each client
+	COMPILER:          Built on g++ with c++11
+
+	A client can send as many frames as it likes before reading any answers (pipelining),
+	and each frame can hold many operations (batching). Every frame's changes are handed to the
+	storage engine and committed before its answer is sent, so an answer means the changes are safe.
+
+	A client on the same machine can ask to move onto a shared memory channel, after which
+	its frames go through the channel's rings instead of the socket.
+
+	Only one client changes the database at a time. Lookups don't wait for them, they go through
+	an AccountIndex, which always has a complete version of the open accounts for them to search.
+	On a machine with more than one NUMA node, each client's thread follows the accounts it
+	looks up onto the node which keeps them.
+
+	A server can also be one of a group replicated with a Replica. Then a change isn't made
+	by the client's thread, it's handed to the Replica as the same bytes it came in as, and
+	every server in the group makes it once it's committed. Only the leader takes changes,
+	the others answer them with ERR_NOT_LEADER, and any of them can be asked to look accounts
+	up, which a follower answers from what it has made so far. The journal is what keeps the
+	changes safe, so frames aren't saved to the database one at a time.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+#include "wire.h"
+#include "ring.h"
+#include "rcu.h"
+#include "raft.h"
+
+using namespace std;
+
+struct ClientSlot {
+	thread worker;
+	int fd;
+	bool busy;
+};
+
+//Everything the client threads share
+struct ServerState {
+	vector<Account>* people;
+	Storage* storage;
+	//Held by anything which changes the database or hands it to the storage engine
+	mutex writer;
+	//Lookups go through here instead, without taking the writer lock
+	AccountIndex* index;
+	int listener;
+	atomic<bool> stop;
+	//Set if a change couldn't be saved
+	atomic<bool> failed;
+	//Each client's reader number in the index is its place in here
+	mutex clientsLock;
+	ClientSlot clients[RCU_MAX_READERS];
+	//Takes every change if the server is one of a replicated group, otherwise nullptr
+	Replica* replica;
+};
+
+//What running a frame asked of the server, beyond its answer
+struct FrameEffects {
+	//Whether anything might have changed, so the frame needs to be committed
+	bool changed;
+	//Whether the server should stop
+	bool stop;
+	//A shared memory channel to move the connection onto
+	SharedChannel* attach;
+};
+
+static void addResult(vector<char>* out, int status, Account* acc) {
+	ResultHeader result;
+	result.status = status;
+	result.found = acc != nullptr;
+	out->insert(out->end(), (char*) &result, (char*) &result + sizeof(ResultHeader));
+	if(acc == nullptr) return;
+	Record rec;
+	toRecord(acc, &rec);
+	out->insert(out->end(), (char*) &rec, (char*) &rec + sizeof(Record));
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          readOp()
+DESCRIPTION:       Reads one operation and its fields, moving on past them
+RETURNS:           Whether there was a whole operation there
+----------------------------------------------------------------------------- */
+static bool readOp(const char* data, size_t size, size_t* at, OpHeader* op, vector<string>* fields) {
+	if(size - *at < sizeof(OpHeader)) return false;
+	memcpy(op, data + *at, sizeof(OpHeader));
+	*at += sizeof(OpHeader);
+
+	fields->clear();
+	for(unsigned int j = 0; j < op->fields; j++) {
+		unsigned short length;
+		if(size - *at < sizeof(length)) return false;
+		memcpy(&length, data + *at, sizeof(length));
+		*at += sizeof(length);
+		if(size - *at < length) return false;
+		fields->push_back(string(data + *at, length));
+		*at += length;
+	}
+	return true;
+}
+
+//The other way around from readOp(), which is how a change is put in the journal
+static void writeOp(OpHeader* op, vector<string>* fields, string* out) {
+	out->append((char*) op, sizeof(OpHeader));
+	for(string& field : *fields) {
+		unsigned short length = field.size();
+		out->append((char*) &length, sizeof(length));
+		out->append(field);
+	}
+}
+
+//Points a batch change at the fields of an OP_CHANGE, checking that it makes sense
+static bool makeChange(OpHeader* header, vector<string>* fields, BatchOp* op) {
+	vector<string>& f = *fields;
+	if(f.size() != 3 && f.size() != 5) return false;
+	op->number = &f[0][0];
+	op->password = &f[1][0];
+	op->change = header->change;
+	op->value = &f[2][0];
+	op->toNumber = f.size() == 5 ? &f[3][0] : nullptr;
+	op->toPassword = f.size() == 5 ? &f[4][0] : nullptr;
+	return validBatchOp(op);
+}
+
+static bool validCreate(vector<string>* fields) {
+	return fields->size() == 1 && validValue(O_CREATE, &(*fields)[0][0]);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          changeOp()
+DESCRIPTION:       Makes an OP_CHANGE or OP_CREATE, adding its result to the answer
+RETURNS:           Whether the operation was well formed
+----------------------------------------------------------------------------- */
+static bool changeOp(ServerState* state, OpHeader* header, vector<string>* fields, vector<char>* out) {
+	vector<Account>* people = state->people;
+	if(header->op == OP_CHANGE) {
+		BatchOp op;
+		if(!makeChange(header, fields, &op)) return false;
+		lock_guard<mutex> hold(state->writer);
+		op.acc = findAccount(people, op.number, op.password);
+		op.to = op.toNumber == nullptr ? nullptr : findAccount(people, op.toNumber, op.toPassword);
+		int status = runBatchOp(&op);
+		if(status == 0) {
+			//Found by the passwords the accounts had before the change, which might have been a new password
+			state->index->update(op.password, op.acc);
+			if(op.to != nullptr) state->index->update(op.toPassword, op.to);
+		}
+		addResult(out, status, status == 0 && !op.acc->closed ? op.acc : nullptr);
+		return true;
+	}
+
+	if(header->op != OP_CREATE || !validCreate(fields)) return false;
+	lock_guard<mutex> hold(state->writer);
+	Account* acc;
+	int status = createAccount(people, &(*fields)[0][0], &acc);
+	if(status == ERR_NO_INFO) return false;
+	if(status == 0) state->index->insert(acc);
+	addResult(out, status, status == 0 ? acc : nullptr);
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          proposeOp()
+DESCRIPTION:       Hands a change to the Replica, and adds the result it got on being made to the answer
+RETURNS:           Whether the operation was well formed
+NOTES:             Anything which couldn't be made anyway is turned down before it gets into the journal
+----------------------------------------------------------------------------- */
+static bool proposeOp(ServerState* state, OpHeader* header, vector<string>* fields, vector<char>* out) {
+	BatchOp check;
+	if(header->op == OP_CHANGE ? !makeChange(header, fields, &check) : !validCreate(fields)) return false;
+	string op, result;
+	writeOp(header, fields, &op);
+	int status = state->replica->propose(op, &result);
+	if(status != 0) addResult(out, status, nullptr);
+	else out->insert(out->end(), result.begin(), result.end());
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runOp()
+DESCRIPTION:       Runs a single operation from a frame, adding its result to the answer
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+static void runOp(ServerState* state, unsigned int reader, OpHeader* header, vector<string>* fields, vector<char>* out, FrameEffects* effects) {
+	vector<string>& f = *fields;
+	Account copy;
+
+	switch(header->op) {
+		case OP_GET:
+			if(f.size() != 2) break;
+			if(state->index->find(reader, f[0].c_str(), f[1].c_str(), &copy)) addResult(out, 0, &copy);
+			else addResult(out, ERR_NO_ACCOUNT, nullptr);
+			return;
+		case OP_CHANGE:
+		case OP_CREATE:
+			if(state->replica != nullptr) {
+				if(proposeOp(state, header, fields, out)) return;
+				break;
+			}
+			effects->changed = true;
+			if(changeOp(state, header, fields, out)) return;
+			break;
+		case OP_SHUTDOWN:
+			effects->stop = true;
+			addResult(out, 0, nullptr);
+			return;
+		case OP_ATTACH:
+			if(f.size() != 1 || effects->attach != nullptr) break;
+			effects->attach = openChannel(f[0].c_str());
+			if(effects->attach == nullptr) break;
+			addResult(out, 0, nullptr);
+			return;
+	}
+	addResult(out, ERR_NO_INFO, nullptr);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runFrame()
+DESCRIPTION:       Splits a frame's body into operations and runs each of them
+RETURNS:           Whether the body was well formed
+----------------------------------------------------------------------------- */
+static bool runFrame(ServerState* state, unsigned int reader, FrameHeader* header, vector<char>* body, vector<char>* out, FrameEffects* effects) {
+	size_t at = 0;
+	for(unsigned int i = 0; i < header->count; i++) {
+		OpHeader op;
+		vector<string> fields;
+		if(!readOp(body->data(), body->size(), &at, &op, &fields)) return false;
+		runOp(state, reader, &op, &fields, out, effects);
+	}
+	return at == body->size();
+}
+
+//Whether two accounts would be stored the same
+static bool sameAccount(Account* a, Account* b) {
+	Record first, second;
+	toRecord(a, &first);
+	toRecord(b, &second);
+	return memcmp(&first, &second, sizeof(Record)) == 0;
+}
+
+/* -----------------------------------------------------------------------------
+CLASS:             ServerMachine
+DESCRIPTION:       The server's database, as the Replica sees it
+NOTES:             A snapshot is every account in order, closed ones included, since they decide the next account number
+----------------------------------------------------------------------------- */
+class ServerMachine : public ReplicatedState {
+	private:
+		ServerState* state;
+		//Stored accounts a snapshot was loaded over, to be taken out of the storage engine by persist()
+		vector<Account> dropped;
+	public:
+		ServerMachine(ServerState* a) : state(a) {}
+
+		void apply(const string& op, string* result) {
+			OpHeader header;
+			vector<string> fields;
+			vector<char> out;
+			size_t at = 0;
+			if(!readOp(op.data(), op.size(), &at, &header, &fields) || !changeOp(state, &header, &fields, &out)) {
+				out.clear();
+				addResult(&out, ERR_NO_INFO, nullptr);
+			}
+			result->assign(out.begin(), out.end());
+		}
+
+		void save(string* out) {
+			lock_guard<mutex> hold(state->writer);
+			out->clear();
+			out->reserve(state->people->size() * (sizeof(Record) + 1));
+			for(Account& acc : *state->people) {
+				Record rec;
+				toRecord(&acc, &rec);
+				out->append((char*) &rec, sizeof(Record));
+				out->push_back(acc.closed);
+			}
+		}
+
+		/* -----------------------------------------------------------------------------
+		FUNCTION:          load()
+		DESCRIPTION:       Replaces the database with a snapshot, leaving it to persist() to save it to the storage engine
+		RETURNS:           Whether the snapshot was well formed
+		NOTES:             Stored accounts which are the same in the snapshot are left where they are,
+		                   and the rest are taken out, so a server starting up from its own snapshot writes next to nothing.
+		                   Nothing is saved here, since the Replica has to write out the snapshot file first
+		----------------------------------------------------------------------------- */
+		bool load(const string& data) {
+			size_t size = sizeof(Record) + 1;
+			if(data.size() % size != 0) return false;
+			vector<Account> people(data.size() / size);
+			for(size_t i = 0; i < people.size(); i++) {
+				Record rec;
+				memcpy(&rec, data.data() + i * size, sizeof(Record));
+				fromRecord(&rec, &people[i], NO_SLOT);
+				people[i].closed = data[i * size + sizeof(Record)] != 0;
+				people[i].dirty = !people[i].closed;
+			}
+			//Only one account with any number is ever open at a time
+			map<unsigned long long, Account*> open;
+			for(Account& acc : people) {
+				if(!acc.closed) open[accountKey(acc.number)] = &acc;
+			}
+
+			lock_guard<mutex> hold(state->writer);
+			for(Account& acc : *state->people) {
+				if(acc.slot == NO_SLOT || (acc.closed && !acc.dirty)) continue;
+				map<unsigned long long, Account*>::iterator it = open.find(accountKey(acc.number));
+				if(!acc.closed && !acc.dirty && it != open.end() && sameAccount(&acc, it->second)) {
+					it->second->slot = acc.slot;
+					it->second->version = acc.version;
+					it->second->dirty = false;
+					continue;
+				}
+				acc.closed = true;
+				dropped.push_back(acc);
+			}
+			state->people->swap(people);
+			state->index->rebuild(state->people);
+			return true;
+		}
+
+		bool persist() {
+			lock_guard<mutex> hold(state->writer);
+			bool ok = true;
+			for(Account& acc : dropped) ok = state->storage->put(&acc) && ok;
+			dropped.clear();
+			if(WriteOnShutdown::saveDatabase(state->people, state->storage) && ok) return true;
+			state->failed = true;
+			return false;
+		}
+};
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          stopServer()
+DESCRIPTION:       Tells the server to stop, waking up the listener and every client thread
+RETURNS:           Void function
+NOTES:             Shutting a socket down wakes up anything waiting on it, without closing it under them
+----------------------------------------------------------------------------- */
+static void stopServer(ServerState* state) {
+	lock_guard<mutex> hold(state->clientsLock);
+	state->stop = true;
+	shutdown(state->listener, SHUT_RDWR);
+	for(ClientSlot& client : state->clients) {
+		if(client.busy) shutdown(client.fd, SHUT_RDWR);
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          serveClient()
+DESCRIPTION:       Answers frames from one client until it hangs up, sends something malformed, or the server stops
+RETURNS:           False only if the changes couldn't be saved
+----------------------------------------------------------------------------- */
+static bool serveClient(ServerState* state, unsigned int reader, int fd) {
+	unique_ptr<Transport> transport(new SocketTransport(fd));
+	FrameHeader header;
+	vector<char> body, out;
+	unsigned int pinned = NO_NODE;
+	while(!state->stop && transport->read(&header, sizeof(FrameHeader))) {
+		if(header.magic != WIRE_MAGIC || header.version != WIRE_VERSION || header.length > WIRE_MAX_FRAME) return true;
+		body.resize(header.length);
+		if(!transport->read(body.data(), body.size())) return true;
+
+		FrameHeader answer = header;
+		FrameEffects effects = {false, false, nullptr};
+		out.assign((char*) &answer, (char*) &answer + sizeof(FrameHeader));
+		bool ok = runFrame(state, reader, &header, &body, &out, &effects);
+		//The channel has to be let go of even if the frame was no good
+		unique_ptr<Transport> ring(effects.attach == nullptr ? nullptr : new RingTransport(effects.attach, true, fd));
+		if(!ok) return true;
+		//Frames which only look things up don't need to wait on the storage engine
+		if(effects.changed) {
+			lock_guard<mutex> hold(state->writer);
+			if(!WriteOnShutdown::saveDatabase(state->people, state->storage)) return false;
+		}
+
+		answer.length = out.size() - sizeof(FrameHeader);
+		memcpy(out.data(), &answer, sizeof(FrameHeader));
+		if(!transport->write(out.data(), out.size())) return true;
+		//The answer to the attach itself still goes over the socket
+		if(ring != nullptr) transport = move(ring);
+
+		//Move onto the node whose accounts the client has been looking up the most
+		unsigned int home = state->index->homeNode(reader);
+		if(home != NO_NODE && home != pinned && pinToNode(home)) pinned = home;
+		if(effects.stop) stopServer(state);
+	}
+	return true;
+}
+
+static void runClient(ServerState* state, unsigned int reader) {
+	ClientSlot& client = state->clients[reader];
+	if(!serveClient(state, reader, client.fd)) state->failed = true;
+	if(state->failed) stopServer(state);
+
+	lock_guard<mutex> hold(state->clientsLock);
+	close(client.fd);
+	client.fd = -1;
+	client.busy = false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          serve()
+DESCRIPTION:       Listens on a Unix socket and answers clients until one of them asks the server to stop
+RETURNS:           Whether the socket could be set up and every change was saved
+NOTES:             The database must already be fully loaded and sorted.
+                   Each client gets its own thread, up to RCU_MAX_READERS at once,
+                   and any more are hung up on until one of them leaves.
+                   With a Replica, the server joins its group first, and leaves it when it stops
+----------------------------------------------------------------------------- */
+bool serve(vector<Account>* people, Storage* storage, const char* path, Replica* replica) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	if(path == nullptr || strlen(path) >= sizeof(addr.sun_path)) return false;
+	strcpy(addr.sun_path, path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener == -1) return false;
+	unlink(path);
+	if(bind(listener, (sockaddr*) &addr, sizeof(sockaddr_un)) != 0 || listen(listener, 16) != 0) {
+		close(listener);
+		return false;
+	}
+
+	AccountIndex index(people);
+	ServerState state;
+	state.people = people;
+	state.storage = storage;
+	state.index = &index;
+	state.listener = listener;
+	state.stop = false;
+	state.failed = false;
+	state.replica = replica;
+	for(ClientSlot& client : state.clients) {
+		client.fd = -1;
+		client.busy = false;
+	}
+	ServerMachine machine(&state);
+	if(replica != nullptr && !replica->start(&machine)) {
+		replica->stop();
+		close(listener);
+		unlink(path);
+		return false;
+	}
+
+	while(!state.stop) {
+		int fd = accept(listener, nullptr, nullptr);
+		if(fd == -1) {
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+			if(!state.stop) state.failed = true;
+			break;
+		}
+
+		lock_guard<mutex> hold(state.clientsLock);
+		ClientSlot* slot = nullptr;
+		unsigned int reader;
+		for(reader = 0; reader < RCU_MAX_READERS; reader++) {
+			if(!state.clients[reader].busy) {
+				slot = &state.clients[reader];
+				break;
+			}
+		}
+		if(state.stop || slot == nullptr) {
+			close(fd);
+			continue;
+		}
+		//A slot which isn't busy has a thread which is done, or none at all
+		if(slot->worker.joinable()) slot->worker.join();
+		slot->fd = fd;
+		slot->busy = true;
+		slot->worker = thread(runClient, &state, reader);
+	}
+
+	stopServer(&state);
+	//Clients waiting on a change are let go once the Replica stops
+	if(replica != nullptr) replica->stop();
+	for(ClientSlot& client : state.clients) {
+		if(client.worker.joinable()) client.worker.join();
+	}
+
+	close(listener);
+	unlink(path);
+	return !state.failed;
+}
@@ -0,0 +1,22 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              server.h
+
+DESCRIPTION:       Serves the database over a Unix socket using the binary framing in wire.h,
+                   on its own or as one of a group of servers replicated with raft.h
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <vector>
+#include "bankacct.h"
+#include "raft.h"
+
+//The Replica can be nullptr for a server on its own
+bool serve(vector<Account>*, Storage*, const char*, Replica*);
+
+#endif
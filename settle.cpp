@@ -0,0 +1,169 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              settle.cpp
+	DESCRIPTION:       Settles a batch of transfers by netting them
+	COMPILER:          Built on g++ with c++11
+
+	The transfers are added up in two steps. First each thread goes through its own stretch of the
+	batch, adding every transfer into one table for each thread, picked by a hash of the account.
+	Then each thread merges its table out of everybody's, so every account is added up by exactly
+	one thread and nobody has to lock anything.
+
+	Only what every account has at the end is checked against the rule that no balance goes below 0,
+	so a transfer can spend money which only comes in later in the batch. If an account would still
+	end up below 0, its transfers out are turned down from the last one in the batch backwards until
+	it doesn't. Turning a transfer down also takes the money away from the account it was going to,
+	which can leave that account below 0 in turn, so this goes on until no account is.
+	Everything is added up in cents, so the order things are added in never changes the result.
+----------------------------------------------------------------------------- */
+
+#include <cstdlib>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+#include "settle.h"
+
+using namespace std;
+
+typedef unordered_map<Account*, long long> NetTable;
+
+//Everything the threads share, which each of them only writes its own part of
+struct Settlement {
+	vector<BatchOp>* batch;
+	vector<long long> amounts;
+	vector<int> status;
+	//One table per thread for each thread's accounts, then the merged table for each thread's accounts
+	vector<vector<NetTable>> partial;
+	vector<NetTable> net;
+};
+
+//Spreads out account numbers which are close together, the same way the sharded batch does
+static unsigned int partitionFor(Account* acc, unsigned int threads) {
+	unsigned long long hash = accountKey(acc->number) * 0x9E3779B97F4A7C15ULL;
+	return (hash >> 32) % threads;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          addTransfers()
+DESCRIPTION:       Adds up one thread's stretch of the batch, turning down transfers between accounts which weren't found
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+static void addTransfers(Settlement* settlement, unsigned int thread, unsigned int threads) {
+	vector<BatchOp>& batch = *settlement->batch;
+	vector<NetTable>& tables = settlement->partial[thread];
+	size_t end = batch.size() * (thread + 1) / threads;
+	for(size_t i = batch.size() * thread / threads; i < end; i++) {
+		BatchOp& op = batch[i];
+		if(op.acc == nullptr) {
+			settlement->status[i] = ERR_NO_ACCOUNT;
+			continue;
+		}
+		if(op.to == nullptr) {
+			settlement->status[i] = ERR_NO_TRANSFER_ACCOUNT;
+			continue;
+		}
+		long long cents = toCents(atof(op.value));
+		settlement->amounts[i] = cents;
+		tables[partitionFor(op.acc, threads)][op.acc] -= cents;
+		tables[partitionFor(op.to, threads)][op.to] += cents;
+	}
+}
+
+//Merges one thread's accounts out of every thread's tables
+static void mergeTransfers(Settlement* settlement, unsigned int thread, unsigned int threads) {
+	NetTable& net = settlement->net[thread];
+	for(unsigned int from = 0; from < threads; from++) {
+		for(pair<Account* const, long long>& entry : settlement->partial[from][thread]) net[entry.first] += entry.second;
+		settlement->partial[from][thread].clear();
+	}
+}
+
+//Runs one step of the settlement on every thread at once
+static void onEveryThread(Settlement* settlement, unsigned int threads, void (*step)(Settlement*, unsigned int, unsigned int)) {
+	vector<thread> workers;
+	for(unsigned int i = 1; i < threads; i++) workers.push_back(thread(step, settlement, i, threads));
+	step(settlement, 0, threads);
+	for(thread& worker : workers) worker.join();
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          turnDownOverdrawn()
+DESCRIPTION:       Turns down the last transfers out of every account which would end up below 0, until none would
+RETURNS:           Void function
+NOTES:             This only happens when something would be overdrawn, so it is done on one thread.
+                   Nothing is ever turned back on, so it always finishes
+----------------------------------------------------------------------------- */
+static void turnDownOverdrawn(Settlement* settlement, unsigned int threads) {
+	NetTable net;
+	for(NetTable& table : settlement->net) net.insert(table.begin(), table.end());
+	vector<BatchOp>& batch = *settlement->batch;
+
+	vector<Account*> overdrawn;
+	for(pair<Account* const, long long>& entry : net) {
+		if(toCents(entry.first->balance) + entry.second < 0) overdrawn.push_back(entry.first);
+	}
+	if(overdrawn.empty()) return;
+
+	//Every account's transfers out, in batch order
+	unordered_map<Account*, vector<size_t>> outgoing;
+	for(size_t i = 0; i < batch.size(); i++) {
+		if(settlement->status[i] == 0) outgoing[batch[i].acc].push_back(i);
+	}
+
+	while(!overdrawn.empty()) {
+		Account* acc = overdrawn.back();
+		overdrawn.pop_back();
+		vector<size_t>& out = outgoing[acc];
+		while(toCents(acc->balance) + net[acc] < 0 && !out.empty()) {
+			size_t i = out.back();
+			out.pop_back();
+			BatchOp& op = batch[i];
+			settlement->status[i] = ERR_TOO_MUCH_TRANSFER;
+			net[acc] += settlement->amounts[i];
+			bool covered = toCents(op.to->balance) + net[op.to] >= 0;
+			net[op.to] -= settlement->amounts[i];
+			if(covered && toCents(op.to->balance) + net[op.to] < 0) overdrawn.push_back(op.to);
+		}
+	}
+
+	for(NetTable& table : settlement->net) table.clear();
+	for(pair<Account* const, long long>& entry : net) settlement->net[partitionFor(entry.first, threads)].insert(entry);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          settleBatch()
+DESCRIPTION:       Looks up every account in a batch of transfers, nets them, and changes each account's balance once
+RETURNS:           0, or the error code of the first transfer in the batch which was turned down
+NOTES:             Every transfer which isn't turned down is made. Asking for 0 threads uses every core
+----------------------------------------------------------------------------- */
+int settleBatch(vector<Account>* people, vector<BatchOp>* batch, unsigned int threads) {
+	if(batch->empty()) return 0;
+	findBatchAccounts(people, batch);
+	if(threads == 0) threads = thread::hardware_concurrency();
+	threads = max(1u, min(threads, min((unsigned int) SETTLE_MAX_THREADS, (unsigned int) batch->size())));
+
+	Settlement settlement;
+	settlement.batch = batch;
+	settlement.amounts.assign(batch->size(), 0);
+	settlement.status.assign(batch->size(), 0);
+	settlement.partial.assign(threads, vector<NetTable>(threads));
+	settlement.net.assign(threads, NetTable());
+
+	onEveryThread(&settlement, threads, addTransfers);
+	onEveryThread(&settlement, threads, mergeTransfers);
+	turnDownOverdrawn(&settlement, threads);
+
+	//Only accounts whose balance actually moved get written
+	for(NetTable& table : settlement.net) {
+		for(pair<Account* const, long long>& entry : table) {
+			if(entry.second == 0) continue;
+			entry.first->balance = (toCents(entry.first->balance) + entry.second) / 100.0;
+			entry.first->dirty = true;
+		}
+	}
+
+	for(int err : settlement.status) {
+		if(err != 0) return err;
+	}
+	return 0;
+}
@@ -0,0 +1,24 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              settle.h
+
+DESCRIPTION:       Settles a batch of transfers by netting them. Every transfer is added up into one
+                   change to each account's balance, split between threads by account, and each
+                   account is only written once no matter how many transfers it was in
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __SETTLE_H__
+#define __SETTLE_H__
+
+#include <vector>
+#include "bankacct.h"
+
+//Most threads the transfers are added up on
+#define SETTLE_MAX_THREADS 256
+
+int settleBatch(vector<Account>*, vector<BatchOp>*, unsigned int);
+
+#endif
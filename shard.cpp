@@ -0,0 +1,308 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              shard.cpp
+	DESCRIPTION:       Runs a batch thread-per-core with nothing shared
+	COMPILER:          Built on g++ with c++11
+
+	Every change is handed to the core which owns its account, in batch order, so the changes to any
+	one account are made in the same order as they would be one at a time. A transfer between two
+	cores is made in two steps: the sender's core takes the money out and sends a credit to the
+	receiver's core, which puts it in, or sends it back as a refund if the receiver has been closed.
+
+	Unlike runBatch(), a change which fails doesn't stop the rest. Changes to different accounts
+	can happen in a different order than in the batch, so a transfer can only spend money which had
+	reached the account by the time its turn came, and one to an account closed later in the batch
+	might find it already closed.
+
+	Every transfer into a hot account goes through its owner, so the owner can be kept busy while the
+	other cores wait on it. An escrowed hot account has a part of its balance on every core instead:
+	a core sending money to it adds the money to its own part, with no message and nothing shared with
+	the other cores but the account's cache line for that core. Money going out is taken by the owner,
+	out of its own part first and then out of the others, each part only giving what it has, so the
+	balance never goes below 0. The parts are folded back into the balance when the batch is done.
+	Hot accounts which the batch closes aren't escrowed, since money could still be coming in.
+----------------------------------------------------------------------------- */
+
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <new>
+#include "shard.h"
+#include "numa.h"
+
+using namespace std;
+
+struct ShardMessage {
+	unsigned char kind;
+	BatchOp* op;
+	double amount;
+};
+
+//Everything one core owns. Only the inbox is ever touched by another core
+struct Shard {
+	vector<BatchOp*> ops;
+	mutex inboxLock;
+	vector<ShardMessage> inbox;
+};
+
+//Everything about the batch the cores share, none of which they change except the counts
+struct ShardRun {
+	vector<unique_ptr<Shard>> shards;
+	//There are only ever a few hot accounts, so they are looked through rather than indexed
+	vector<unique_ptr<Escrow>> escrows;
+	BatchOp* first;
+	vector<int>* status;
+	//Cores still going through their changes, and messages sent but not handled yet
+	atomic<unsigned int> running;
+	atomic<unsigned long long> pending;
+};
+
+//Spreads out account numbers which are close together, since new accounts get numbers one after another
+static unsigned int owner(ShardRun* run, Account* acc) {
+	unsigned long long hash = accountKey(acc->number) * 0x9E3779B97F4A7C15ULL;
+	return (hash >> 32) % run->shards.size();
+}
+
+static Escrow* findEscrow(ShardRun* run, Account* acc) {
+	for(unique_ptr<Escrow>& escrow : run->escrows) {
+		if(escrow->acc == acc) return escrow.get();
+	}
+	return nullptr;
+}
+
+//Puts money into an account. An escrowed account gets it in this core's part, and any other has to belong to this core
+static void deposit(ShardRun* run, unsigned int core, Account* acc, double amount) {
+	Escrow* escrow = findEscrow(run, acc);
+	if(escrow != nullptr) {
+		escrow->slots[core].cents.fetch_add(toCents(amount));
+		return;
+	}
+	acc->balance = (toCents(acc->balance) + toCents(amount)) / 100.0;
+	acc->dirty = true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          withdraw()
+DESCRIPTION:       Takes money out of an account which belongs to this core, as long as it has that much
+RETURNS:           Whether there was enough money
+NOTES:             An escrowed account's parts are gone through starting with this core's own, taking what each has.
+                   Anything taken is put back in this core's part if the parts didn't have enough between them
+----------------------------------------------------------------------------- */
+static bool withdraw(ShardRun* run, unsigned int core, Account* acc, double amount) {
+	Escrow* escrow = findEscrow(run, acc);
+	if(escrow == nullptr) {
+		if(toCents(acc->balance) < toCents(amount)) return false;
+		acc->balance = (toCents(acc->balance) - toCents(amount)) / 100.0;
+		acc->dirty = true;
+		return true;
+	}
+
+	long long wanted = toCents(amount);
+	long long taken = 0;
+	unsigned int cores = run->shards.size();
+	for(unsigned int i = 0; i < cores && taken < wanted; i++) {
+		atomic<long long>& part = escrow->slots[(core + i) % cores].cents;
+		long long have = part.load();
+		long long take = 0;
+		do {
+			take = min(have, wanted - taken);
+		} while(take > 0 && !part.compare_exchange_weak(have, have - take));
+		if(take > 0) taken += take;
+	}
+	if(taken == wanted) return true;
+	escrow->slots[core].cents.fetch_add(taken);
+	return false;
+}
+
+static void send(ShardRun* run, unsigned int core, ShardMessage message) {
+	run->pending++;
+	Shard* shard = run->shards[core].get();
+	lock_guard<mutex> hold(shard->inboxLock);
+	shard->inbox.push_back(message);
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runShardOp()
+DESCRIPTION:       Makes one change on the core which owns its account
+RETURNS:           Void function
+NOTES:             The same checks as runBatchOp(), except that the receiver of a transfer on
+                   another core can't be looked at here, so that's left to its own core
+----------------------------------------------------------------------------- */
+static void runShardOp(ShardRun* run, unsigned int core, BatchOp* op) {
+	int& status = (*run->status)[op - run->first];
+	if(op->acc == nullptr || op->acc->closed) {
+		status = ERR_NO_ACCOUNT;
+		return;
+	}
+	if(op->change != O_TRANS) {
+		status = runBatchOp(op);
+		return;
+	}
+
+	if(op->to == nullptr) {
+		status = ERR_NO_TRANSFER_ACCOUNT;
+		return;
+	}
+	unsigned int to = owner(run, op->to);
+	bool escrowed = findEscrow(run, op->acc) != nullptr || findEscrow(run, op->to) != nullptr;
+	if(to == core && !escrowed) {
+		status = runBatchOp(op);
+		return;
+	}
+	if(op->to->closed && (to == core || findEscrow(run, op->to) != nullptr)) {
+		status = ERR_NO_TRANSFER_ACCOUNT;
+		return;
+	}
+	double amount = atof(op->value);
+	if(!withdraw(run, core, op->acc, amount)) {
+		status = ERR_TOO_MUCH_TRANSFER;
+		return;
+	}
+	//Money for an escrowed account goes straight into this core's part of it
+	if(to == core || findEscrow(run, op->to) != nullptr) deposit(run, core, op->to, amount);
+	else send(run, to, {SHARD_CREDIT, op, amount});
+}
+
+static void handleMessage(ShardRun* run, unsigned int core, ShardMessage* message) {
+	BatchOp* op = message->op;
+	if(message->kind == SHARD_REFUND) {
+		deposit(run, core, op->acc, message->amount);
+	} else if(op->to->closed) {
+		(*run->status)[op - run->first] = ERR_NO_TRANSFER_ACCOUNT;
+		send(run, owner(run, op->acc), {SHARD_REFUND, op, message->amount});
+	} else {
+		deposit(run, core, op->to, message->amount);
+	}
+	//Only counted as handled after anything it sent has been counted
+	run->pending--;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runShard()
+DESCRIPTION:       Runs one core's changes, handling messages from the other cores in between
+RETURNS:           Void function
+NOTES:             A core is done once every core has run all of its changes and no messages are left,
+                   since nothing else can send a message after that
+----------------------------------------------------------------------------- */
+static void runShard(ShardRun* run, unsigned int core) {
+	if(run->shards.size() > 1) pinToCore(core);
+	Shard* shard = run->shards[core].get();
+	vector<ShardMessage> messages;
+	size_t next = 0;
+	bool finished = false;
+
+	while(true) {
+		{
+			lock_guard<mutex> hold(shard->inboxLock);
+			messages.swap(shard->inbox);
+		}
+		for(ShardMessage& message : messages) handleMessage(run, core, &message);
+		messages.clear();
+
+		if(next < shard->ops.size()) {
+			size_t end = min(shard->ops.size(), next + SHARD_RUN_LENGTH);
+			for(; next < end; next++) runShardOp(run, core, shard->ops[next]);
+			continue;
+		}
+		if(!finished) {
+			finished = true;
+			run->running--;
+		}
+		if(run->running == 0 && run->pending == 0) return;
+		this_thread::yield();
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          escrowHot()
+DESCRIPTION:       Splits the balance of every hot account between the cores, starting it all out in its owner's part
+RETURNS:           Void function
+NOTES:             Accounts given by number which aren't open, or which the batch closes, are left alone
+----------------------------------------------------------------------------- */
+static void escrowHot(ShardRun* run, vector<Account>* people, vector<BatchOp>* batch, vector<const char*>* hot) {
+	for(const char* number : *hot) {
+		if(number == nullptr) continue;
+		unsigned long long key = accountKey(number);
+		vector<Account>::iterator it = lower_bound(people->begin(), people->end(), key, [](const Account& acc, unsigned long long key) {
+			return accountKey(acc.number) < key;
+		});
+		while(it != people->end() && accountKey(it->number) == key && it->closed) it++;
+		if(it == people->end() || accountKey(it->number) != key || findEscrow(run, &*it) != nullptr) continue;
+
+		Account* acc = &*it;
+		bool closes = false;
+		for(BatchOp& op : *batch) {
+			if(op.acc == acc && op.change == O_CLOSE) closes = true;
+		}
+		if(closes) continue;
+
+		Escrow* escrow = new Escrow;
+		escrow->acc = acc;
+		for(EscrowSlot& slot : escrow->slots) slot.cents.store(0);
+		escrow->slots[owner(run, acc)].cents.store(toCents(acc->balance));
+		run->escrows.push_back(unique_ptr<Escrow>(escrow));
+	}
+}
+
+void* Escrow::operator new(size_t size) {
+	void* mem;
+	if(posix_memalign(&mem, ESCROW_SLOT_SIZE, size) != 0) throw bad_alloc();
+	return mem;
+}
+
+void Escrow::operator delete(void* mem) {
+	free(mem);
+}
+
+//Adds up the parts of every escrowed account back into its balance
+static void foldEscrows(ShardRun* run) {
+	for(unique_ptr<Escrow>& escrow : run->escrows) {
+		long long cents = 0;
+		for(EscrowSlot& slot : escrow->slots) cents += slot.cents.load();
+		if(cents == toCents(escrow->acc->balance)) continue;
+		escrow->acc->balance = cents / 100.0;
+		escrow->acc->dirty = true;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          runShardedBatch()
+DESCRIPTION:       Looks up every account in a batch, then makes the changes split between cores
+RETURNS:           0, or the error code of the first change in the batch which couldn't be made
+NOTES:             Every change which can be made is made, even after one fails.
+                   Asking for 0 cores uses every core. The hot accounts are given by number, and can be nullptr
+----------------------------------------------------------------------------- */
+int runShardedBatch(vector<Account>* people, vector<BatchOp>* batch, unsigned int cores, vector<const char*>* hot) {
+	if(batch->empty()) return 0;
+	findBatchAccounts(people, batch);
+	if(cores == 0) cores = thread::hardware_concurrency();
+	cores = max(1u, min(cores, min((unsigned int) SHARD_MAX_CORES, (unsigned int) batch->size())));
+
+	vector<int> status(batch->size(), 0);
+	ShardRun run;
+	run.first = &(*batch)[0];
+	run.status = &status;
+	run.running = cores;
+	run.pending = 0;
+	for(unsigned int core = 0; core < cores; core++) run.shards.push_back(unique_ptr<Shard>(new Shard));
+	for(BatchOp& op : *batch) {
+		//An account which wasn't found doesn't belong to anybody, so any core can turn it down
+		unsigned int core = op.acc == nullptr ? 0 : owner(&run, op.acc);
+		run.shards[core]->ops.push_back(&op);
+	}
+	if(hot != nullptr) escrowHot(&run, people, batch, hot);
+
+	//Every core gets a thread of its own, so the caller's thread is never pinned
+	vector<thread> workers;
+	for(unsigned int core = 0; core < cores; core++) workers.push_back(thread(runShard, &run, core));
+	for(thread& worker : workers) worker.join();
+	foldEscrows(&run);
+
+	for(int err : status) {
+		if(err != 0) return err;
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              shard.h
+
+DESCRIPTION:       Runs a batch thread-per-core with nothing shared. Each core owns the accounts
+                   whose numbers hash to it, only that core ever touches them, and the cores
+                   only talk to each other by sending messages. Hot accounts, which most transfers
+                   go to, can be escrowed instead, with their balance split between the cores
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include <vector>
+#include <atomic>
+#include "bankacct.h"
+
+//Most cores a batch is split between
+#define SHARD_MAX_CORES 256
+
+//Changes to run before looking for messages from the other cores
+#define SHARD_RUN_LENGTH 64
+
+//Messages between cores, which are the second half of a transfer between accounts on different cores
+//Put the money into the account being sent to
+#define SHARD_CREDIT 1
+//The account being sent to was closed, so give the money back
+#define SHARD_REFUND 2
+
+//How far apart the cores' parts of an escrowed balance are kept, so no two of them share a cache line
+#define ESCROW_SLOT_SIZE 64
+
+//One core's part of an escrowed account's balance, in cents, on a cache line of its own
+struct alignas(ESCROW_SLOT_SIZE) EscrowSlot {
+	atomic<long long> cents;
+};
+
+//A hot account whose balance is split between the cores. Any core can put money into its own part
+//without waiting on anybody, and the owner takes money out of every part, never leaving one below 0
+struct Escrow {
+	Account* acc;
+	EscrowSlot slots[SHARD_MAX_CORES];
+
+	//Plain new in C++11 doesn't line anything up past 16 bytes, which would leave every slot across two cache lines
+	static void* operator new(size_t);
+	static void operator delete(void*);
+};
+
+int runShardedBatch(vector<Account>*, vector<BatchOp>*, unsigned int, vector<const char*>*);
+
+#endif
@@ -0,0 +1,103 @@
+#!/bin/sh
+# Runs big batches of transfers between a few accounts thread-per-core on different numbers of
+# cores, with and without hot accounts split between the cores. Changes to different accounts
+# can happen in any order then, so when every account has the money for all of its transfers
+# every way has to end with the balances of making them one after another, which are worked out
+# here as well. When they don't, one core still has to give those balances, and more than one
+# has to keep the total and leave nothing below 0. A batch without /Q is scheduled around which
+# changes touch the same accounts, and has to end exactly like making the changes one after
+# another up to the first one which fails, however the threads ran. That only runs on more than
+# one thread with more than one core, so the scheduler is also run on several threads directly
+TESTS=$(cd "$(dirname "$0")" && pwd)
+BANK=$TESTS/../bankacct
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR"
+FAILED=0
+
+# Writes name.db, a text database of 50 accounts, name.ops, a batch of 3000 transfers between
+# them with a third going to A000A and some with the wrong password, name.expected, the balances
+# the batch leaves when the transfers are made one after another, skipping any which fail, and
+# name.stopped, the balances it leaves stopping at the first one which fails instead. A funded
+# batch's accounts start out with enough for every transfer out of them
+makeBatch() {
+	awk -v name=$1 -v funded=$2 -v seed=$3 -v wrong=$4 'BEGIN {
+		srand(seed)
+		letters = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+		for(i = 0; i < 50; i++) number[i] = sprintf("A%03d%s", int(i / 26), substr(letters, i % 26 + 1, 1))
+		for(op = 0; op < 3000; op++) {
+			from[op] = int(rand() * 50)
+			to[op] = rand() < 0.33 ? 0 : int(rand() * 50)
+			amount[op] = 1 + int(rand() * 6000)
+			password[op] = rand() < wrong ? "WRONG1" : "ABC123"
+			printf "/U%s,%s,T%d.%02d,%s,ABC123\n", number[from[op]], password[op], amount[op] / 100, amount[op] % 100, number[to[op]] > name ".ops"
+			if(funded) cents[from[op]] += amount[op]
+		}
+		for(i = 0; i < 50; i++) {
+			cents[i] += int(rand() * 10000)
+			printf "Last\nFirst\nM\n%09d\n775\n5550000\n%d.%02d\n%s\nABC123\n", 100000000 + i, cents[i] / 100, cents[i] % 100, number[i] > name ".db"
+		}
+		for(i = 0; i < 50; i++) stopped[i] = cents[i]
+		for(op = 0; op < 3000; op++) {
+			made = password[op] == "ABC123" && cents[from[op]] >= amount[op]
+			if(made) {
+				cents[from[op]] -= amount[op]
+				cents[to[op]] += amount[op]
+			}
+			if(!made) stop = 1
+			if(!stop) {
+				stopped[from[op]] -= amount[op]
+				stopped[to[op]] += amount[op]
+			}
+		}
+		for(i = 0; i < 50; i++) {
+			printf "%s %d.%02d\n", number[i], cents[i] / 100, cents[i] % 100 > name ".expected"
+			printf "%s %d.%02d\n", number[i], stopped[i] / 100, stopped[i] % 100 > name ".stopped"
+		}
+	}'
+}
+
+# Runs a batch on a fresh copy of its database with the options given, leaving the balances it ends with in balances
+run() {
+	cp $1.db db
+	"$BANK" /Ddb $(cat $1.ops) $2 > /dev/null
+	"$BANK" /Ddb /Rreport.txt || return 1
+	awk '$1 ~ /^A[0-9][0-9][0-9][A-Z]$/ { print $1, $NF }' report.txt > balances
+}
+
+# Checks the batch ends with the balances of making the transfers one after another, skipping
+# the ones which fail, or stopping at the first one if the balances are given as stopped
+same() {
+	if ! run $1 "$2" || ! cmp -s balances $1.${3:-expected}; then
+		echo "$1 $2: different balances than making the transfers one after another"
+		diff $1.${3:-expected} balances | head -10
+		FAILED=1
+	fi
+}
+
+# Checks the batch keeps the total and leaves every balance above 0
+kept() {
+	run $1 "$2" && awk '{ total += $2 * 100; if($2 < 0) low = 1 } END { printf "%.0f %d\n", total, low }' balances > got
+	awk '{ total += $2 * 100 } END { printf "%.0f 0\n", total }' $1.expected > want
+	if ! cmp -s got want; then
+		echo "$1 $2: the total changed or a balance went below 0"
+		FAILED=1
+	fi
+}
+
+makeBatch funded 1 93 0.02
+makeBatch tight 0 930 0.02
+makeBatch clean 1 98 0
+for options in /Q1 /Q0 /Q3 "/Q4 /JA000A" "/Q3 /JA000A /JA000B"; do
+	same funded "$options"
+	kept tight "$options"
+done
+same tight /Q1
+
+for batch in funded tight clean; do
+	same $batch "" stopped
+done
+cmp -s clean.expected clean.stopped || { echo "clean: a transfer failed"; FAILED=1; }
+"$TESTS/schedule" || FAILED=1
+
+exit $FAILED
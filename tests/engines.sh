@@ -0,0 +1,72 @@
+#!/bin/sh
+# Makes the same changes to a database with each storage engine, checking every engine gives
+# exactly the output in engines.expected. Then moves money around a text database and its
+# binary and LSM copies, checking each gives the balances in money.expected
+TESTS=$(cd "$(dirname "$0")" && pwd)
+BANK=$TESTS/../bankacct
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+FAILED=0
+
+# Opens two accounts and goes through changing them, showing them, and the errors along the way.
+# Then closes the newest account twice over, and the number of a closed account is never given out again
+changes() {
+	"$BANK" /Ddb /E$1 /OAa,Bb,C,123456789,775,5551234,ABC123; echo rc$?
+	"$BANK" /Ddb /OQq,Rr,D,987654321,555,5559999,XYZ789; echo rc$?
+	"$BANK" /Ddb /NA000A /PABC123 /FNewname /WNEWPW1 /H5551111 /LLast /I; echo rc$?
+	"$BANK" /Ddb /NA000A /PNEWPW1 /T0 /NA000B /PXYZ789 /I; echo rc$?
+	"$BANK" /Ddb /NA000A /PNEWPW1 /T1000000 /NA000B /PXYZ789; echo rc$?
+	"$BANK" /Ddb /NA000B /PXYZ789 /I; echo rc$?
+	"$BANK" /Ddb /NA000A /Pbad /I; echo rc$?
+	"$BANK" /Ddb /UA000A,NEWPW1,MZ /UA000B,XYZ789,T0,A000A,NEWPW1 /NA000A /PNEWPW1 /I; echo rc$?
+	"$BANK" /Ddb /Rrep.txt /Bexb /Yexl; echo rc$?; cat rep.txt
+	"$BANK" /Dexb /NA000B /PXYZ789 /I; echo rc$?
+	"$BANK" /Dexl /NA000A /PNEWPW1 /I; echo rc$?
+	"$BANK" /Ddb /OBb,Cc,E,111111111,555,5559999,PPP /X; echo rc$?
+	"$BANK" /Ddb /Rrep2.txt; cat rep2.txt
+	"$BANK" /Ddb /OCc,Dd,F,222222222,555,5550000,QWE456; echo rc$?
+	"$BANK" /Ddb /NA000C /PQWE456 /X; echo rc$?
+	"$BANK" /Ddb /ODd,Ee,G,333333333,555,5550000,RTY789; echo rc$?
+	"$BANK" /Ddb /NA000D /PRTY789 /X; echo rc$?
+	"$BANK" /Ddb /Bexc; echo rc$?
+	"$BANK" /Dexc /OEe,Ff,H,444444444,555,5550000,UIO123; echo rc$?
+	"$BANK" /Ddb /Ebogus /I; echo rc$?
+	"$BANK" /Dnonexist_dir/x /I /NA /PB; echo rc$?
+}
+
+# Transfers one at a time, in a sharded batch, and settled, including ones without the money
+money() {
+	"$BANK" /D$1 /NA000A /PABC123 /T10.25 /NA000B /PABC123; echo rc$?
+	"$BANK" /D$1 /NA000C /PABC123 /T5 /NA000A /PABC123; echo rc$?
+	"$BANK" /D$1 /UA000B,ABC123,T0.10,A000C,ABC123 /UA000D,ABC123,T999.99,A000C,ABC123 /Q0; echo rc$?
+	"$BANK" /D$1 /UA000A,ABC123,T1.01,A000B,ABC123 /UA000B,ABC123,T2.02,A000A,ABC123 /UA000C,ABC123,T0.01,A000D,ABC123 /Z0; echo rc$?
+	"$BANK" /D$1 /Rrep.txt; echo rc$?; cat rep.txt
+}
+
+for engine in text binary lsm memory memory-fork; do
+	mkdir "$DIR/$engine"
+	(cd "$DIR/$engine" && changes $engine > out 2>&1)
+	if ! cmp -s "$DIR/$engine/out" "$TESTS/engines.expected"; then
+		echo "$engine: changes gave different output"
+		diff "$TESTS/engines.expected" "$DIR/$engine/out" | head -20
+		FAILED=1
+	fi
+done
+
+mkdir "$DIR/money"
+cd "$DIR/money"
+printf '%s\n' Ames Ann A 111111111 775 5550001 100.00 A000A ABC123 \
+	Bell Bob B 222222222 775 5550002 25.50 A000B ABC123 \
+	Cole Cam C 333333333 775 5550003 0.10 A000C ABC123 \
+	Dunn Dee D 444444444 775 5550004 1000 A000D ABC123 > text
+"$BANK" /Dtext /Bbinary /Ylsm || { echo "couldn't copy the database to the other engines"; exit 1; }
+for engine in text binary lsm; do
+	money $engine > $engine.out 2>&1
+	if ! cmp -s $engine.out "$TESTS/money.expected"; then
+		echo "$engine: money gave different balances"
+		diff "$TESTS/money.expected" $engine.out | head -20
+		FAILED=1
+	fi
+done
+
+exit $FAILED
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Starts a replicated group of three servers and moves money until one of them is the leader,
+# then kills the leader outright straight after it answered. The other two have to elect a new
+# leader with every transfer the old one said was made, take more transfers, and bring the old
+# leader up to date once it's started again, without any server losing or repeating a transfer
+TESTS=$(cd "$(dirname "$0")" && pwd)
+BANK=$TESTS/../bankacct
+GROUP=$TESTS/group
+DIR=$(mktemp -d)
+cd "$DIR"
+PIDS=""
+trap 'kill -9 $PIDS 2> /dev/null; rm -rf "$DIR"' EXIT
+FAILED=0
+SOCKETS="$DIR/c0 $DIR/c1 $DIR/c2"
+
+# A000A starts out with 1000.00 and A000B with nothing
+printf '%s\n' Ames Ann A 111111111 775 5550001 1000.00 A000A ABC123 "" \
+	Bell Bob B 222222222 775 5550002 0.00 A000B ABC123 "" > base
+
+# Starts the nth server with whatever it already has, remembering its process as PIDn
+start() {
+	(cd n$1 && exec "$BANK" /Ddb /V$DIR/c$1,$1,$DIR/r0,$DIR/r1,$DIR/r2 > log 2>&1) &
+	eval PID$1=$!
+	PIDS="$PIDS $!"
+}
+
+# Waits for the server on a socket to have A000B at a balance, giving up after 10 seconds
+caughtUp() {
+	for try in $(seq 100); do
+		[ "$("$GROUP" balance A000B $1 2> /dev/null)" = "$2" ] && return 0
+		sleep 0.1
+	done
+	echo "$1 has A000B at $("$GROUP" balance A000B $1) instead of $2"
+	FAILED=1
+}
+
+for n in 0 1 2; do
+	mkdir n$n
+	"$BANK" /Dbase /Bn$n/db || exit 1
+	start $n
+done
+
+leader=$("$GROUP" transfer 20 A000A A000B $SOCKETS) || { echo "the group didn't make the first transfers"; exit 1; }
+eval kill -9 \$PID$leader
+survivors=$(for n in 0 1 2; do [ $n = $leader ] || echo $DIR/c$n; done)
+"$GROUP" transfer 10 A000A A000B $survivors > /dev/null || { echo "the group didn't make transfers once $leader was killed"; exit 1; }
+for socket in $survivors; do caughtUp $socket 30.00; done
+
+rm -f $DIR/c$leader $DIR/r$leader
+start $leader
+caughtUp $DIR/c$leader 30.00
+[ "$("$GROUP" balance A000A $DIR/c$leader)" = 970.00 ] || { echo "server $leader has A000A wrong"; FAILED=1; }
+
+"$GROUP" stop $SOCKETS
+exit $FAILED
@@ -0,0 +1,90 @@
+#!/bin/sh
+# Follows the change feed of a replicated group of three servers. A subscriber which read every
+# change from the leader has to be able to pick up where it left off from another server, getting
+# just the changes made since. Then one of the servers is killed while enough changes are made
+# for the others to only keep them in a snapshot, and started again. It gets sent the snapshot,
+# so its feed file has to have the changes it had made before and then a reset, and a subscriber
+# starting from before the snapshot has to be sent the reset
+TESTS=$(cd "$(dirname "$0")" && pwd)
+BANK=$TESTS/../bankacct
+GROUP=$TESTS/group
+DIR=$(mktemp -d)
+cd "$DIR"
+PIDS=""
+trap 'kill -9 $PIDS 2> /dev/null; rm -rf "$DIR"' EXIT
+FAILED=0
+SOCKETS="$DIR/c0 $DIR/c1 $DIR/c2"
+# More changes than a server makes between snapshots
+BULK=10050
+
+# A000A starts out with 1000.00 and A000B with nothing
+printf '%s\n' Ames Ann A 111111111 775 5550001 1000.00 A000A ABC123 "" \
+	Bell Bob B 222222222 775 5550002 0.00 A000B ABC123 "" > base
+
+# Starts the nth server with whatever it already has, remembering its process as PIDn
+start() {
+	rm -f $DIR/c$1 $DIR/r$1 $DIR/f$1
+	(cd n$1 && exec "$BANK" /Ddb /V$DIR/c$1,$1,$DIR/r0,$DIR/r1,$DIR/r2 /@$DIR/f$1 /%feed > log 2>&1) &
+	eval PID$1=$!
+	PIDS="$PIDS $!"
+}
+
+# Waits for the server on a socket to have A000B at a balance, giving up after 20 seconds
+caughtUp() {
+	for try in $(seq 200); do
+		[ "$("$GROUP" balance A000B $1 2> /dev/null)" = "$2" ] && return 0
+		sleep 0.1
+	done
+	echo "$1 has A000B at $("$GROUP" balance A000B $1) instead of $2"
+	exit 1
+}
+
+# Checks a feed summary from the group program against what's expected of it
+expect() {
+	[ "$1" = "$2" ] && return 0
+	echo "$3: got $1 instead of $2"
+	FAILED=1
+}
+
+for n in 0 1 2; do
+	mkdir n$n
+	"$BANK" /Dbase /Bn$n/db || exit 1
+	start $n
+done
+
+leader=$("$GROUP" transfer 20 A000A A000B $SOCKETS) || { echo "the group didn't make the first transfers"; exit 1; }
+set -- $("$GROUP" follow $DIR/f$leader 0)
+[ "$1" = 20 ] && [ "$4" = 0 ] || { echo "following from the start got $*"; exit 1; }
+last=$3
+
+leader=$("$GROUP" transfer 10 A000A A000B $SOCKETS) || exit 1
+other=$(( (leader + 1) % 3 ))
+caughtUp $DIR/c$other 30.00
+set -- $("$GROUP" follow $DIR/f$other $last)
+expect "$1 $4" "10 0" "picking up on server $other from $last"
+[ "$2" -gt "$last" ] || { echo "picking up from $last started at $2"; FAILED=1; }
+
+eval kill -9 \$PID$other
+survivors=$(for n in 0 1 2; do [ $n = $other ] || echo $DIR/c$n; done)
+"$GROUP" bulk $BULK A000A A000B $survivors || { echo "the group didn't make $BULK transfers"; exit 1; }
+for socket in $survivors; do caughtUp $socket 130.50; done
+start $other
+caughtUp $DIR/c$other 130.50
+
+# What it made before being killed, then the snapshot it was sent in place of what it missed,
+# then the same changes as the server which sent it, which was reset at the same index
+set -- $("$GROUP" feed n$other/feed)
+expect "$(( $1 - $6 )) $4" "30 1" "server $other's feed file, changes before the reset and resets"
+[ "$5" -ge 10000 ] || { echo "server $other's feed file was reset at $5"; FAILED=1; }
+afterReset="$5 $6 $3"
+matched=0
+for n in 0 1 2; do
+	[ $n = $other ] && continue
+	set -- $("$GROUP" follow $DIR/f$n $last)
+	expect "$4" 1 "following server $n from $last after the snapshot, resets"
+	[ "$5 $6 $3" = "$afterReset" ] && matched=1
+done
+[ $matched = 1 ] || { echo "no other server's feed matches server $other's feed file after its reset"; FAILED=1; }
+
+"$GROUP" stop $SOCKETS
+exit $FAILED
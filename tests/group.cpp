@@ -0,0 +1,234 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              group.cpp
+
+DESCRIPTION:       A client for the tests to drive a replicated group of servers with. Changes are
+                   sent to whichever server is the leader, trying each in turn until one of them
+                   makes it, the same as a client which didn't know which one it was. Every account's
+                   password is ABC123
+
+                   group transfer count from to socket...   Moves 1.00 at a time, printing which server made the last one
+                   group bulk count from to socket...       Moves 0.01 at a time through the leader, with lots of them in flight
+                   group balance number socket              Prints an account's balance as one server has it
+                   group follow socket cursor               Follows a server's change feed from a cursor until it goes quiet
+                   group feed file                          Reads a feed file
+                   group stop socket...                     Shuts every server down
+
+                   Following a feed or reading a file prints how many changes there were, the
+                   first and last of their indexes, how many resets there were, the index of the
+                   last of them and how many changes came after it, failing if the changes weren't
+                   in order or weren't all made
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "client.h"
+#include "cdc.h"
+
+using namespace std;
+
+#define TEST_PASS "ABC123"
+
+//How long to keep trying every server for a change to be made, in tenths of a second
+#define GROUP_TRIES 200
+
+//Transfers in each frame of a bulk run, and frames sent before reading any answers
+#define BULK_FRAME 50
+#define BULK_IN_FLIGHT 4
+
+//How long a feed has to go without sending anything to be finished, in milliseconds
+#define FEED_QUIET 1000
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          call()
+DESCRIPTION:       Sends one operation to one server on a connection of its own
+RETURNS:           The operation's status, or -1 if the server couldn't be reached
+----------------------------------------------------------------------------- */
+static int call(const char* path, function<void(BankClient*)> add, WireResult* out) {
+	BankClient client;
+	if(!client.connect(path)) return -1;
+	add(&client);
+	unsigned int id;
+	vector<WireResult> results;
+	if(client.send() == 0 || !client.receive(&id, &results) || results.size() != 1) return -1;
+	*out = results[0];
+	return out->status;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          transfer()
+DESCRIPTION:       Moves 1.00 between two accounts, trying every server until one takes it
+RETURNS:           Which server made the transfer, or -1 if none did in time
+NOTES:             Only a server which can't be reached or isn't the leader is tried again, so a
+                   transfer is never made twice. Any other status is a failure
+----------------------------------------------------------------------------- */
+static int transfer(const char* from, const char* to, char** paths, int count) {
+	for(int tries = 0; tries < GROUP_TRIES; tries++) {
+		for(int i = 0; i < count; i++) {
+			WireResult result;
+			int status = call(paths[i], [&](BankClient* client) { client->transfer(from, TEST_PASS, "1", to, TEST_PASS); }, &result);
+			if(status == 0) return i;
+			if(status != -1 && status != ERR_NOT_LEADER) {
+				cerr << "Transfer failed on " << paths[i] << " with " << status << endl;
+				return -1;
+			}
+		}
+		this_thread::sleep_for(chrono::milliseconds(100));
+	}
+	cerr << "No server made the transfer" << endl;
+	return -1;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          bulkOn()
+DESCRIPTION:       Moves 0.01 between two accounts over and over on one connection, until they've all
+                   been made or the server turns them down for not being the leader
+RETURNS:           Whether the server could be reached and nothing failed for any other reason, adding
+                   the transfers which were made to made
+NOTES:             Frames already on their way are still answered once one is turned down, so each
+                   transfer is known to have been made or not
+----------------------------------------------------------------------------- */
+static bool bulkOn(const char* from, const char* to, const char* path, unsigned int count, unsigned int* made) {
+	BankClient client;
+	if(!client.connect(path)) return true;
+	unsigned int queued = 0, unanswered = 0;
+	bool leading = true;
+	while(unanswered > 0 || (leading && queued < count)) {
+		while(leading && queued < count && unanswered < BULK_IN_FLIGHT) {
+			for(unsigned int i = 0; i < BULK_FRAME && queued < count; i++, queued++) client.transfer(from, TEST_PASS, "0.01", to, TEST_PASS);
+			if(client.send() == 0) return false;
+			unanswered++;
+		}
+		unsigned int id;
+		vector<WireResult> results;
+		if(!client.receive(&id, &results)) {
+			cerr << "Lost the connection to " << path << " with transfers unanswered" << endl;
+			return false;
+		}
+		unanswered--;
+		for(WireResult& result : results) {
+			if(result.status == 0) (*made)++;
+			else if(result.status == ERR_NOT_LEADER) leading = false;
+			else {
+				cerr << "Transfer failed on " << path << " with " << result.status << endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//Keeps on with a bulk run on whichever server is the leader, until every transfer has been made
+static bool bulk(const char* from, const char* to, unsigned int count, char** paths, int servers) {
+	unsigned int made = 0;
+	for(int tries = 0; tries < GROUP_TRIES; tries++) {
+		for(int i = 0; i < servers && made < count; i++) {
+			if(!bulkOn(from, to, paths[i], count - made, &made)) return false;
+		}
+		if(made == count) return true;
+		this_thread::sleep_for(chrono::milliseconds(100));
+	}
+	cerr << "Only " << made << " of the transfers were made" << endl;
+	return false;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          summarize()
+DESCRIPTION:       Goes through the events of a feed, printing what's described at the top
+RETURNS:           Whether every event was whole, every change was made, and their indexes went up
+----------------------------------------------------------------------------- */
+static bool summarize(const string& events) {
+	unsigned long long changes = 0, first = 0, last = 0, resets = 0, reset = 0, since = 0;
+	size_t at = 0;
+	while(at < events.size()) {
+		ChangeEvent event;
+		if(events.size() - at < sizeof(ChangeEvent)) return false;
+		memcpy(&event, events.data() + at, sizeof(ChangeEvent));
+		at += sizeof(ChangeEvent);
+		if(event.magic != CDC_MAGIC || event.index <= max(last, reset)) return false;
+		if(event.kind == CDC_RESET) {
+			resets++;
+			reset = event.index;
+			since = 0;
+			continue;
+		}
+		ResultHeader result;
+		if(event.kind != CDC_CHANGE || event.resultLength < sizeof(ResultHeader) || events.size() - at < event.opLength + event.resultLength) return false;
+		memcpy(&result, events.data() + at + event.opLength, sizeof(ResultHeader));
+		if(result.status != 0) return false;
+		at += event.opLength + event.resultLength;
+		if(changes++ == 0) first = event.index;
+		last = event.index;
+		since++;
+	}
+	cout << changes << " " << first << " " << last << " " << resets << " " << reset << " " << since << endl;
+	return true;
+}
+
+//Reads everything a server's change feed sends from a cursor, until it goes quiet
+static bool follow(const char* path, unsigned long long cursor, string* events) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1 || connect(fd, (sockaddr*) &addr, sizeof(sockaddr_un)) != 0 || write(fd, &cursor, sizeof(cursor)) != sizeof(cursor)) return false;
+	pollfd watched = {fd, POLLIN, 0};
+	char buffer[1 << 16];
+	ssize_t got = 0;
+	while(poll(&watched, 1, FEED_QUIET) > 0 && (got = read(fd, buffer, sizeof(buffer))) > 0) events->append(buffer, got);
+	close(fd);
+	return got >= 0;
+}
+
+int main(int argc, char** argv) {
+	if(argc >= 6 && !strcmp(argv[1], "transfer")) {
+		int leader = -1;
+		for(int count = atoi(argv[2]); count > 0; count--) {
+			leader = transfer(argv[3], argv[4], argv + 5, argc - 5);
+			if(leader == -1) return 1;
+		}
+		cout << leader << endl;
+		return 0;
+	}
+	if(argc >= 6 && !strcmp(argv[1], "bulk")) return bulk(argv[3], argv[4], atoi(argv[2]), argv + 5, argc - 5) ? 0 : 1;
+	if(argc == 4 && !strcmp(argv[1], "follow")) {
+		string events;
+		return follow(argv[2], strtoull(argv[3], nullptr, 10), &events) && summarize(events) ? 0 : 1;
+	}
+	if(argc == 3 && !strcmp(argv[1], "feed")) {
+		ifstream file(argv[2], ios::binary);
+		string events((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+		return file.is_open() && summarize(events) ? 0 : 1;
+	}
+	if(argc == 4 && !strcmp(argv[1], "balance")) {
+		WireResult result;
+		if(call(argv[3], [&](BankClient* client) { client->get(argv[2], TEST_PASS); }, &result) != 0 || !result.found) return 1;
+		cout << fixed << setprecision(2) << result.acc.balance << endl;
+		return 0;
+	}
+	if(argc >= 3 && !strcmp(argv[1], "stop")) {
+		for(int i = 2; i < argc; i++) {
+			WireResult result;
+			call(argv[i], [](BankClient* client) { client->shutdown(); }, &result);
+		}
+		return 0;
+	}
+	cerr << "Usage: group transfer count from to socket... | bulk count from to socket... | balance number socket |" << endl
+	     << "       follow socket cursor | feed file | stop socket..." << endl;
+	return 1;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh
+# Runs several processes against the same database at once: writers moving a cent at a time out
+# of A000A into accounts of their own, and readers writing reports in between. Every writer has
+# to wait its turn instead of saving over another's change, so nothing is lost, and every report
+# has to add up to the same total, so no reader sees a change partway through being saved. Each
+# storage engine is tried with writers locking the whole database, and with writers changing
+# accounts optimistically, which only the binary one does without the whole database locked.
+# The binary one is also tried with writers locking only the accounts they change. Working
+# optimistically, every writer takes from A000A at once, so they have to make their changes
+# over again whenever another got in first
+TESTS=$(cd "$(dirname "$0")" && pwd)
+BANK=$TESTS/../bankacct
+TRANSFERS=$TESTS/transfers
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR"
+FAILED=0
+WRITERS="B C D E"
+ROUNDS=20
+
+# A000A starts out with 100.00 and A000B to A000E with nothing
+for letter in A $WRITERS; do
+	balance=0.00
+	[ $letter = A ] && balance=100.00
+	printf '%s\n' Last First M 123456789 775 5550000 $balance A000$letter ABC123 ""
+done > base.text
+"$BANK" /Dbase.text /Bbase.binary /Ybase.lsm || { echo "couldn't copy the database to the other engines"; exit 1; }
+
+# Writes a report and checks it has every account and adds up to 100.00
+reader() {
+	for round in $(seq $ROUNDS); do
+		"$BANK" /D$1 /Rreport.$2 || { echo "report $round failed"; return; }
+		awk '$1 ~ /^A000[A-E]$/ { accounts++; total += int($NF * 100 + 0.5) } END { if(accounts != 5 || total != 10000) print "report " accounts " accounts, total " total / 100 }' report.$2
+	done
+}
+
+# Moves a cent from A000A to A000 and the letter, ROUNDS times, with the CLI as a batch or a
+# transfer, or with the library using the access given
+writer() {
+	case $2 in
+		batch) for round in $(seq $ROUNDS); do "$BANK" /D$1 /UA000A,ABC123,T0.01,A000$3,ABC123 || echo "transfer $round to A000$3 failed"; done;;
+		transfer) for round in $(seq $ROUNDS); do "$BANK" /D$1 /NA000A /PABC123 /T0.01 /NA000$3 /PABC123 || echo "transfer $round to A000$3 failed"; done;;
+		*) "$TRANSFERS" $1 $2 $ROUNDS A000A A000$3;;
+	esac
+}
+
+# Runs every writer and two readers at once, then checks A000A lost a cent for every cent the writers got
+check() {
+	rm -f db db.*
+	case $1 in
+		text) cp base.text db;;
+		binary) "$BANK" /Dbase.text /Bdb;;
+		lsm) "$BANK" /Dbase.text /Ydb;;
+	esac
+	for letter in $WRITERS; do writer db $2 $letter > out.$letter 2>&1 & done
+	reader db 1 > out.1 2>&1 &
+	reader db 2 > out.2 2>&1 &
+	wait
+	if [ -n "$(cat out.*)" ]; then
+		echo "$1 $2:"; cat out.*
+		FAILED=1
+	fi
+	"$BANK" /Ddb /Rreport.txt
+	awk -v rounds=$ROUNDS '$1 == "A000A" { if(int($NF * 100 + 0.5) != 10000 - 4 * rounds) print $1, $NF }
+	                       $1 ~ /^A000[B-E]$/ { if(int($NF * 100 + 0.5) != rounds) print $1, $NF }' report.txt > wrong
+	if [ -s wrong ]; then
+		echo "$1 $2: lost changes, ending with"; cat wrong
+		FAILED=1
+	fi
+}
+
+for engine in text binary lsm; do
+	check $engine batch
+	check $engine transfer
+done
+check binary write
+check binary records
+check binary optimistic
+
+exit $FAILED
@@ -0,0 +1,138 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              schedule.cpp
+
+DESCRIPTION:       Runs random batches both in order and scheduled on several threads, checking
+                   every account and the error code come out exactly the same. The batches go
+                   between a few accounts so most changes wait on others, and fail partway
+                   through so the changes after the failure have to be undone
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <deque>
+#include <random>
+#include "bankacct.h"
+#include "schedule.h"
+
+using namespace std;
+
+#define TEST_ACCOUNTS 20
+#define TEST_OPS 500
+#define TEST_BATCHES 40
+#define TEST_PASS "ABC123"
+
+//The accounts every batch starts from, sorted by account number. Every fourth batch gets
+//plenty of money and no wrong passwords or closed accounts, so nothing in it fails
+static void makeAccounts(vector<Account>* people, minstd_rand* random, bool plenty) {
+	people->assign(TEST_ACCOUNTS, Account());
+	for(unsigned int i = 0; i < TEST_ACCOUNTS; i++) {
+		Account& acc = (*people)[i];
+		memset(&acc, 0, sizeof(Account));
+		strcpy(acc.first, "First");
+		strcpy(acc.last, "Last");
+		acc.middle = 'M';
+		acc.social = 100000000 + i;
+		acc.area = 775;
+		acc.phone = 5550000 + i;
+		acc.balance = (plenty ? 100000 : 0) + (*random)() % 10000 / 100.0;
+		snprintf(acc.number, ACC_NUM_LENGTH + 1, "A%03u%c", i / 26, 'A' + i % 26);
+		strcpy(acc.password, TEST_PASS);
+		acc.nameLength = strlen(acc.first) + strlen(acc.last) + 4;
+		acc.slot = NO_SLOT;
+	}
+}
+
+//Keeps the text a batch points at, which doesn't move as more is added
+static char* keep(deque<string>* text, const string& value) {
+	text->push_back(value);
+	return &text->back()[0];
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          makeBatch()
+DESCRIPTION:       Makes a random batch of mostly transfers, along with field changes and now and then
+                   a wrong password or an account being closed
+RETURNS:           Nothing
+----------------------------------------------------------------------------- */
+static void makeBatch(vector<BatchOp>* batch, deque<string>* text, minstd_rand* random, bool plenty) {
+	batch->clear();
+	for(unsigned int i = 0; i < TEST_OPS; i++) {
+		BatchOp op;
+		memset(&op, 0, sizeof(BatchOp));
+		char number[ACC_NUM_LENGTH + 1];
+		unsigned int account = (*random)() % TEST_ACCOUNTS;
+		snprintf(number, sizeof(number), "A%03u%c", account / 26, 'A' + account % 26);
+		op.number = keep(text, number);
+		op.password = keep(text, !plenty && (*random)() % 100 == 0 ? "WRONG1" : TEST_PASS);
+		unsigned int kind = (*random)() % 200;
+		if(kind < 140) {
+			unsigned int to = (*random)() % TEST_ACCOUNTS;
+			snprintf(number, sizeof(number), "A%03u%c", to / 26, 'A' + to % 26);
+			op.change = O_TRANS;
+			op.value = keep(text, plenty ? "0.01" : to_string((*random)() % 40) + "." + to_string(10 + (*random)() % 90));
+			op.toNumber = keep(text, number);
+			op.toPassword = keep(text, TEST_PASS);
+		} else if(kind < 160) {
+			op.change = O_CHANGE_F;
+			op.value = keep(text, string(1 + (*random)() % 10, 'A' + (*random)() % 26));
+		} else if(kind < 180) {
+			op.change = O_CHANGE_PHONE;
+			op.value = keep(text, to_string(5550000 + (*random)() % 10000));
+		} else if(kind < 199 || plenty) {
+			op.change = O_CHANGE_M;
+			op.value = keep(text, string(1, 'A' + (*random)() % 26));
+		} else {
+			op.change = O_CLOSE;
+			op.value = keep(text, "");
+		}
+		batch->push_back(op);
+	}
+}
+
+static bool sameAccount(const Account& a, const Account& b) {
+	return !strcmp(a.first, b.first) && !strcmp(a.last, b.last) && a.middle == b.middle && a.social == b.social &&
+	       a.area == b.area && a.phone == b.phone && toCents(a.balance) == toCents(b.balance) &&
+	       !strcmp(a.number, b.number) && !strcmp(a.password, b.password) && a.closed == b.closed;
+}
+
+int main() {
+	int failed = 0;
+	for(unsigned int seed = 1; seed <= TEST_BATCHES; seed++) {
+		minstd_rand random(seed);
+		bool plenty = seed % 4 == 0;
+		vector<Account> start;
+		makeAccounts(&start, &random, plenty);
+		deque<string> text;
+		vector<BatchOp> batch;
+		makeBatch(&batch, &text, &random, plenty);
+
+		vector<Account> inOrder(start);
+		vector<BatchOp> inOrderBatch(batch);
+		int inOrderErr = runBatch(&inOrder, &inOrderBatch);
+		if(plenty && inOrderErr != 0) {
+			cout << "Batch " << seed << " failed with " << inOrderErr << " without anything which should fail" << endl;
+			failed = 1;
+		}
+
+		for(unsigned int threads : {2, 4, 8}) {
+			vector<Account> scheduled(start);
+			vector<BatchOp> scheduledBatch(batch);
+			int err = runScheduledBatch(&scheduled, &scheduledBatch, threads);
+			if(err != inOrderErr) {
+				cout << "Batch " << seed << " on " << threads << " threads gave " << err << " instead of " << inOrderErr << endl;
+				failed = 1;
+			}
+			for(unsigned int i = 0; i < TEST_ACCOUNTS; i++) {
+				if(sameAccount(scheduled[i], inOrder[i])) continue;
+				cout << "Batch " << seed << " on " << threads << " threads left " << inOrder[i].number << " different" << endl;
+				failed = 1;
+			}
+		}
+	}
+	return failed;
+}
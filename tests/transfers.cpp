@@ -0,0 +1,43 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              transfers.cpp
+
+DESCRIPTION:       Moves a cent from one account to another over and over, opening the database
+                   afresh each time with one of the kinds of access, for the tests to run several
+                   of at once against the same database. Every account's password is ABC123
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include "bank.h"
+
+using namespace std;
+
+#define TEST_PASS "ABC123"
+
+int main(int argc, char** argv) {
+	if(argc != 6) {
+		cerr << "Usage: transfers db write|records|optimistic count from to" << endl;
+		return 1;
+	}
+	int access = BANK_WRITE;
+	if(!strcmp(argv[2], "records")) access = BANK_WRITE_RECORDS;
+	else if(!strcmp(argv[2], "optimistic")) access = BANK_WRITE_OPTIMISTIC;
+	else if(strcmp(argv[2], "write")) return 1;
+
+	for(int count = atoi(argv[3]); count > 0; count--) {
+		Bank bank;
+		int err = bank.open(argv[1], nullptr, access);
+		if(err == 0) err = bank.transfer(argv[4], TEST_PASS, argv[5], TEST_PASS, "0.01");
+		if(err == 0) err = bank.commit();
+		if(err != 0) {
+			cerr << "Transfer from " << argv[4] << " failed with " << err << endl;
+			return err;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,182 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              textstore.cpp
+	DESCRIPTION:       Keeps a text database, which is read all at once and written all at once
+	COMPILER:          Built on g++ with c++11
+
+	Closed accounts stay in the table as tombstones so that slots don't move around,
+	but they are left out whenever the file is written. If the account with the highest
+	number was closed, that number is written on its own line after the last account.
+----------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+#include "textstore.h"
+
+using namespace std;
+
+/*----------------------------------------------------------------------------
+FUNCTION:          open()
+DESCRIPTION:       Loads the database from a file
+RETURNS:           Whether the database was able to be loaded
+----------------------------------------------------------------------------- */
+bool TextStore::open(const char* fileName) {
+	ifstream input(fileName);
+	if(!input.is_open()) return false;
+	name = fileName;
+
+	while(!input.eof()) {
+		Account person;
+		if(!(input >> person.last)) break;
+		if(!(input >> person.first)) {
+			//Nothing but an account number after the last account is the highest number the database has had
+			if(strlen(person.last) == ACC_NUM_LENGTH) strcpy(highest, person.last);
+			break;
+		}
+		input >> person.middle
+			  >> person.social
+			  >> person.area
+			  >> person.phone
+			  >> person.balance
+			  >> person.number
+			  >> person.password;
+		person.nameLength = strlen(person.first) + strlen(person.last) + 4;
+		person.closed = false;
+		person.slot = table.size() + 1;
+		person.dirty = false;
+		person.version = 0;
+		if(input.eof()) break;
+		table.push_back(person);
+		index.insert(make_pair(accountKey(person.number), person.slot));
+	}
+	return true;
+}
+
+/*----------------------------------------------------------------------------
+FUNCTION:          create()
+DESCRIPTION:       Creates an empty database file
+RETURNS:           Whether the file could be written
+----------------------------------------------------------------------------- */
+bool TextStore::create(const char* fileName) {
+	name = fileName;
+	table.clear();
+	index.clear();
+	highest[0] = '\0';
+	ofstream out(fileName);
+	return out.is_open();
+}
+
+/*----------------------------------------------------------------------------
+FUNCTION:          get()
+DESCRIPTION:       Finds the first open account with a given number and password
+RETURNS:           Whether the account was found
+----------------------------------------------------------------------------- */
+bool TextStore::get(const char* number, const char* password, Account* acc) {
+	pair<multimap<unsigned long long, unsigned int>::iterator, multimap<unsigned long long, unsigned int>::iterator> range = index.equal_range(accountKey(number));
+	for(multimap<unsigned long long, unsigned int>::iterator it = range.first; it != range.second; it++) {
+		Account& person = table[it->second - 1];
+		if(person.closed || strcmp(person.password, password)) continue;
+		*acc = person;
+		return true;
+	}
+	return false;
+}
+
+/*----------------------------------------------------------------------------
+FUNCTION:          put()
+DESCRIPTION:       Copies an account into the table, keeping the index up to date
+RETURNS:           Whether the account could be stored
+----------------------------------------------------------------------------- */
+bool TextStore::put(Account* acc) {
+	changed = true;
+	if(acc->slot == NO_SLOT) {
+		if(acc->closed) return true;
+		acc->slot = table.size() + 1;
+		table.push_back(*acc);
+		index.insert(make_pair(accountKey(acc->number), acc->slot));
+		return true;
+	}
+
+	Account& old = table[acc->slot - 1];
+	unsigned long long oldKey = accountKey(old.number);
+	unsigned long long key = accountKey(acc->number);
+	if(!old.closed && (acc->closed || oldKey != key)) {
+		pair<multimap<unsigned long long, unsigned int>::iterator, multimap<unsigned long long, unsigned int>::iterator> range = index.equal_range(oldKey);
+		for(multimap<unsigned long long, unsigned int>::iterator it = range.first; it != range.second; it++) {
+			if(it->second != acc->slot) continue;
+			index.erase(it);
+			break;
+		}
+	}
+	if(!acc->closed && (old.closed || oldKey != key)) index.insert(make_pair(key, acc->slot));
+	old = *acc;
+	if(acc->closed) acc->slot = NO_SLOT;
+	return true;
+}
+
+/*----------------------------------------------------------------------------
+FUNCTION:          scan()
+DESCRIPTION:       Goes through every open account in the order they were loaded
+RETURNS:           Whether every account was visited
+----------------------------------------------------------------------------- */
+bool TextStore::scan(function<bool(Account*)> visit) {
+	for(Account& acc : table) {
+		if(acc.closed) continue;
+		Account person = acc;
+		if(!visit(&person)) return false;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          commit()
+DESCRIPTION:       Writes the whole database back to its file, if anything changed
+RETURNS:           Whether the file could be written
+----------------------------------------------------------------------------- */
+bool TextStore::commit() {
+	if(!changed) return true;
+	ofstream out(name);
+	if(!out.is_open()) return false;
+	unsigned long long top = 0;
+	for(Account& acc : table) {
+		if(acc.closed) continue;
+		top = max(top, accountKey(acc.number));
+		out << acc.last<< endl
+		    << acc.first << endl
+			<< acc.middle << endl
+			<< acc.social << endl
+			<< acc.area << endl
+			<< acc.phone << endl
+			//Balances move in cents, which the default precision loses past 9999.99
+			<< fixed << setprecision(2) << acc.balance << endl
+			<< acc.number << endl
+			<< acc.password << endl << endl;
+	}
+	//Only needed once the account with the highest number is gone
+	if(accountKey(highest) > top) out << highest << endl;
+	changed = !out.good();
+	return !changed;
+}
+
+void TextStore::highestNumber(char* number) {
+	strcpy(number, highest);
+}
+
+void TextStore::keepNumber(const char* number) {
+	if(accountKey(number) <= accountKey(highest)) return;
+	strcpy(highest, number);
+	changed = true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          stats()
+DESCRIPTION:       Displays how many accounts are in the table
+RETURNS:           Void function
+----------------------------------------------------------------------------- */
+void TextStore::stats(ostream& out) {
+	unsigned int open = index.size();
+	out << "Accounts: " << open << endl
+	    << "Closed: " << table.size() - open << endl;
+}
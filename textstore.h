@@ -0,0 +1,42 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              textstore.h
+
+DESCRIPTION:       The original text database format, with each field of each account on its own line
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __TEXTSTORE_H__
+#define __TEXTSTORE_H__
+
+#include <vector>
+#include <map>
+#include <string>
+#include "bankacct.h"
+
+class TextStore : public Storage {
+	private:
+		string name;
+		//Every account in the order it was loaded or added, where slot n is table[n - 1]
+		vector<Account> table;
+		multimap<unsigned long long, unsigned int> index;
+		char highest[ACC_NUM_LENGTH + 1];
+		bool changed;
+	public:
+		TextStore() : highest(""), changed(false) {}
+
+		bool open(const char*);
+		bool create(const char*);
+		bool get(const char*, const char*, Account*);
+		bool put(Account*);
+		bool scan(function<bool(Account*)>);
+		bool commit();
+		bool checkpoint() { return commit(); }
+		void highestNumber(char*);
+		void keepNumber(const char*);
+		void stats(ostream&);
+};
+
+#endif
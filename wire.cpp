@@ -0,0 +1,48 @@
+/* -----------------------------------------------------------------------------
+
+	FILE:              wire.cpp
+	DESCRIPTION:       Socket helpers shared by the server and the client
+	COMPILER:          Built on g++ with c++11
+----------------------------------------------------------------------------- */
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "wire.h"
+
+using namespace std;
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          readFull()
+DESCRIPTION:       Reads exactly the given number of bytes, however many reads it takes
+RETURNS:           Whether all of them arrived before the other side hung up
+----------------------------------------------------------------------------- */
+bool readFull(int fd, void* buf, size_t size) {
+	char* at = (char*) buf;
+	while(size > 0) {
+		ssize_t got = read(fd, at, size);
+		if(got == -1 && errno == EINTR) continue;
+		if(got <= 0) return false;
+		at += got;
+		size -= got;
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+FUNCTION:          writeFull()
+DESCRIPTION:       Sends exactly the given number of bytes, however many writes it takes
+RETURNS:           Whether all of them could be sent
+NOTES:             The other side going away shouldn't kill the program with SIGPIPE
+----------------------------------------------------------------------------- */
+bool writeFull(int fd, const void* buf, size_t size) {
+	const char* at = (const char*) buf;
+	while(size > 0) {
+		ssize_t sent = send(fd, at, size, MSG_NOSIGNAL);
+		if(sent == -1 && errno == EINTR) continue;
+		if(sent <= 0) return false;
+		at += sent;
+		size -= sent;
+	}
+	return true;
+}
@@ -0,0 +1,86 @@
+/* -----------------------------------------------------------------------------
+
+FILE:              wire.h
+
+DESCRIPTION:       Binary framing used between the server and its clients. A frame is a header
+                   followed by any number of operations, and the server answers every frame with
+                   a frame holding one result for each operation, in the same order
+
+COMPILER:          g++ with c++ 11
+
+----------------------------------------------------------------------------- */
+
+#ifndef __WIRE_H__
+#define __WIRE_H__
+
+#include <cstddef>
+#include "bankacct.h"
+#include "binstore.h"
+
+//Start of every frame
+#define WIRE_MAGIC 0x4B4E4142
+#define WIRE_VERSION 1
+//Biggest frame body either side will take
+#define WIRE_MAX_FRAME (1 << 24)
+
+//Operations
+//Look up an account: number,password
+#define OP_GET 1
+//Make a batch change: number,password,value[,number,password], with the option letter in the change byte
+#define OP_CHANGE 2
+//Open a new account from the same value as the create option
+#define OP_CREATE 3
+//Stop the server once this frame has been answered
+#define OP_SHUTDOWN 4
+//Move the connection onto a shared memory channel, given the channel's name, once this frame has been answered
+#define OP_ATTACH 5
+
+//Frames only travel over a local socket, so everything is in the machine's own byte order
+struct FrameHeader {
+	unsigned int magic;
+	unsigned int version;
+	//Picked by the client and sent back in the answer, so pipelined frames can be matched up
+	unsigned int id;
+	//Number of operations or results
+	unsigned int count;
+	//Size of everything after the header
+	unsigned int length;
+};
+
+//Followed by each field as an unsigned short length and then its characters
+struct OpHeader {
+	unsigned char op;
+	unsigned char change;
+	unsigned short fields;
+};
+
+//Followed by a Record if found is set
+struct ResultHeader {
+	//0, or one of the exit codes
+	int status;
+	unsigned int found;
+};
+
+bool readFull(int, void*, size_t);
+bool writeFull(int, const void*, size_t);
+
+//Something frames can be sent over, so the server and client don't care whether it's a socket or shared memory
+class Transport {
+	public:
+		virtual ~Transport() {}
+		//Both wait until exactly that many bytes have been moved, returning false if the other side went away
+		virtual bool read(void*, size_t) = 0;
+		virtual bool write(const void*, size_t) = 0;
+};
+
+class SocketTransport : public Transport {
+	private:
+		int fd;
+	public:
+		SocketTransport(int a) : fd(a) {}
+
+		bool read(void* buf, size_t size) { return readFull(fd, buf, size); }
+		bool write(const void* buf, size_t size) { return writeFull(fd, buf, size); }
+};
+
+#endif